@@ -0,0 +1,194 @@
+/*
+ * The ckCore library provides core software functionality.
+ * Copyright (C) 2006-2012 Christian Kindahl
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file include/ckcore/atomicfilestream.hh
+ * @brief Stream class for atomically replacing files.
+ */
+
+#pragma once
+#include <vector>
+#include "ckcore/types.hh"
+#include "ckcore/stream.hh"
+#include "ckcore/file.hh"
+#include "ckcore/path.hh"
+#include "ckcore/thread.hh"
+
+namespace ckcore
+{
+    /**
+     * @brief Group of committed files that are made durable together.
+     *
+     * Flushing every file individually is very slow when writing a large
+     * number of files. Files committed to a batch are kept under their
+     * temporary names until the batch is committed, at which point all data
+     * is flushed concurrently before the files are moved into place. Large
+     * batches are flushed by synchronizing the whole file system.
+     */
+    class FileSyncBatch
+    {
+    private:
+        struct Pending
+        {
+            tstring temp_name;
+            tstring file_name;
+            File *file;         // Open temporary file, may be NULL.
+            bool flushed;
+        };
+
+        thread::Mutex mutex_;
+        std::vector<Pending> pending_;
+        size_t sync_all_threshold_;
+
+        void add(File *file,const Path &file_path);
+
+        FileSyncBatch(const FileSyncBatch &rhs);
+        FileSyncBatch &operator=(const FileSyncBatch &rhs);
+
+        friend class AtomicFileOutStream;
+
+    public:
+        /**
+         * Constructs a FileSyncBatch object.
+         * @param [in] sync_all_threshold The number of files from which the
+         *                                whole file system is synchronized
+         *                                instead of the individual files.
+         */
+        FileSyncBatch(size_t sync_all_threshold = 64);
+
+        /**
+         * Commits all pending files and destructs the object.
+         */
+        ~FileSyncBatch();
+
+        /**
+         * Adds a file to the batch. The file is moved into place when the
+         * batch is committed.
+         * @param [in] temp_path The path to the file holding the data.
+         * @param [in] file_path The path that the file should replace.
+         */
+        void add(const Path &temp_path,const Path &file_path);
+
+        /**
+         * Returns the number of files waiting to be committed.
+         * @return The number of pending files.
+         */
+        size_t count();
+
+        /**
+         * Flushes the data of all pending files to the storage device and
+         * moves the files into place. The batch may be reused afterwards.
+         * @return If all files were committed true is returned, otherwise
+         *         false is returned.
+         */
+        bool commit();
+    };
+
+    /**
+     * @brief Stream class for atomically replacing files.
+     *
+     * The data is written to a temporary file in the same directory as the
+     * target file, which is not replaced until the stream is committed.
+     * Readers of the target file will therefore never see partially written
+     * data. On Linux the temporary file is anonymous so nothing is left
+     * behind if the process is interrupted.
+     */
+    class AtomicFileOutStream : public OutStream
+    {
+    public:
+        /**
+         * Defines how committed files are flushed to the storage device.
+         */
+        enum Durability
+        {
+            ckDURABILITY_NONE,      ///< Rely on the operating system.
+            ckDURABILITY_FILE       ///< Flush the file and directory on commit.
+        };
+
+    private:
+        Path file_path_;
+        File *file_;
+        Durability durability_;
+        FileSyncBatch *batch_;
+
+        void reset();
+
+        AtomicFileOutStream(const AtomicFileOutStream &rhs);
+        AtomicFileOutStream &operator=(const AtomicFileOutStream &rhs);
+
+    public:
+        /**
+         * Constructs an AtomicFileOutStream object.
+         * @param [in] file_path The path to the file to write.
+         * @param [in] durability How the file should be flushed on commit.
+         */
+        AtomicFileOutStream(const Path &file_path,
+                            Durability durability = ckDURABILITY_FILE);
+
+        /**
+         * Constructs an AtomicFileOutStream object whose file is committed as
+         * part of a batch. The file is not moved into place until the batch
+         * is committed.
+         * @param [in] file_path The path to the file to write.
+         * @param [in] batch The batch to add the file to on commit.
+         */
+        AtomicFileOutStream(const Path &file_path,FileSyncBatch &batch);
+
+        /**
+         * Discards any uncommitted data and destructs the object.
+         */
+        virtual ~AtomicFileOutStream();
+
+        /**
+         * Creates the temporary file that will receive the data.
+         * @return If successfull true is returned, otherwise false.
+         */
+        bool open();
+
+        /**
+         * Replaces the target file with the written data and closes the
+         * stream.
+         * @return If successfull true is returned, otherwise false is
+         *         returned and the target file is left unchanged.
+         */
+        bool commit();
+
+        /**
+         * Closes the stream and discards the written data.
+         * @return If successfull true is returned, otherwise false.
+         */
+        bool discard();
+
+        /**
+         * Returns the preferred block size for writing the file.
+         * @return If successfull the block size in bytes is returned, otherwise
+         *         0 is returned.
+         */
+        tuint32 block_size() const;
+
+        /**
+         * Writes raw data to the stream.
+         * @param [in] buffer Pointer to the beginning of the buffer containing the
+         *                    data to be written.
+         * @param [in] count The number of bytes to write.
+         * @return If the operation failed -1 is returned, otherwise the function
+         *         returns the number of bytes written.
+         */
+        tint64 write(const void *buffer,tuint32 count);
+    };
+}
@@ -0,0 +1,169 @@
+/*
+ * The ckCore library provides core software functionality.
+ * Copyright (C) 2006-2012 Christian Kindahl
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file include/ckcore/blockchecksumstream.hh
+ * @brief Stream class for calculating per-block checksums.
+ */
+
+#pragma once
+#include <vector>
+#include "ckcore/types.hh"
+#include "ckcore/stream.hh"
+#include "ckcore/crcstream.hh"
+
+namespace ckcore
+{
+    /**
+     * @brief Manifest containing one checksum for each block of a stream.
+     */
+    class BlockManifest
+    {
+    public:
+        /**
+         * @brief Describes a range of consecutive blocks.
+         */
+        struct Range
+        {
+            tuint64 first;  ///< Index of the first block in the range.
+            tuint64 count;  ///< Number of blocks in the range.
+        };
+
+    private:
+        CrcStream::CrcType type_;
+        tuint32 block_size_;
+        tuint64 size_;      // Total number of bytes covered by the manifest.
+        std::vector<tuint32> checksums_;
+
+        friend class BlockChecksumStream;
+
+    public:
+        /**
+         * Constructs an empty BlockManifest object.
+         * @param [in] type The CRC algorithm used for the block checksums.
+         * @param [in] block_size The number of bytes in each block.
+         */
+        BlockManifest(CrcStream::CrcType type = CrcStream::ckCRC_32,
+                      tuint32 block_size = 65536);
+
+        /**
+         * Returns the CRC algorithm used for the block checksums.
+         * @return The CRC algorithm used for the block checksums.
+         */
+        CrcStream::CrcType type() const;
+
+        /**
+         * Returns the number of bytes in each block. The last block may be
+         * smaller.
+         * @return The block size in bytes.
+         */
+        tuint32 block_size() const;
+
+        /**
+         * Returns the total number of bytes covered by the manifest.
+         * @return The total number of bytes covered by the manifest.
+         */
+        tuint64 size() const;
+
+        /**
+         * Returns the number of blocks in the manifest.
+         * @return The number of blocks in the manifest.
+         */
+        tuint64 count() const;
+
+        /**
+         * Returns the checksum of the specified block.
+         * @param [in] index The block index.
+         * @return The checksum of the block.
+         */
+        tuint32 checksum(tuint64 index) const;
+
+        /**
+         * Writes the manifest to a stream in a compact binary format.
+         * @param [in] stream The stream to write to.
+         * @return If successfull true is returned, otherwise false is
+         *         returned.
+         */
+        bool save(OutStream &stream) const;
+
+        /**
+         * Reads a manifest previously written by save from a stream.
+         * @param [in] stream The stream to read from.
+         * @return If successfull true is returned, otherwise false is
+         *         returned and the manifest is left unchanged.
+         */
+        bool load(InStream &stream);
+
+        /**
+         * Reads the contents of a stream and compares it against the
+         * manifest. Reading and checksum calculation is performed in
+         * parallel using the thread pool. Blocks that could not be read
+         * because the stream is too short are reported as mismatching. Data
+         * beyond the size of the manifest is not verified.
+         * @param [in] stream The stream to verify, it should be positioned at
+         *                    the beginning of the data.
+         * @param [out] mismatches Receives the ranges of blocks that do not
+         *                         match the manifest, ordered by block index.
+         * @return If the stream could be read true is returned, otherwise
+         *         false is returned.
+         */
+        bool verify(InStream &stream,std::vector<Range> &mismatches) const;
+    };
+
+    /**
+     * @brief Stream for calculating one CRC checksum for each block of data.
+     */
+    class BlockChecksumStream : public OutStream
+    {
+    private:
+        CrcStream crc_;
+        BlockManifest manifest_;
+        tuint32 block_pos_;     // Number of bytes written to the current block.
+
+    public:
+        /**
+         * Constructs a BlockChecksumStream object.
+         * @param [in] block_size The number of bytes in each block.
+         * @param [in] type The CRC algorithm to use for the block checksums.
+         */
+        BlockChecksumStream(tuint32 block_size,
+                            CrcStream::CrcType type = CrcStream::ckCRC_32);
+
+        /**
+         * Discards all calculated checksums.
+         */
+        void reset();
+
+        /**
+         * Returns the manifest of all data written so far. If the last block
+         * is incomplete its checksum is calculated on the available data.
+         * @return The block manifest.
+         */
+        BlockManifest manifest();
+
+        /**
+         * Updates the block checksums according to the data in the specified
+         * buffer.
+         * @param [in] buffer Pointer to the beginning of a buffer containing
+         *                    the data to calculate the checksums of.
+         * @param [in] count The number of bytes in the buffer.
+         * @return The number of bytes processed (always the same as count).
+         */
+        tint64 write(const void *buffer,tuint32 count);
+    };
+}
@@ -22,14 +22,65 @@
  */
 
 #pragma once
+#include <string.h>
+#include <new>
 #include "ckcore/types.hh"
 
 namespace ckcore
 {
+    /**
+     * @brief Raw memory allocation functions used by the Buffer class.
+     */
+    class BufferStorage
+    {
+    public:
+        /**
+         * Defines where buffer memory is allocated from.
+         */
+        enum Backing
+        {
+            ckBACKING_HEAP,     ///< Allocate using the system heap.
+            ckBACKING_POOL      ///< Allocate from the buffer pool, huge pages
+                                ///< are used for large buffers if enabled in
+                                ///< the pool.
+        };
+
+        /**
+         * Allocates a block of memory.
+         * @param [in, out] size The number of bytes to allocate, receives the
+         *                       number of bytes actually allocated.
+         * @param [in] alignment The required alignment of the memory, must be
+         *                       zero or a power of two. If zero the default
+         *                       alignment of the system allocator is used.
+         * @param [in, out] backing The preferred source of the memory,
+         *                          receives the source actually used.
+         * @return If successfull a pointer to the memory is returned,
+         *         otherwise NULL is returned.
+         */
+        static void *allocate(size_t &size,size_t alignment,Backing &backing);
+
+        /**
+         * Frees a block of memory allocated by allocate.
+         * @param [in] buffer Pointer to the memory, may be NULL.
+         * @param [in] size The size returned by allocate.
+         * @param [in] alignment The alignment the memory was allocated with.
+         * @param [in] backing The backing returned by allocate.
+         */
+        static void release(void *buffer,size_t size,size_t alignment,
+                            Backing backing);
+    };
+
     /**
      * @brief Buffer class with facilities for resizing and deallocation.
+     *
+     * The buffer can be given an alignment, for example for use with SIMD
+     * instructions or unbuffered file I/O, and can be backed by the buffer
+     * pool instead of the system heap. Buffers with at most N elements are
+     * stored inside the object itself without any allocation, as long as no
+     * alignment stricter than 8 bytes is requested. Since the contents are
+     * copied using memcpy, T must be a POD type.
      */
-    template <typename T,typename S = size_t>
+    template <typename T,typename S = size_t,size_t N = 0>
     class Buffer
     {
     private:
@@ -38,31 +89,118 @@ namespace ckcore
          */
         enum
         {
-            DEFAULT_BUFFER_SIZE = 4096
+            DEFAULT_BUFFER_SIZE = 4096,
+            INLINE_ALIGNMENT = 8
         };
 
     private:
         S size_;
+        S capacity_;
         T *buffer_;
+        size_t alignment_;
+        size_t bytes_;      // Number of bytes allocated, zero if inline.
+        BufferStorage::Backing backing_;
+
+        union
+        {
+            unsigned char data[(N > 0 ? N : 1)*sizeof(T)];
+            tuint64 align_int;
+            double align_double;
+            void *align_ptr;
+        } inline_;
+
+        T *inline_buffer()
+        {
+            return reinterpret_cast<T *>(inline_.data);
+        }
+
+        bool is_inline() const
+        {
+            return bytes_ == 0;
+        }
+
+        /**
+         * Replaces the storage with storage for at least capacity elements,
+         * keeping the first count elements.
+         */
+        void reallocate(S capacity,S count)
+        {
+            T *buffer = NULL;
+            size_t bytes = 0;
+            BufferStorage::Backing backing = backing_;
+
+            if (capacity <= N && alignment_ <= INLINE_ALIGNMENT)
+            {
+                buffer = inline_buffer();
+            }
+            else
+            {
+                bytes = static_cast<size_t>(capacity)*sizeof(T);
+                buffer = static_cast<T *>(BufferStorage::allocate(bytes,alignment_,backing));
+                if (buffer == NULL)
+                    throw std::bad_alloc();
+
+                capacity = static_cast<S>(bytes/sizeof(T));
+            }
+
+            if (buffer != buffer_ && count > 0)
+                memmove(buffer,buffer_,static_cast<size_t>(count)*sizeof(T));
+
+            if (!is_inline() && buffer != buffer_)
+                BufferStorage::release(buffer_,bytes_,alignment_,backing_);
+
+            buffer_ = buffer;
+            bytes_ = bytes;
+            capacity_ = buffer == inline_buffer() ? static_cast<S>(N) : capacity;
+            backing_ = backing;
+        }
+
+        void init(S size,size_t alignment,BufferStorage::Backing backing)
+        {
+            size_ = 0;
+            capacity_ = 0;
+            buffer_ = inline_buffer();
+            alignment_ = alignment;
+            bytes_ = 0;
+            backing_ = backing;
+
+            reallocate(size,0);
+            size_ = size;
+        }
 
     public:
         /**
          * Constructs the Buffer object.
          */
         Buffer()
-            : size_(DEFAULT_BUFFER_SIZE),
-              buffer_(new T [DEFAULT_BUFFER_SIZE])
         {
+            init(DEFAULT_BUFFER_SIZE,0,BufferStorage::ckBACKING_HEAP);
         }
 
         /**
          * Constructs the Buffer object.
          * @param [in] size Buffer size.
+         * @param [in] alignment The required alignment of the buffer in
+         *                       bytes, must be zero or a power of two. If
+         *                       zero the default alignment of the system
+         *                       allocator is used.
+         * @param [in] backing Where to allocate the buffer memory from.
+         */
+        Buffer(S size,size_t alignment = 0,
+               BufferStorage::Backing backing = BufferStorage::ckBACKING_HEAP)
+        {
+            init(size,alignment,backing);
+        }
+
+        /**
+         * Constructs the Buffer object as a copy of another buffer.
+         * @param [in] rhs The buffer to copy.
          */
-        Buffer(S size)
-            : size_(size),
-              buffer_(new T [size])
+        Buffer(const Buffer &rhs)
         {
+            init(rhs.size_,rhs.alignment_,rhs.backing_);
+            if (size_ > 0)
+                memcpy(buffer_,rhs.buffer_,static_cast<size_t>(size_)*sizeof(T));
         }
 
         /**
@@ -70,24 +208,79 @@ namespace ckcore
          */
         ~Buffer()
         {
-            if (buffer_ != NULL)
+            if (!is_inline())
+                BufferStorage::release(buffer_,bytes_,alignment_,backing_);
+
+            buffer_ = NULL;
+        }
+
+        /**
+         * Copies the contents of another buffer.
+         * @param [in] rhs The buffer to copy.
+         * @return Reference to this buffer.
+         */
+        Buffer &operator=(const Buffer &rhs)
+        {
+            if (this != &rhs)
             {
-                delete [] buffer_;
-                buffer_ = NULL;
+                Buffer copy(rhs);
+                swap(copy);
             }
+
+            return *this;
         }
 
         /**
-         * Resizes the buffer, previous buffer contents will be lost.
+         * Exchanges the contents of two buffers. Heap and pool allocated
+         * memory is exchanged without copying, this should be used to
+         * transfer ownership of buffer memory.
+         * @param [in] rhs The buffer to exchange contents with.
+         */
+        void swap(Buffer &rhs)
+        {
+            bool lhs_inline = is_inline();
+            bool rhs_inline = rhs.is_inline();
+
+            unsigned char tmp_inline[sizeof(inline_.data)];
+            memcpy(tmp_inline,inline_.data,sizeof(tmp_inline));
+            memcpy(inline_.data,rhs.inline_.data,sizeof(tmp_inline));
+            memcpy(rhs.inline_.data,tmp_inline,sizeof(tmp_inline));
+
+            S tmp_size = size_; size_ = rhs.size_; rhs.size_ = tmp_size;
+            S tmp_capacity = capacity_; capacity_ = rhs.capacity_; rhs.capacity_ = tmp_capacity;
+            T *tmp_buffer = buffer_; buffer_ = rhs.buffer_; rhs.buffer_ = tmp_buffer;
+            size_t tmp_alignment = alignment_; alignment_ = rhs.alignment_; rhs.alignment_ = tmp_alignment;
+            size_t tmp_bytes = bytes_; bytes_ = rhs.bytes_; rhs.bytes_ = tmp_bytes;
+            BufferStorage::Backing tmp_backing = backing_; backing_ = rhs.backing_; rhs.backing_ = tmp_backing;
+
+            if (rhs_inline)
+                buffer_ = inline_buffer();
+            if (lhs_inline)
+                rhs.buffer_ = rhs.inline_buffer();
+        }
+
+        /**
+         * Resizes the buffer. The previous buffer contents are kept up to the
+         * new size, new elements are not initialized.
          * @param [in] size Buffer size.
          */
         void resize(S size)
         {
-            if (buffer_ != NULL)
-                delete [] buffer_;
+            if (size > capacity_)
+                reallocate(size,size_);
 
             size_ = size;
-            buffer_ = new T [size_];
+        }
+
+        /**
+         * Makes sure that the buffer can hold the specified number of
+         * elements without reallocating. The buffer contents are kept.
+         * @param [in] capacity The number of elements to reserve space for.
+         */
+        void reserve(S capacity)
+        {
+            if (capacity > capacity_)
+                reallocate(capacity,size_);
         }
 
         /**
@@ -99,6 +292,44 @@ namespace ckcore
             return size_;
         }
 
+        /**
+         * Returns the number of elements the buffer can hold without
+         * reallocating.
+         * @return The buffer capacity.
+         */
+        S capacity() const
+        {
+            return capacity_;
+        }
+
+        /**
+         * Returns the alignment the buffer was requested with.
+         * @return The buffer alignment in bytes, zero for the default
+         *         alignment.
+         */
+        size_t alignment() const
+        {
+            return alignment_;
+        }
+
+        /**
+         * Returns the buffer pointer.
+         * @return Buffer pointer.
+         */
+        T *data()
+        {
+            return buffer_;
+        }
+
+        /**
+         * Returns the buffer pointer.
+         * @return Buffer pointer.
+         */
+        const T *data() const
+        {
+            return buffer_;
+        }
+
         /**
          * Type conversion operator returning the buffer pointer.
          * @return Buffer pointer.
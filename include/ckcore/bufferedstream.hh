@@ -43,10 +43,36 @@ namespace ckcore
         // The number of valid bytes of data the buffer contains.
         unsigned long buffer_data_;
 
+        // Position of the underlying stream, -1 if unknown.
+        tint64 stream_pos_;
+
+        // Background read-ahead state, NULL if read-ahead is disabled.
+        struct ReadAhead;
+        class ReadAheadTask;
+        ReadAhead *read_ahead_;
+
+        // Initial buffer size if the buffer size is chosen automatically,
+        // otherwise zero.
+        tuint32 base_size_;
+
+        // Number of consecutive buffer refills without seeking.
+        tuint32 refills_;
+
+        void resize_buffer(tuint32 buffer_size);
+        void reset_buffer_size();
+
+        tint64 fetch();
+        void start_read_ahead();
+        void stop_read_ahead();
+        void discard_read_ahead();
+        tuint32 skip_read_ahead(tuint32 distance);
+
     public:
         /**
-         * Constructs an BufferedInStream object. The default internal buffer size
-         * is the size of the host processor level 1 cache.
+         * Constructs an BufferedInStream object. The initial internal buffer
+         * size is based on the preferred block size of the stream if it's a
+         * FileInStream. The buffer grows while the stream is read
+         * sequentially and shrinks back when seeking.
          * @param [in] stream Input stream to read from.
          */
         BufferedInStream(InStream &stream);
@@ -63,6 +89,21 @@ namespace ckcore
          */
         virtual ~BufferedInStream();
 
+        /**
+         * Enables or disables background read-ahead. When enabled, the
+         * specified number of buffers are filled from the underlying stream by
+         * a thread pool task while the current buffer is being consumed. If
+         * the underlying stream is a FileInStream the operating system is
+         * advised that the file will be read sequentially. While read-ahead is
+         * enabled the underlying stream must not be accessed directly.
+         * @param [in] depth The number of buffers to read ahead, zero disables
+         *                   read-ahead.
+         * @return If successfull true is returned, otherwise false is returned.
+         *         The function fails if data has been read ahead but not yet
+         *         consumed.
+         */
+        bool set_read_ahead(tuint32 depth);
+
         /**
          * Checks if the end of the stream has been reached.
          * @return If positioned at end of the stream true is returned,
@@ -72,8 +113,11 @@ namespace ckcore
 
         /**
          * Repositions the file pointer to the specified offset accoding to the
-         * whence directive in the stream. Please note that the seeking performance
-         * is very poor since it calls the read function and throws the data.
+         * whence directive in the stream. If the new position is inside the
+         * buffered data no data is read, otherwise the seek operation is
+         * delegated to the underlying stream. Backward seeks into the buffered
+         * data are only possible once the position is known, that is after
+         * seeking relative to the beginning of the stream.
          * @param [in] distance The number of bytes that the stream pointer should
          *                      move.
          * @param [in] whence Specifies what to use as base when calculating the
@@ -83,7 +127,9 @@ namespace ckcore
         bool seek(tuint32 distance,StreamWhence whence);
 
         /**
-         * Reads raw data from the stream.
+         * Reads raw data from the stream. Requests larger than the internal
+         * buffer are read directly from the underlying stream unless
+         * read-ahead is enabled.
          * @param [in] buffer Pointer to beginning of buffer to read to.
          * @param [in] count The number of bytes to read.
          * @return If the operation failed -1 is returned, otherwise the
@@ -112,10 +158,26 @@ namespace ckcore
         tuint32 buffer_size_;
         tuint32 buffer_pos_;
 
+        // Background write-behind state, NULL if write-behind is disabled.
+        struct WriteBehind;
+        class WriteBehindTask;
+        WriteBehind *write_behind_;
+
+        // Initial buffer size if the buffer size is chosen automatically,
+        // otherwise zero.
+        tuint32 base_size_;
+
+        // Number of consecutive full buffer writes without flushing.
+        tuint32 flushes_;
+
+        tint64 write_buffer(tuint32 count);
+
     public:
         /**
-         * Constructs an BufferedOutStream object. The default internal buffer size
-         * is the size of the host processor level 1 cache.
+         * Constructs an BufferedOutStream object. The initial internal buffer
+         * size is based on the preferred block size of the stream if it's a
+         * FileOutStream. The buffer grows while data is written without
+         * flushing.
          * @param [in] stream Output stream to write to.
          */
         BufferedOutStream(OutStream &stream);
@@ -134,7 +196,23 @@ namespace ckcore
         ~BufferedOutStream();
 
         /**
-         * Writes raw data to the stream.
+         * Enables or disables background write-behind. When enabled, full
+         * buffers are handed to a thread pool task that writes them to the
+         * underlying stream while new data is being buffered. At most depth
+         * buffers are queued at any time. If a background write fails, all
+         * following writes and flushes fail. While write-behind is enabled the
+         * underlying stream must not be accessed directly.
+         * @param [in] depth The number of buffers that may be queued for
+         *                   writing, zero disables write-behind.
+         * @return If all previously queued data was successfully written true
+         *         is returned, otherwise false is returned.
+         */
+        bool set_write_behind(tuint32 depth);
+
+        /**
+         * Writes raw data to the stream. Requests larger than the internal
+         * buffer are written directly to the underlying stream unless
+         * write-behind is enabled.
          * @param [in] buffer Pointer to the beginning of the bufferi
          *                    containing the data to be written.
          * @param [in] count The number of bytes to write.
@@ -145,7 +223,8 @@ namespace ckcore
 
         /**
          * Flushes the internal buffer, writing all buffered data to the output
-         * stream.
+         * stream. If write-behind is enabled the function waits until all
+         * queued data has been written.
          * @return If the operation failed -1 is returned, otherwise the number of
          *         bytes that where flushed is returned.
          */
@@ -0,0 +1,139 @@
+/*
+ * The ckCore library provides core software functionality.
+ * Copyright (C) 2006-2012 Christian Kindahl
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file include/ckcore/bufferpool.hh
+ * @brief Pool of page aligned I/O buffers.
+ */
+
+#pragma once
+#include <stddef.h>
+#include <vector>
+#include "ckcore/types.hh"
+#include "ckcore/memorystats.hh"
+#include "ckcore/thread.hh"
+
+namespace ckcore
+{
+    /**
+     * @brief Process wide pool of page aligned I/O buffers.
+     *
+     * Buffers are grouped in size classes of powers of two. Released buffers
+     * are kept in a small per-thread cache and in a shared free list so that
+     * they can be reused without involving the system allocator. Buffers
+     * larger than the largest size class are allocated and freed directly.
+     */
+    class BufferPool
+    {
+    public:
+        enum
+        {
+            MIN_BUFFER_SIZE = 4096,         ///< Size of the smallest size class.
+            MAX_BUFFER_SIZE = 1024*1024,    ///< Size of the largest size class.
+            NUM_SIZE_CLASSES = 9            ///< Number of size classes.
+        };
+
+    private:
+        struct ThreadCache;
+
+        thread::Mutex mutex_;
+        std::vector<void *> free_[NUM_SIZE_CLASSES];
+
+        size_t page_size_;
+        bool huge_pages_;
+
+#ifdef _UNIX
+        pthread_key_t cache_key_;
+        bool cache_key_valid_;
+
+        static void destroy_cache(void *cache);
+#endif
+
+        ThreadCache *thread_cache();
+        void release_shared(void *buffer,size_t size_class);
+
+        void *allocate_buffer(size_t size);
+        void *allocate_system(size_t size);
+        void free_system(void *buffer,size_t size);
+
+        /**
+         * Constructs the BufferPool object. The pool is a singleton and should
+         * only be accessed through the instance function.
+         */
+        BufferPool();
+        BufferPool(const BufferPool &rhs);
+        ~BufferPool();
+        BufferPool &operator=(const BufferPool &rhs);
+
+    public:
+        /**
+         * Returns the BufferPool instance. The instance is never destroyed so
+         * it may be used by threads that exit after the main thread.
+         * @return The BufferPool instance.
+         */
+        static BufferPool &instance();
+
+        /**
+         * Calculates the actual number of bytes of a buffer allocated with
+         * the specified size.
+         * @param [in] size The requested buffer size in bytes.
+         * @return The buffer capacity in bytes.
+         */
+        size_t capacity(size_t size) const;
+
+        /**
+         * Allocates a page aligned buffer.
+         * @param [in] size The requested buffer size in bytes.
+         * @param [in] tag What the buffer is used for, used for accounting.
+         * @return If successfull a pointer to the beginning of the buffer is
+         *         returned, otherwise NULL is returned.
+         */
+        void *allocate(size_t size,MemoryStats::Tag tag = MemoryStats::ckTAG_OTHER);
+
+        /**
+         * Returns a buffer to the pool.
+         * @param [in] buffer Pointer to a buffer previously returned by
+         *                    allocate, may be NULL.
+         * @param [in] size The size the buffer was allocated with.
+         * @param [in] tag The tag the buffer was allocated with.
+         */
+        void release(void *buffer,size_t size,
+                     MemoryStats::Tag tag = MemoryStats::ckTAG_OTHER);
+
+        /**
+         * Frees all buffers kept in the shared free list and in the cache of
+         * the calling thread.
+         */
+        void trim();
+
+        /**
+         * Calculates the number of bytes kept in the shared free list.
+         * @return The number of bytes kept in the shared free list.
+         */
+        tuint64 cached();
+
+        /**
+         * Enables or disables the use of huge pages for buffers larger than
+         * the largest size class. If huge pages are not available the buffers
+         * are allocated using normal pages.
+         * @param [in] enable Set to true to enable huge pages and false to
+         *                    disable them.
+         */
+        void set_huge_pages(bool enable);
+    };
+}
@@ -22,6 +22,7 @@
  */
 
 #pragma once
+#include <stddef.h>
 #include "ckcore/types.hh"
 #include "ckcore/stream.hh"
 
@@ -92,5 +93,36 @@ namespace ckcore
          * @return The number of bytes processed (always the same as count).
          */
         tint64 write(const void *buffer,tuint32 count);
+
+        /**
+         * Calculates the checksums of a number of independent buffers. The
+         * buffers are processed in interleaved lanes so that the latency of
+         * one checksum calculation is hidden behind the others, this is much
+         * faster than calling write and checksum for each small buffer. The
+         * internal checksum of the stream is not affected.
+         * @param [in] buffers Array of pointers to the buffers.
+         * @param [in] counts Array with the number of bytes in each buffer.
+         * @param [out] checksums Array receiving the final checksum of each
+         *                        buffer.
+         * @param [in] num The number of buffers.
+         */
+        void checksum_many(const void * const *buffers,const size_t *counts,
+                           tuint32 *checksums,size_t num) const;
     };
+
+    namespace crc
+    {
+        /**
+         * Calculates the checksums of a number of independent buffers using
+         * the specified CRC algorithm. See CrcStream::checksum_many.
+         * @param [in] type The CRC algorithm to use.
+         * @param [in] buffers Array of pointers to the buffers.
+         * @param [in] counts Array with the number of bytes in each buffer.
+         * @param [out] checksums Array receiving the final checksum of each
+         *                        buffer.
+         * @param [in] num The number of buffers.
+         */
+        void compute_many(CrcStream::CrcType type,const void * const *buffers,
+                          const size_t *counts,tuint32 *checksums,size_t num);
+    }
 }
@@ -35,9 +35,11 @@
 #error "Unknown platform"
 #endif
 
+#include <vector>
 #include <ckcore/types.hh>
 #include <ckcore/path.hh>
 #include <ckcore/exception.hh>
+#include <ckcore/progresser.hh>
 
 namespace ckcore
 {
@@ -63,6 +65,50 @@ namespace ckcore
             ckOPEN_READWRITE
         };
 
+        /**
+         * Defines how files should be locked when opened.
+         */
+        enum LockMode
+        {
+            ckLOCK_NONE,        ///< Don't lock the file.
+            ckLOCK_PROCESS,     ///< Lock owned by the process.
+            ckLOCK_OFD          ///< Lock owned by the open file handle.
+        };
+
+        /**
+         * @brief Options controlling how a file is opened.
+         *
+         * The default options correspond to the behavior of opening a file
+         * without any options.
+         */
+        struct OpenOptions
+        {
+            /**
+             * How to lock the file. Read mode takes a shared lock, the other
+             * modes an exclusive lock. On Unix the locks are advisory, and
+             * ckLOCK_OFD falls back to ckLOCK_PROCESS if open file description
+             * locks are not supported by the system. On Windows the lock
+             * determines the share mode and ckLOCK_NONE allows full sharing.
+             */
+            LockMode lock;
+            bool no_atime;          ///< Don't update the access time when reading (Unix only).
+            bool close_on_exec;     ///< Don't let child processes inherit the handle.
+            bool create;            ///< Create the file if it does not exist.
+            bool truncate;          ///< Truncate the file when opening it for writing.
+            bool exclusive;         ///< Fail if the file already exists, implies create.
+
+            /**
+             * Create an anonymous temporary file in the directory specified
+             * by the file path. The file is deleted when it is closed. Read
+             * mode opens the file for reading and writing.
+             */
+            bool temporary;
+
+            OpenOptions()
+                : lock(ckLOCK_PROCESS),no_atime(false),close_on_exec(false),
+                  create(false),truncate(false),exclusive(false),temporary(false) {}
+        };
+
         /**
          * Defines directives what to use as base offset when performing seek
          * operations.
@@ -74,6 +120,59 @@ namespace ckcore
             ckFILE_END
         };
 
+        /**
+         * Defines hints about how the file data will be accessed.
+         */
+        enum FileAdvice
+        {
+            ckADVICE_NORMAL,
+            ckADVICE_SEQUENTIAL,
+            ckADVICE_RANDOM,
+            ckADVICE_WILLNEED,
+            ckADVICE_DONTNEED
+        };
+
+        /**
+         * @brief File meta data obtained using a single system call.
+         *
+         * All time stamps are expressed in nanoseconds since 1970-01-01 UTC.
+         */
+        struct Info
+        {
+            tint64 size;            ///< File size in bytes.
+            tuint32 block_size;     ///< Preferred I/O size, 0 if unknown.
+            tint64 blocks;          ///< Number of allocated 512 byte blocks.
+            tuint32 mode;           ///< File type and permissions (attributes on Windows).
+            tuint64 inode;          ///< File serial number, 0 if unknown.
+            tuint64 device;         ///< Device or volume number, 0 if unknown.
+            tint64 access_time;     ///< Time of last access.
+            tint64 modify_time;     ///< Time of last modification.
+            tint64 change_time;     ///< Time of last status change.
+            tint64 create_time;     ///< Time of creation, change_time if unknown.
+        };
+
+        /**
+         * @brief Interface for receiving file contents from read_many.
+         */
+        class ReadCallback
+        {
+        public:
+            virtual ~ReadCallback() {}
+
+            /**
+             * Called when a file has been read.
+             * @param [in] index The index of the file in the list of paths.
+             * @param [in] data The file contents, only valid during the
+             *                  call. May be NULL if the file is empty.
+             * @param [in] size The number of bytes in data or -1 if the file
+             *                  could not be read.
+             * @return To continue reading files true should be returned, to
+             *         cancel the remaining files false should be returned.
+             */
+            virtual bool file_read(size_t index,const unsigned char *data,
+                                   tint64 size) = 0;
+        };
+
     private:
 #ifdef _WINDOWS
         HANDLE file_handle_;
@@ -81,9 +180,19 @@ namespace ckcore
         int file_handle_;
 #endif
         Path file_path_;
+        bool unbuffered_;   // Unbuffered I/O requested.
+        bool direct_;       // Unbuffered I/O active on the open handle.
+        bool anonymous_;    // Open file has no name.
 
         void check_file_is_open() const throw(std::exception);
 
+        tint64 read_raw(void *buffer,tint64 count);
+        tint64 write_raw(const void *buffer,tint64 count);
+        bool truncate_raw(tint64 size);
+        tint64 read_unbuffered(void *buffer,tint64 count);
+        tint64 write_unbuffered(const void *buffer,tint64 count);
+        bool fill_block(unsigned char *block,tint64 offset,tint64 file_size);
+
     public:
         /**
          * Constructs a File object.
@@ -94,24 +203,48 @@ namespace ckcore
 
         const tstring &name() const { return file_path_.name(); }
 
+        /**
+         * Enables or disables unbuffered I/O, bypassing the operating system
+         * file cache. The setting takes effect the next time the file is
+         * opened. Data not aligned to the device sector size is transferred
+         * through internal aligned buffers, so unbuffered I/O is most
+         * efficient with large, aligned requests. If the file system does not
+         * support unbuffered I/O the file is opened normally.
+         * @param [in] unbuffered Set to true to enable unbuffered I/O.
+         */
+        void set_unbuffered(bool unbuffered) { unbuffered_ = unbuffered; }
+
+        /**
+         * Checks if unbuffered I/O is used on the open file.
+         * @return If the file is open for unbuffered I/O true is returned,
+         *         otherwise false is returned.
+         */
+        bool unbuffered() const { return direct_; }
+
         /**
          * Opens the file in the requested mode.
          * @param [in] file_mode Determines how the file should be opened. In write
          *                       mode the file will be created if it does not
          *                       exist.
+         * @param [in] options Additional options controlling how the file is
+         *                     opened.
          * @return true if the file was successfully opened otherwise false is
          *         returned.
          */
-        bool open(FileMode file_mode) throw();
+        bool open(FileMode file_mode,
+                  const OpenOptions &options = OpenOptions()) throw();
 
         /**
          * Opens the file in the requested mode.
          * @param [in] file_mode Determines how the file should be opened. In write
          *                       mode the file will be created if it does not
          *                       exist.
+         * @param [in] options Additional options controlling how the file is
+         *                     opened.
          * @throw Exception object on error.
          */
-        void open2(FileMode file_mode) throw(std::exception);
+        void open2(FileMode file_mode,
+                   const OpenOptions &options = OpenOptions()) throw(std::exception);
 
         /**
          * Closes the currently opened file handle. If the file has not been opened
@@ -187,6 +320,122 @@ namespace ckcore
          */
         tint64 write(const void *buffer,tint64 count);
 
+        /**
+         * Reads raw data from the specified position in the file without
+         * moving the file pointer on Unix. On Windows the file pointer is
+         * left after the read data. Several threads may read from the same
+         * file concurrently using this function. For unbuffered files the
+         * request must be aligned to the device sector size.
+         * @param [out] buffer A pointer to the beginning of a buffer in which to
+         *                     put the data.
+         * @param [in] count The number of bytes to read from the file.
+         * @param [in] offset The position in the file to read from.
+         * @return If the operation failed -1 is returned, otherwise the function
+         *         returns the number of bytes read (this may be zero when the end
+         *         of the file has been reached).
+         */
+        tint64 read_at(void *buffer,tint64 count,tint64 offset) const;
+
+        /**
+         * Writes raw data to the specified position in the file without
+         * moving the file pointer on Unix. On Windows the file pointer is
+         * left after the written data. For unbuffered files the request must
+         * be aligned to the device sector size.
+         * @param [in] buffer A pointer to the beginning of a buffer containing
+         *                    the data to write.
+         * @param [in] count The number of bytes to write.
+         * @param [in] offset The position in the file to write to.
+         * @return If the operation failed -1 is returned, otherwise the function
+         *         returns the number of bytes written.
+         */
+        tint64 write_at(const void *buffer,tint64 count,tint64 offset);
+
+        /**
+         * Informs the operating system about how a range of the file will be
+         * accessed, allowing it to schedule read-ahead or release cached data.
+         * The advice is only a hint and may be ignored on some platforms.
+         * @param [in] advice The expected access pattern.
+         * @param [in] offset The beginning of the range.
+         * @param [in] count The number of bytes in the range, zero means until
+         *                   the end of the file.
+         * @return If successfull true is returned, otherwise false.
+         */
+        bool advise(FileAdvice advice,tint64 offset = 0,tint64 count = 0);
+
+        /**
+         * Reads a range of the file into the operating system file cache so
+         * that later reads can be served from memory. Unlike advise with
+         * ckADVICE_WILLNEED this function may block until the data has been
+         * read.
+         * @param [in] offset The beginning of the range.
+         * @param [in] count The number of bytes in the range, zero means until
+         *                   the end of the file.
+         * @return If successfull true is returned, otherwise false.
+         */
+        bool prefetch(tint64 offset = 0,tint64 count = 0);
+
+        /**
+         * Returns the preferred block size for efficient I/O on the file system
+         * where the file resides. If the file does not exist the block size of
+         * its directory is returned.
+         * @return If successfull the block size in bytes is returned, otherwise
+         *         0 is returned.
+         */
+        tuint32 block_size() const;
+
+        /**
+         * Reserves disk space for the file without changing its size. Writing
+         * a file with a known final size into reserved space avoids
+         * fragmentation and repeated allocation of new blocks. Reservation is
+         * only a hint and is ignored on file systems not supporting it.
+         * @param [in] size The number of bytes to reserve from the beginning
+         *                  of the file.
+         * @return If successfull true is returned, otherwise false.
+         */
+        bool reserve(tuint64 size);
+
+        /**
+         * Flushes all written data of the file to the storage device.
+         * @param [in] data_only If true, meta data that is not needed to read
+         *                       the data back, like time stamps, is not
+         *                       necessarily flushed.
+         * @return If successfull true is returned, otherwise false.
+         */
+        bool sync(bool data_only = false);
+
+        /**
+         * Starts writing the modified data in a range of the file to the
+         * storage device. Unlike sync, no meta data is written and the data
+         * is not guaranteed to be durable afterwards. This is only supported
+         * on Linux.
+         * @param [in] offset The offset of the first byte in the range.
+         * @param [in] count The number of bytes in the range, zero means until
+         *                   the end of the file.
+         * @param [in] wait If true the function waits until all data in the
+         *                  range has been written.
+         * @return If successfull true is returned, otherwise false.
+         */
+        bool writeback(tint64 offset,tint64 count,bool wait);
+
+        /**
+         * Checks if the file is an anonymous temporary file that has no name
+         * in the file system. Such files can be given a name using link.
+         * Anonymous files are only supported on Linux, on other systems
+         * temporary files have a unique name.
+         * @return If the file is anonymous true is returned, otherwise false
+         *         is returned.
+         */
+        bool anonymous() const { return anonymous_; }
+
+        /**
+         * Gives an anonymous file a name. The file must be open and the new
+         * name must not exist. On success the file object refers to the new
+         * path and is no longer deleted when closed.
+         * @param [in] new_file_path The name to give the file.
+         * @return If successfull true is returned, otherwise false.
+         */
+        bool link(const Path &new_file_path);
+
         /**
          * Checks whether the file exist or not.
          * @return If the file exist true is returned, otherwise false.
@@ -210,6 +459,14 @@ namespace ckcore
          */
         bool rename(const Path &new_file_path);
 
+        /**
+         * Obtains the meta data of the file. If the file is open the meta data
+         * is obtained from the file handle.
+         * @param [out] info Receives the file meta data.
+         * @return If successfull true is returned, otherwise false.
+         */
+        bool info(Info &info) const;
+
         /**
          * Obtains time stamps on when the file was last accessed, last modified
          * and created.
@@ -279,6 +536,28 @@ namespace ckcore
         static bool rename(const Path &old_file_path,
                            const Path &new_file_path);
 
+        /**
+         * Moves the old file to use the new file path, atomically replacing
+         * the new file if it exist. Readers of the new file path will either
+         * see the old contents or the new, never a missing file.
+         * @param [in] old_file_path The path to the file that should be moved.
+         * @param [in] new_file_path The path to replace.
+         * @return If the file was sucessfully moved true is returned,
+         *         otherwise false is returned.
+         */
+        static bool replace(const Path &old_file_path,
+                            const Path &new_file_path);
+
+        /**
+         * Flushes all modified data of the file system containing the
+         * specified path to the storage device. This is much faster than
+         * synchronizing a large number of files individually.
+         * @param [in] file_path A path on the file system to synchronize.
+         * @return If successfull true is returned, if the operation is not
+         *         supported by the system or failed false is returned.
+         */
+        static bool sync_all(const Path &file_path);
+
         /**
          * Obtains time stamps on when the specified file was last accessed, last
          * modified and created.
@@ -325,6 +604,56 @@ namespace ckcore
          */
         static tint64 size2(const Path &file_path) throw(std::exception);
 
+        /**
+         * Obtains the meta data of the specified file.
+         * @param [in] file_path The path to the file.
+         * @param [out] info Receives the file meta data.
+         * @return If successfull true is returned, otherwise false.
+         */
+        static bool info(const Path &file_path,Info &info);
+
+#ifndef _WINDOWS
+        /**
+         * Obtains the meta data of a file in an open directory, avoiding the
+         * need to resolve the full path. Symbolic links are not followed.
+         * @param [in] dir_handle The directory file descriptor.
+         * @param [in] file_name The name of the file in the directory.
+         * @param [out] info Receives the file meta data.
+         * @return If successfull true is returned, otherwise false.
+         */
+        static bool info(int dir_handle,const char *file_name,Info &info);
+#endif
+
+        /**
+         * Copies the contents of a file to a new file, replacing any existing
+         * file. If supported by the file system the data is shared between
+         * the files (reflink) or copied without passing through user space.
+         * Holes in sparse files are preserved where possible.
+         * @param [in] src_file_path The path to the file to copy.
+         * @param [in] dst_file_path The path to the new file.
+         * @param [in] progresser Progresser for reporting progress and
+         *                        checking for cancellation.
+         * @return If successfull true is returned, otherwise false.
+         */
+        static bool copy(const Path &src_file_path,const Path &dst_file_path,
+                         Progresser &progresser);
+
+        /**
+         * Reads the complete contents of many files. Several files are read
+         * concurrently, using io_uring on Linux and the thread pool on other
+         * systems. The callback is always called from the calling thread, in
+         * the order the files complete.
+         * @param [in] file_paths The paths to the files to read.
+         * @param [in] callback The callback receiving the file contents.
+         * @param [in] queue_depth The maximum number of files being read at
+         *                         the same time.
+         * @return If all files were processed true is returned, if cancelled
+         *         by the callback false is returned. Files that could not be
+         *         read are reported to the callback.
+         */
+        static bool read_many(const std::vector<Path> &file_paths,
+                              ReadCallback &callback,tuint32 queue_depth = 32);
+
         /**
          * Creates a File object of a temporary file. The file path is generated
          * to be placed in the systems default temporary directory.
@@ -349,13 +678,15 @@ namespace ckcore
      * @param [in] file_mode Determines how the file should be opened. In write
      *                       mode the file will be created if it does not
      *                       exist.
+     * @param [in] options Additional options controlling how the file is
+     *                     opened.
      * @return If successfull true is returned, otherwise false.
      */
-    inline bool File::open(FileMode file_mode) throw()
+    inline bool File::open(FileMode file_mode,const OpenOptions &options) throw()
     {
         try
         {
-            open2(file_mode);
+            open2(file_mode,options);
         }
         catch (...)
         {
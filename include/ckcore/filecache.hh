@@ -0,0 +1,186 @@
+/*
+ * The ckCore library provides core software functionality.
+ * Copyright (C) 2006-2012 Christian Kindahl
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file include/ckcore/filecache.hh
+ * @brief Cache of open files for positional reading.
+ */
+
+#pragma once
+#include <list>
+#include <map>
+#include "ckcore/types.hh"
+#include "ckcore/file.hh"
+#include "ckcore/path.hh"
+#include "ckcore/thread.hh"
+
+namespace ckcore
+{
+    /**
+     * @brief Bounded cache of files opened for reading.
+     *
+     * Opening the same file repeatedly through the cache only costs a meta
+     * data query, which is used to verify that the file has not been
+     * replaced or modified since it was opened. Idle files are closed in
+     * least recently used order when the cache is full. Files in the cache
+     * are only accessed using positional reads so the same handle can be
+     * shared by several readers and threads.
+     */
+    class FileCache
+    {
+    private:
+        struct Entry
+        {
+            Path path;
+            File file;
+            File::Info info;
+            size_t refs;        // Number of handles referencing the entry.
+            bool cached;        // False if not owned by the cache.
+            std::list<Entry *>::iterator lru;
+
+            Entry(const Path &path) : path(path),file(path),refs(0),cached(false) {}
+        };
+
+    public:
+        /**
+         * @brief Reference to a file in the cache.
+         *
+         * The file is kept open for as long as a handle references it. Handles
+         * may be freely copied.
+         */
+        class Handle
+        {
+        private:
+            FileCache *cache_;
+            Entry *entry_;
+
+            friend class FileCache;
+
+            Handle(FileCache *cache,Entry *entry);
+
+        public:
+            Handle();
+            Handle(const Handle &rhs);
+            ~Handle();
+
+            Handle &operator=(const Handle &rhs);
+
+            /**
+             * Releases the reference to the file.
+             */
+            void reset();
+
+            /**
+             * Checks whether the handle references an open file.
+             * @return If the handle references an open file true is returned,
+             *         otherwise false is returned.
+             */
+            bool test() const;
+
+            /**
+             * Reads raw data from the specified position in the file.
+             * @param [out] buffer A pointer to the beginning of a buffer in
+             *                     which to put the data.
+             * @param [in] count The number of bytes to read from the file.
+             * @param [in] offset The position in the file to read from.
+             * @return If the operation failed -1 is returned, otherwise the
+             *         function returns the number of bytes read (this may be
+             *         zero when the end of the file has been reached).
+             */
+            tint64 read(void *buffer,tint64 count,tint64 offset) const;
+
+            /**
+             * Returns the file meta data queried when the file was opened.
+             * @return The file meta data.
+             */
+            const File::Info &info() const;
+
+            /**
+             * Returns the underlying file object. It must only be used for
+             * operations that do not depend on the file pointer.
+             * @return The file object.
+             */
+            File &file() const;
+        };
+
+    private:
+        thread::Mutex mutex_;
+        size_t capacity_;
+        std::map<tstring,Entry *> entries_;
+        std::list<Entry *> lru_;            // Idle entries, least recent first.
+
+        void release(Entry *entry);
+        void evict(Entry *entry);
+
+        friend class Handle;
+
+        FileCache(const FileCache &rhs);
+        FileCache &operator=(const FileCache &rhs);
+
+    public:
+        /**
+         * Constructs a FileCache object.
+         * @param [in] capacity The maximum number of files kept open. The
+         *                      capacity is limited to a fraction of the
+         *                      process file descriptor limit.
+         */
+        FileCache(size_t capacity = 64);
+
+        /**
+         * Closes all idle files and destructs the object. All handles must
+         * have been released before the cache is destroyed.
+         */
+        ~FileCache();
+
+        /**
+         * Returns the process wide file cache.
+         * @return The file cache.
+         */
+        static FileCache &instance()
+        {
+            static FileCache *instance = new FileCache();
+            return *instance;
+        }
+
+        /**
+         * Opens a file for reading, reusing a previously opened file if it
+         * has not changed on disk.
+         * @param [in] file_path The path to the file.
+         * @return A handle to the file. If the file could not be opened the
+         *         handle test function returns false.
+         */
+        Handle open(const Path &file_path);
+
+        /**
+         * Closes all files that are not currently in use.
+         */
+        void clear();
+
+        /**
+         * Returns the maximum number of files kept open by the cache.
+         * @return The cache capacity.
+         */
+        size_t capacity() const;
+
+        /**
+         * Returns the number of files currently open through the cache.
+         * @return The number of open files.
+         */
+        size_t count();
+    };
+}
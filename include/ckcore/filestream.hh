@@ -25,6 +25,8 @@
 #include "ckcore/types.hh"
 #include "ckcore/stream.hh"
 #include "ckcore/file.hh"
+#include "ckcore/filecache.hh"
+#include "ckcore/filewatch.hh"
 #include "ckcore/path.hh"
 
 namespace ckcore
@@ -34,28 +36,75 @@ namespace ckcore
      */
     class FileInStream : public InStream
     {
+    public:
+        /**
+         * Defines how the file cache should be managed while reading.
+         */
+        enum AccessPolicy
+        {
+            ckACCESS_NORMAL,
+            ckACCESS_SEQUENTIAL,    ///< Aggressive read-ahead.
+            ckACCESS_DROP_BEHIND    ///< Read-ahead and release consumed data.
+        };
+
     private:
         File file_;
+        File::OpenOptions options_;
+        FileCache::Handle cached_;  // Used instead of file_ if opened through a cache.
         tint64 size_;
         tint64 read_;
+        AccessPolicy policy_;
+        tint64 dropped_;    // Data before this offset has been released.
+
+        // Follow mode state.
+        FileWatch watch_;
+        bool follow_;
+        tuint32 follow_timeout_;
+        bool closed_;       // A writer has closed the file.
+        bool eof_;          // No more data will be written.
+
+        File &active_file();
+        tint64 read_data(void *buffer,tuint32 count);
+        tint64 read_follow(void *buffer,tuint32 count);
+        void apply_policy();
+        void drop_behind(bool all);
 
     public:
         /**
          * Constructs a FileInStream object.
+         * @param [in] file_path The path to the file to read.
+         * @param [in] unbuffered Set to true to bypass the operating system
+         *                        file cache, see File::set_unbuffered.
          */
-        FileInStream(const Path &file_path);
+        FileInStream(const Path &file_path,bool unbuffered = false);
 
         /**
          * Closes the stream and destructs the object.
          */
         virtual ~FileInStream();
 
+        /**
+         * Sets the options used when opening the file. The options take
+         * effect the next time the stream is opened.
+         * @param [in] options The open options.
+         */
+        void set_options(const File::OpenOptions &options);
+
         /**
          * Opens the file for access through the stream.
          * @return If successfull true is returned, otherwise false.
          */
         bool open();
 
+        /**
+         * Opens the file through a file cache. If the file is already open in
+         * the cache and has not been modified, the open file is reused. The
+         * unbuffered mode is not used for files opened through a cache.
+         * @param [in] cache The file cache to use.
+         * @return If successfull true is returned, otherwise false.
+         */
+        bool open(FileCache &cache);
+
         /**
          * Closes the currently opened file handle. If the file has not been opened
          * a call this call will fail.
@@ -88,6 +137,50 @@ namespace ckcore
          */
         bool test() const;
 
+        /**
+         * Informs the operating system about how the remaining data in the
+         * file will be read.
+         * @param [in] advice The expected access pattern.
+         * @param [in] count The number of bytes from the current position
+         *                   that the advice applies to, zero means until the
+         *                   end of the file.
+         * @return If successfull true is returned, otherwise false.
+         */
+        bool advise(File::FileAdvice advice,tint64 count = 0);
+
+        /**
+         * Sets the policy for managing the file cache while reading. With
+         * ckACCESS_DROP_BEHIND, data is released from the cache once it has
+         * been read so that reading large files does not evict more useful
+         * data. The policy is applied immediately if the stream is open,
+         * otherwise when it is opened.
+         * @param [in] policy The access policy.
+         */
+        void set_policy(AccessPolicy policy);
+
+        /**
+         * Enables follow mode for reading files that are still being written,
+         * or named pipes. In follow mode reading at the end of the file
+         * blocks until more data is written, and the end of the stream is
+         * only reported when a writer closes the file or no data has been
+         * written within the timeout. Closing is only detected on Linux, and
+         * if the file is not being written when opened, the end is only
+         * reported after the timeout. Follow mode must be enabled before the
+         * stream is opened.
+         * @param [in] follow Set to true to enable follow mode.
+         * @param [in] timeout The number of milliseconds to wait for more data
+         *                     before reporting the end of the stream, zero
+         *                     means wait forever.
+         */
+        void set_follow(bool follow,tuint32 timeout = 0);
+
+        /**
+         * Returns the preferred block size for reading the file.
+         * @return If successfull the block size in bytes is returned, otherwise
+         *         0 is returned.
+         */
+        tuint32 block_size() const;
+
         /**
          * Reads raw data from the stream.
          * @param [in] buffer Pointer to beginning of buffer to read to.
@@ -99,7 +192,8 @@ namespace ckcore
         tint64 read(void *buffer,tuint32 count);
 
         /**
-         * Returns the size of the file provoding data for the stream.
+         * Returns the size of the file provoding data for the stream. In
+         * follow mode this is the amount of data known to exist so far.
          * @return If successfull the size in bytes of the file is returned,
          *         if unsuccessfull -1 is returned.
          */
@@ -113,18 +207,42 @@ namespace ckcore
     {
     private:
         File file_;
+        File::OpenOptions options_;
+        tuint64 expected_size_;
+
+        // Writeback state, the window size is zero if disabled.
+        tuint32 writeback_window_;
+        tint64 written_;        // Number of bytes written since opening.
+        tint64 submitted_;      // Data before this offset is being written back.
+        tint64 waited_;         // Data before this offset has been written back.
+
+        void writeback();
 
     public:
         /**
          * Constructs a FileOutStream object.
+         * @param [in] file_path The path to the file to write.
+         * @param [in] unbuffered Set to true to bypass the operating system
+         *                        file cache, see File::set_unbuffered.
+         * @param [in] expected_size The expected final size of the file. If
+         *                           non-zero the disk space is reserved when
+         *                           the file is opened.
          */
-        FileOutStream(const Path &file_path);
+        FileOutStream(const Path &file_path,bool unbuffered = false,
+                      tuint64 expected_size = 0);
 
         /**
          * Closes the stream and destructs the object.
          */
         virtual ~FileOutStream();
 
+        /**
+         * Sets the options used when opening the file. The options take
+         * effect the next time the stream is opened.
+         * @param [in] options The open options.
+         */
+        void set_options(const File::OpenOptions &options);
+
         /**
          * Opens the file for access through the stream.
          * @return If successfull true is returned, otherwise false.
@@ -138,6 +256,28 @@ namespace ckcore
          */
         bool close();
 
+        /**
+         * Enables smoothed writeback of the written data. Instead of letting
+         * modified data accumulate in the file cache until the system writes
+         * it in large bursts, writing is started as soon as each window of
+         * data is complete. Once the following window is complete the
+         * previous window is waited for and released from the cache. This
+         * keeps the amount of modified memory bounded by roughly two
+         * windows. Writeback is only supported on Linux and has no effect on
+         * unbuffered files.
+         * @param [in] window_size The number of bytes in each window, a few
+         *                         megabytes is recommended. Zero disables
+         *                         writeback control.
+         */
+        void set_writeback(tuint32 window_size);
+
+        /**
+         * Returns the preferred block size for writing the file.
+         * @return If successfull the block size in bytes is returned, otherwise
+         *         0 is returned.
+         */
+        tuint32 block_size() const;
+
         /**
          * Writes raw data to the stream.
          * @param [in] buffer Pointer to the beginning of the bufferi
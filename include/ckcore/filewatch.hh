@@ -0,0 +1,112 @@
+/*
+ * The ckCore library provides core software functionality.
+ * Copyright (C) 2006-2012 Christian Kindahl
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file include/ckcore/filewatch.hh
+ * @brief Notification of changes to files.
+ */
+
+#pragma once
+
+#ifdef _WINDOWS
+#include <windows.h>
+#endif
+
+#include "ckcore/types.hh"
+#include "ckcore/path.hh"
+
+namespace ckcore
+{
+    /**
+     * @brief Class for waiting on changes to a file.
+     *
+     * On Linux the file is watched using inotify which also reports when a
+     * writer closes the file. On Windows the directory containing the file is
+     * watched for changes, which may cause spurious notifications. Other
+     * systems periodically check the size of the file.
+     */
+    class FileWatch
+    {
+    public:
+        /**
+         * Defines the results of waiting for a change.
+         */
+        enum Event
+        {
+            ckEVENT_TIMEOUT,        ///< Nothing happened within the timeout.
+            ckEVENT_MODIFIED,       ///< The file may have been modified.
+            ckEVENT_CLOSED,         ///< A writer closed the file.
+            ckEVENT_ERROR
+        };
+
+    private:
+        Path file_path_;
+#ifdef _WINDOWS
+        HANDLE handle_;
+#else
+        int handle_;
+        bool pipe_;         // The file is a named pipe.
+        tint64 size_;       // Last known size when polling.
+#endif
+
+        FileWatch(const FileWatch &rhs);
+        FileWatch &operator=(const FileWatch &rhs);
+
+    public:
+        /**
+         * Constructs a FileWatch object.
+         * @param [in] file_path The path to the file to watch.
+         */
+        FileWatch(const Path &file_path);
+
+        /**
+         * Stops watching and destructs the object.
+         */
+        ~FileWatch();
+
+        /**
+         * Starts watching the file. Changes made after this call are reported
+         * by wait, even if they happen before wait is called.
+         * @return If successfull true is returned, otherwise false.
+         */
+        bool open();
+
+        /**
+         * Stops watching the file.
+         * @return If successfull true is returned, otherwise false.
+         */
+        bool close();
+
+        /**
+         * Checks whether the file is being watched.
+         * @return If the file is being watched true is returned, otherwise
+         *         false is returned.
+         */
+        bool test() const;
+
+        /**
+         * Waits for the file to change. For named pipes ckEVENT_CLOSED is
+         * returned immediately since reading from a pipe only returns no data
+         * once all writers have closed it.
+         * @param [in] timeout The maximum number of milliseconds to wait,
+         *                     zero means wait forever.
+         * @return The event that ended the wait.
+         */
+        Event wait(tuint32 timeout);
+    };
+}
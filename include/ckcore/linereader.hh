@@ -22,6 +22,7 @@
  */
 
 #pragma once
+#include <string.h>
 #include "ckcore/types.hh"
 #include "ckcore/stream.hh"
 
@@ -105,6 +106,29 @@ namespace ckcore
                 next_str_.clear();
             }
 
+            // Scan the stream data in place if the stream supports it. Any
+            // line break is left in the stream for the loop below.
+            const unsigned char *data = NULL;
+            tint64 avail = 0;
+            while ((avail = stream_.borrow(data,4096)) >= static_cast<tint64>(sizeof(T)))
+            {
+                tuint32 count = static_cast<tuint32>(avail)/sizeof(T);
+                tuint32 i = 0;
+                for (; i < count; i++)
+                {
+                    T c;
+                    memcpy(&c,data + i*sizeof(T),sizeof(T));
+                    if (c == '\n' || c == '\r')
+                        break;
+
+                    line.push_back(c);
+                }
+
+                stream_.seek(i*sizeof(T),InStream::ckSTREAM_CURRENT);
+                if (i < count)
+                    break;
+            }
+
             // Loop until we find line breaks or the end of stream.
             while (!stream_.end())
             {
@@ -0,0 +1,163 @@
+/*
+ * The ckCore library provides core software functionality.
+ * Copyright (C) 2006-2012 Christian Kindahl
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file include/ckcore/mappedfilestream.hh
+ * @brief Memory mapped implementation of the input stream interface.
+ */
+
+#pragma once
+
+#ifdef _WINDOWS
+#include <windows.h>
+#endif
+
+#include <stddef.h>
+#include "ckcore/types.hh"
+#include "ckcore/stream.hh"
+#include "ckcore/file.hh"
+#include "ckcore/path.hh"
+
+namespace ckcore
+{
+    /**
+     * @brief Stream class for reading memory mapped files.
+     *
+     * The file is mapped into memory, either as a whole or in windows when
+     * the address space is limited. Data can be accessed without copying
+     * through the borrow function. Please note that the file must not be
+     * truncated while it's mapped.
+     */
+    class MappedFileInStream : public InStream
+    {
+    private:
+        Path file_path_;
+#ifdef _WINDOWS
+        HANDLE file_handle_;
+        HANDLE map_handle_;
+#else
+        int file_handle_;
+#endif
+        tint64 size_;
+        tint64 pos_;
+
+        File::FileAdvice advice_;
+
+        // The currently mapped view of the file.
+        unsigned char *view_;
+        tint64 view_offset_;
+        size_t view_size_;
+        size_t window_size_;    // Maximum view size, zero maps the whole file.
+
+        bool map(tint64 offset,size_t count);
+        void unmap();
+        void apply_advice();
+
+    public:
+        /**
+         * Constructs a MappedFileInStream object.
+         * @param [in] file_path The path to the file to read.
+         * @param [in] window_size The maximum number of bytes mapped at once.
+         *                         If zero, the whole file is mapped on 64-bit
+         *                         systems and 64 MiB windows are used on
+         *                         32-bit systems.
+         */
+        MappedFileInStream(const Path &file_path,size_t window_size = 0);
+
+        /**
+         * Closes the stream and destructs the object.
+         */
+        virtual ~MappedFileInStream();
+
+        /**
+         * Opens and maps the file for access through the stream.
+         * @return If successfull true is returned, otherwise false.
+         */
+        bool open();
+
+        /**
+         * Unmaps and closes the file. If the file has not been opened a call
+         * this call will fail.
+         * @return If successfull true is returned, otherwise false.
+         */
+        bool close();
+
+        /**
+         * Checks whether the file stream has been opened or not.
+         * @return If a file stream is open true is returned, otherwise false is
+         *         returned.
+         */
+        bool test() const;
+
+        /**
+         * Informs the operating system about how the mapped data will be
+         * accessed. The advice is applied to the current and all future views
+         * of the file.
+         * @param [in] advice The expected access pattern.
+         * @return If successfull true is returned, otherwise false.
+         */
+        bool advise(File::FileAdvice advice);
+
+        /**
+         * Checks if the end of the stream has been reached.
+         * @return If positioned at end of the stream true is returned,
+         *         otherwise false is returned.
+         */
+        bool end();
+
+        /**
+         * Repositions the stream pointer to the specified offset accoding to
+         * the whence directive in the stream.
+         * @param [in] distance The number of bytes that the stream pointer
+         *                      should move.
+         * @param [in] whence Specifies what to use as base when calculating
+         *                    the final stream pointer position.
+         * @return If successfull true is returned, otherwise false is returned.
+         */
+        bool seek(tuint32 distance,StreamWhence whence);
+
+        /**
+         * Reads raw data from the stream.
+         * @param [in] buffer Pointer to beginning of buffer to read to.
+         * @param [in] count The number of bytes to read.
+         * @return If the operation failed -1 is returned, otherwise the
+         *         function returns the number of butes read (this may be zero
+         *         when the end of the file has been reached).
+         */
+        tint64 read(void *buffer,tuint32 count);
+
+        /**
+         * Gives direct access to the mapped data at the current position. The
+         * stream position is not changed.
+         * @param [out] buffer Receives a pointer to the data.
+         * @param [in] count The maximum number of bytes to borrow.
+         * @return If the operation failed -1 is returned, otherwise the
+         *         number of bytes available through buffer is returned. Less
+         *         than count bytes are returned at the end of the file or if
+         *         count is larger than the window size.
+         */
+        tint64 borrow(const unsigned char *&buffer,tuint32 count);
+
+        /**
+         * Returns the size of the file provoding data for the stream.
+         * @return If successfull the size in bytes of the file is returned,
+         *         if unsuccessfull -1 is returned.
+         */
+        tint64 size();
+    };
+}
@@ -22,7 +22,11 @@
  */
 
 #pragma once
+#include <stddef.h>
+#include <map>
+#include <new>
 #include "ckcore/types.hh"
+#include "ckcore/thread.hh"
 
 namespace ckcore
 {
@@ -47,4 +51,190 @@ namespace ckcore
             }
         }
     };
+
+    /**
+     * @brief Monotonic memory arena for short lived allocations.
+     *
+     * Memory is allocated by bumping a pointer in large blocks obtained from
+     * the buffer pool. Individual allocations are never freed, instead all
+     * memory is released at once when the arena is reset or destroyed. No
+     * destructors are called for objects placed in the arena.
+     *
+     * An arena must only be used by one thread at a time. Worker threads
+     * may use their own sub-arena obtained through local() to allocate
+     * without any locking, the sub-arenas are released together with their
+     * parent.
+     */
+    class Arena
+    {
+    public:
+        enum
+        {
+            DEFAULT_BLOCK_SIZE = 64*1024,
+            DEFAULT_ALIGNMENT = 2*sizeof(void *)
+        };
+
+    private:
+        struct Block
+        {
+            Block *next;
+            size_t size;        // Number of bytes allocated from the pool.
+        };
+
+        Block *blocks_;         // The first block is the current one.
+        unsigned char *pos_;
+        unsigned char *end_;
+        size_t block_size_;
+        size_t used_;
+        size_t capacity_;
+
+        thread::Mutex mutex_;
+        std::map<thandle,Arena *> locals_;
+
+        Block *allocate_block(size_t size);
+
+        Arena(const Arena &rhs);
+        Arena &operator=(const Arena &rhs);
+
+    public:
+        /**
+         * Constructs an Arena object.
+         * @param [in] block_size The number of bytes to allocate from the
+         *                        buffer pool at a time.
+         */
+        Arena(size_t block_size = DEFAULT_BLOCK_SIZE);
+
+        /**
+         * Releases all memory of the arena and its sub-arenas.
+         */
+        ~Arena();
+
+        /**
+         * Allocates memory from the arena.
+         * @param [in] size The number of bytes to allocate.
+         * @param [in] alignment The required alignment, must be a power of
+         *                       two not larger than the page size. If zero
+         *                       DEFAULT_ALIGNMENT is used.
+         * @return If successfull a pointer to the memory is returned,
+         *         otherwise NULL is returned.
+         */
+        void *allocate(size_t size,size_t alignment = 0);
+
+        /**
+         * Releases all memory allocated from the arena and its sub-arenas.
+         * Memory previously returned by allocate must not be used after this
+         * call.
+         */
+        void reset();
+
+        /**
+         * Returns the sub-arena of the calling thread, creating it if
+         * necessary. This function is thread-safe, but since it requires a
+         * lookup the returned reference should be kept for the duration of
+         * the work performed by the thread.
+         * @return The sub-arena of the calling thread.
+         */
+        Arena &local();
+
+        /**
+         * Returns the number of bytes allocated from the arena, excluding
+         * sub-arenas.
+         * @return The number of bytes allocated from the arena.
+         */
+        size_t used() const;
+
+        /**
+         * Returns the number of bytes the arena holds from the buffer pool,
+         * excluding sub-arenas.
+         * @return The number of bytes held by the arena.
+         */
+        size_t capacity() const;
+    };
+
+    /**
+     * @brief Standard library allocator using an Arena.
+     *
+     * Deallocation does nothing, memory is released with the arena. The
+     * arena must outlive all containers using it.
+     */
+    template <typename T>
+    class ArenaAllocator
+    {
+    public:
+        typedef T value_type;
+        typedef T *pointer;
+        typedef const T *const_pointer;
+        typedef T &reference;
+        typedef const T &const_reference;
+        typedef size_t size_type;
+        typedef ptrdiff_t difference_type;
+
+        template <typename U>
+        struct rebind
+        {
+            typedef ArenaAllocator<U> other;
+        };
+
+    private:
+        Arena *arena_;
+
+        template <typename U>
+        friend class ArenaAllocator;
+
+    public:
+        ArenaAllocator(Arena &arena) : arena_(&arena) {}
+
+        template <typename U>
+        ArenaAllocator(const ArenaAllocator<U> &rhs) : arena_(rhs.arena_) {}
+
+        pointer address(reference x) const
+        {
+            return &x;
+        }
+
+        const_pointer address(const_reference x) const
+        {
+            return &x;
+        }
+
+        pointer allocate(size_type n,const void * = 0)
+        {
+            void *ptr = arena_->allocate(n*sizeof(T));
+            if (ptr == NULL)
+                throw std::bad_alloc();
+
+            return static_cast<pointer>(ptr);
+        }
+
+        void deallocate(pointer,size_type)
+        {
+        }
+
+        size_type max_size() const
+        {
+            return static_cast<size_type>(-1)/sizeof(T);
+        }
+
+        void construct(pointer p,const T &val)
+        {
+            new (static_cast<void *>(p)) T(val);
+        }
+
+        void destroy(pointer p)
+        {
+            p->~T();
+        }
+
+        template <typename U>
+        bool operator==(const ArenaAllocator<U> &rhs) const
+        {
+            return arena_ == rhs.arena_;
+        }
+
+        template <typename U>
+        bool operator!=(const ArenaAllocator<U> &rhs) const
+        {
+            return arena_ != rhs.arena_;
+        }
+    };
 }
@@ -0,0 +1,222 @@
+/*
+ * The ckCore library provides core software functionality.
+ * Copyright (C) 2006-2012 Christian Kindahl
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file include/ckcore/memorystats.hh
+ * @brief Accounting of memory allocated by the library.
+ */
+
+#pragma once
+#include <stddef.h>
+#include <map>
+#include <memory>
+#include "ckcore/types.hh"
+#include "ckcore/thread.hh"
+
+namespace ckcore
+{
+    /**
+     * @brief Process wide accounting of memory allocated by the library.
+     *
+     * Allocations are counted per tag describing what the memory is used
+     * for. Accounting is disabled by default, when disabled reporting an
+     * allocation only costs a test of a flag. Memory allocated before
+     * accounting was enabled is not counted. Counted allocations are
+     * remembered by address so that releasing memory that was never
+     * counted does not affect the counters.
+     */
+    class MemoryStats
+    {
+    public:
+        /**
+         * Defines what the memory is used for.
+         */
+        enum Tag
+        {
+            ckTAG_OTHER,            ///< Untagged allocations.
+            ckTAG_STREAM,           ///< Stream and copy buffers.
+            ckTAG_MEMORY_STREAM,    ///< Memory streams and shared buffers.
+            ckTAG_BUFFER,           ///< Buffer objects.
+            ckTAG_ARENA,            ///< Arena blocks.
+            ckTAG_FILE,             ///< File copy and read buffers.
+            ckTAG_THREAD_POOL,      ///< Thread pool queues.
+            ckTAG_PROCESS,          ///< Process output buffers.
+            ckTAG_DIRECTORY,        ///< Directory handle maps.
+            ckTAG_COUNT
+        };
+
+        /**
+         * @brief Allocation counters of a tag.
+         */
+        struct Counter
+        {
+            tuint64 current;        ///< Number of bytes currently allocated.
+            tuint64 peak;           ///< Largest value of current.
+            tuint64 allocations;    ///< Total number of allocations.
+        };
+
+        /**
+         * @brief Copy of all counters at one point in time.
+         */
+        struct Snapshot
+        {
+            Counter tags[ckTAG_COUNT];
+            Counter total;
+            tuint64 pool_cached;    ///< Bytes kept in the buffer pool free list.
+        };
+
+    private:
+        thread::Mutex mutex_;
+        volatile bool enabled_;
+        volatile bool counting_;    // Set while counted memory is allocated.
+        Counter tags_[ckTAG_COUNT];
+        Counter total_;
+        std::map<const void *,size_t> counted_; // Counted bytes per allocation.
+
+        MemoryStats();
+        MemoryStats(const MemoryStats &rhs);
+        MemoryStats &operator=(const MemoryStats &rhs);
+
+    public:
+        /**
+         * Returns the MemoryStats instance.
+         * @return The MemoryStats instance.
+         */
+        static MemoryStats &instance();
+
+        /**
+         * Returns a human readable name of a tag.
+         * @param [in] tag The tag.
+         * @return The name of the tag.
+         */
+        static const tchar *name(Tag tag);
+
+        /**
+         * Enables or disables accounting.
+         * @param [in] enable Set to true to enable accounting and false to
+         *                    disable it.
+         */
+        void set_enabled(bool enable);
+
+        /**
+         * Checks if accounting is enabled.
+         * @return If accounting is enabled true is returned, otherwise false
+         *         is returned.
+         */
+        bool enabled() const
+        {
+            return enabled_;
+        }
+
+        /**
+         * Reports that memory has been allocated.
+         * @param [in] tag What the memory is used for.
+         * @param [in] key The address of the allocation, or of the object
+         *                 owning it for memory that grows in steps.
+         * @param [in] size The number of bytes allocated.
+         */
+        void allocated(Tag tag,const void *key,size_t size)
+        {
+            if (enabled_)
+                add(tag,key,size);
+        }
+
+        /**
+         * Reports that memory has been freed. Only memory that was counted
+         * when allocated is subtracted from the counters.
+         * @param [in] tag The tag the memory was allocated with.
+         * @param [in] key The key the memory was allocated with.
+         * @param [in] size The number of bytes freed.
+         */
+        void released(Tag tag,const void *key,size_t size)
+        {
+            if (counting_)
+                remove(tag,key,size);
+        }
+
+        /**
+         * Counts an allocation, use allocated instead.
+         */
+        void add(Tag tag,const void *key,size_t size);
+
+        /**
+         * Counts a release, use released instead.
+         */
+        void remove(Tag tag,const void *key,size_t size);
+
+        /**
+         * Copies the current counters.
+         * @return The current counters.
+         */
+        Snapshot snapshot();
+
+        /**
+         * Resets the peak counters to the current number of bytes and the
+         * allocation counters to zero.
+         */
+        void reset();
+    };
+
+    /**
+     * @brief Standard allocator reporting its allocations to MemoryStats.
+     *
+     * Used for the containers of library objects so that their memory is
+     * counted under a tag.
+     */
+    template <typename T,MemoryStats::Tag tag>
+    class CountingAllocator : public std::allocator<T>
+    {
+    public:
+        typedef size_t size_type;
+
+        template <typename U>
+        struct rebind
+        {
+            typedef CountingAllocator<U,tag> other;
+        };
+
+        CountingAllocator() throw()
+        {
+        }
+
+        CountingAllocator(const CountingAllocator &rhs) throw()
+            : std::allocator<T>(rhs)
+        {
+        }
+
+        template <typename U>
+        CountingAllocator(const CountingAllocator<U,tag> &rhs) throw()
+            : std::allocator<T>(rhs)
+        {
+        }
+
+        T *allocate(size_type n,const void * = 0)
+        {
+            T *p = std::allocator<T>::allocate(n);
+            MemoryStats::instance().allocated(tag,p,n * sizeof(T));
+            return p;
+        }
+
+        void deallocate(T *p,size_type n)
+        {
+            MemoryStats::instance().released(tag,p,n * sizeof(T));
+            std::allocator<T>::deallocate(p,n);
+        }
+    };
+}
@@ -22,8 +22,10 @@
  */
 
 #pragma once
+#include <vector>
 #include "ckcore/types.hh"
 #include "ckcore/stream.hh"
+#include "ckcore/sharedbuffer.hh"
 
 namespace ckcore
 {
@@ -33,7 +35,8 @@ namespace ckcore
     class MemoryInStream : public InStream
     {
     private:
-        unsigned char *data_;
+        SharedBuffer buffer_;
+        const unsigned char *data_;
         tuint32 count_;
         tuint32 pos_;
 
@@ -46,6 +49,14 @@ namespace ckcore
          */
         MemoryInStream(unsigned  char *data,tuint32 count);
 
+        /**
+         * Constructs an MemoryInStream object reading from a shared buffer.
+         * The stream keeps a reference to the buffer data for as long as it
+         * exists, the data is not copied.
+         * @param [in] buffer The buffer to read from.
+         */
+        MemoryInStream(const SharedBuffer &buffer);
+
         /**
          * Destructs the MemoryInStream object.
          */
@@ -80,6 +91,16 @@ namespace ckcore
          */
         tint64 read(void *buffer,tuint32 count);
 
+        /**
+         * Gives direct access to the data at the current position. The
+         * stream position is not changed.
+         * @param [out] buffer Receives a pointer to the data.
+         * @param [in] count The maximum number of bytes to borrow.
+         * @return The number of bytes available through buffer (this may be
+         *         zero when the end of the stream has been reached).
+         */
+        tint64 borrow(const unsigned char *&buffer,tuint32 count);
+
         /**
          * Calculates the size of the data provided by the stream.
          * @return If successfull the size in bytes of the stream data is returned,
@@ -98,6 +119,8 @@ namespace ckcore
         tuint32 buffer_size_;
         tuint32 buffer_pos_;
 
+        friend class SharedBuffer;
+
     public:
         /**
          * Constructs an MemoryOutStream object.
@@ -138,4 +161,163 @@ namespace ckcore
          */
         tuint32 count() const;
     };
+
+    /**
+     * @brief In-memory stream class for writing large amounts of data.
+     *
+     * Unlike MemoryOutStream, the data is stored in a list of fixed size
+     * segments allocated from the buffer pool. The stream grows without
+     * copying previously written data and is not limited to 4 GiB. The
+     * segments can be accessed directly, for example for vectored writes,
+     * and the data can be handed over to a SegmentedMemoryInStream without
+     * copying.
+     */
+    class SegmentedMemoryOutStream : public OutStream
+    {
+    private:
+        std::vector<unsigned char *> segments_;
+        tuint32 segment_size_;
+        tuint64 count_;
+
+        friend class SegmentedMemoryInStream;
+
+        SegmentedMemoryOutStream(const SegmentedMemoryOutStream &rhs);
+        SegmentedMemoryOutStream &operator=(const SegmentedMemoryOutStream &rhs);
+
+    public:
+        /**
+         * Constructs a SegmentedMemoryOutStream object.
+         * @param [in] segment_size The size of each segment.
+         */
+        SegmentedMemoryOutStream(tuint32 segment_size = 256*1024);
+
+        /**
+         * Releases all segments and destructs the object.
+         */
+        ~SegmentedMemoryOutStream();
+
+        /**
+         * Writes raw data to the stream.
+         * @param [in] buffer Pointer to the beginning of the buffer
+         *                    containing the data to be written.
+         * @param [in] count The number of bytes to write.
+         * @return If the operation failed -1 is returned, otherwise the
+         *         function returns the number of bytes written.
+         */
+        tint64 write(const void *buffer,tuint32 count);
+
+        /**
+         * Writes all data in the stream to another stream.
+         * @param [in] stream The stream to write to.
+         * @return If successfull true is returned, otherwise false.
+         */
+        bool write_to(OutStream &stream) const;
+
+        /**
+         * Releases all segments.
+         */
+        void clear();
+
+        /**
+         * Returns the number of bytes stored in the stream.
+         * @return The number of bytes stored in the stream.
+         */
+        tuint64 count() const;
+
+        /**
+         * Returns the number of segments holding the data.
+         * @return The number of segments.
+         */
+        size_t segments() const;
+
+        /**
+         * Returns a pointer to the data of a segment.
+         * @param [in] index The segment index.
+         * @return Pointer to the segment data.
+         */
+        const unsigned char *segment(size_t index) const;
+
+        /**
+         * Returns the number of bytes stored in a segment. All segments
+         * except the last one are full.
+         * @param [in] index The segment index.
+         * @return The number of bytes in the segment.
+         */
+        tuint32 segment_count(size_t index) const;
+    };
+
+    /**
+     * @brief In-memory stream class for reading data written to a
+     *        SegmentedMemoryOutStream.
+     */
+    class SegmentedMemoryInStream : public InStream
+    {
+    private:
+        std::vector<unsigned char *> segments_;
+        tuint32 segment_size_;
+        tuint64 count_;
+        tuint64 pos_;
+
+        SegmentedMemoryInStream(const SegmentedMemoryInStream &rhs);
+        SegmentedMemoryInStream &operator=(const SegmentedMemoryInStream &rhs);
+
+    public:
+        /**
+         * Constructs a SegmentedMemoryInStream object. The stream takes over
+         * the data of the output stream without copying it, leaving the
+         * output stream empty.
+         * @param [in] stream The stream holding the data.
+         */
+        SegmentedMemoryInStream(SegmentedMemoryOutStream &stream);
+
+        /**
+         * Releases the data and destructs the object.
+         */
+        virtual ~SegmentedMemoryInStream();
+
+        /**
+         * Checks if the end of the stream has been reached.
+         * @return If positioned at end of the stream true is returned,
+         *         otherwise false is returned.
+         */
+        bool end();
+
+        /**
+         * Repositions the stream pointer to the specified offset accoding to
+         * the whence directive in the stream.
+         * @param [in] distance The number of bytes that the stream pointer should
+         *                      move.
+         * @param [in] whence Specifies what to use as base when calculating the
+         *                    final stream pointer position.
+         * @return If successfull true is returned, otherwise false is returned.
+         */
+        bool seek(tuint32 distance,StreamWhence whence);
+
+        /**
+         * Reads raw data from the stream.
+         * @param [in] buffer Pointer to beginning of buffer to read to.
+         * @param [in] count The number of bytes to read.
+         * @return If the operation failed -1 is returned, otherwise the
+         *         function returns the number of butes read (this may be zero
+         *         when the end of the file has been reached).
+         */
+        tint64 read(void *buffer,tuint32 count);
+
+        /**
+         * Gives direct access to the data at the current position. The
+         * stream position is not changed. The data is never borrowed across
+         * segment boundaries.
+         * @param [out] buffer Receives a pointer to the data.
+         * @param [in] count The maximum number of bytes to borrow.
+         * @return The number of bytes available through buffer (this may be
+         *         zero when the end of the stream has been reached).
+         */
+        tint64 borrow(const unsigned char *&buffer,tuint32 count);
+
+        /**
+         * Calculates the size of the data provided by the stream.
+         * @return The size in bytes of the stream data.
+         */
+        tint64 size();
+    };
 }
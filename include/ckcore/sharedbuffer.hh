@@ -0,0 +1,118 @@
+/*
+ * The ckCore library provides core software functionality.
+ * Copyright (C) 2006-2012 Christian Kindahl
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file include/ckcore/sharedbuffer.hh
+ * @brief Reference counted immutable byte buffer.
+ */
+
+#pragma once
+#include "ckcore/types.hh"
+
+namespace ckcore
+{
+    class MemoryOutStream;
+
+    /**
+     * @brief Reference counted immutable byte buffer.
+     *
+     * Copying a buffer or taking a slice of it only updates a reference
+     * count, the data itself is never copied. The memory is allocated from
+     * the buffer pool and released when the last buffer referencing it is
+     * destroyed. Since the data cannot be modified once the buffer has been
+     * created, buffers may be shared between threads. A single buffer
+     * object must however not be modified by several threads at once.
+     */
+    class SharedBuffer
+    {
+    private:
+        struct Storage
+        {
+            volatile long refs;
+            unsigned char *data;
+            size_t capacity;    // Number of bytes allocated from the pool.
+        };
+
+        Storage *storage_;
+        const unsigned char *data_;
+        tuint32 size_;
+
+        static Storage *create(unsigned char *data,size_t capacity);
+
+    public:
+        /**
+         * Constructs an empty SharedBuffer object.
+         */
+        SharedBuffer();
+
+        /**
+         * Constructs a SharedBuffer object holding a copy of the specified
+         * data.
+         * @param [in] data Pointer to the data to copy.
+         * @param [in] count The number of bytes to copy.
+         */
+        SharedBuffer(const void *data,tuint32 count);
+
+        /**
+         * Constructs a SharedBuffer object taking over the data written to a
+         * memory stream without copying it. The stream is left empty and can
+         * be used to write new data.
+         * @param [in] stream The stream holding the data.
+         */
+        explicit SharedBuffer(MemoryOutStream &stream);
+
+        SharedBuffer(const SharedBuffer &rhs);
+        ~SharedBuffer();
+
+        SharedBuffer &operator=(const SharedBuffer &rhs);
+
+        /**
+         * Releases the reference to the data, leaving the buffer empty.
+         */
+        void reset();
+
+        /**
+         * Creates a buffer referencing a part of the data in this buffer.
+         * The range is clamped to the size of this buffer.
+         * @param [in] offset The offset of the first byte in the slice.
+         * @param [in] count The number of bytes in the slice.
+         * @return The new buffer.
+         */
+        SharedBuffer slice(tuint32 offset,tuint32 count) const;
+
+        /**
+         * Returns a pointer to the data.
+         * @return Pointer to the data, NULL if the buffer is empty.
+         */
+        const unsigned char *data() const;
+
+        /**
+         * Returns the number of bytes in the buffer.
+         * @return The number of bytes in the buffer.
+         */
+        tuint32 size() const;
+
+        /**
+         * Checks if the buffer is empty.
+         * @return If the buffer does not contain any data true is returned,
+         *         otherwise false is returned.
+         */
+        bool empty() const;
+    };
+}
@@ -80,6 +80,27 @@ namespace ckcore
          * @return If successfull true is returned, oterwise false is returned.
          */
         virtual bool seek(tuint32 distance,StreamWhence whence) = 0;
+
+        /**
+         * Gives direct access to the data at the current stream position
+         * without copying it. The stream position is not changed, seek should
+         * be used to move past the processed data. The data remains valid
+         * until the stream is read from, borrowed from again or closed.
+         * Streams keeping their data in memory should override this
+         * function.
+         * @param [out] buffer Receives a pointer to the data.
+         * @param [in] count The maximum number of bytes to borrow.
+         * @return If the stream does not support borrowing or if the operation
+         *         failed -1 is returned, otherwise the number of bytes
+         *         available through buffer is returned (this may be zero when
+         *         the end of the stream has been reached).
+         */
+        virtual tint64 borrow(const unsigned char *&buffer,tuint32 count)
+        {
+            ckUNUSED(buffer);
+            ckUNUSED(count);
+            return -1;
+        }
     };
 
     /**
@@ -24,6 +24,7 @@
 #pragma once
 #include <queue>
 #include "ckcore/types.hh"
+#include "ckcore/memorystats.hh"
 #include "ckcore/task.hh"
 #include "ckcore/thread.hh"
 
@@ -78,12 +79,19 @@ namespace ckcore
 
         thread::WaitCondition task_ready_;          ///< Signaled to a thread when a task is ready for execution.
 
-        std::vector<InternalThread *> all_threads_; ///< All threads.
-        std::vector<InternalThread *> ret_threads_; ///< Retired threads.
+        typedef std::vector<InternalThread *,
+                            CountingAllocator<InternalThread *,MemoryStats::ckTAG_THREAD_POOL> > ThreadVector;
+        typedef std::pair<Task *,tuint32> QueueItem;
+        typedef std::priority_queue<QueueItem,
+                                    std::vector<QueueItem,
+                                                CountingAllocator<QueueItem,MemoryStats::ckTAG_THREAD_POOL> > > TaskQueue;
+
+        ThreadVector all_threads_;  ///< All threads.
+        ThreadVector ret_threads_;  ///< Retired threads.
 
         tuint32 ret_timeout_;   ///< How long a thread can indle before being retired.
 
-        std::priority_queue<std::pair<Task *,tuint32> > queue_;
+        TaskQueue queue_;
 
         /**
          * Puts a task into the work queue.
@@ -24,6 +24,7 @@
 #include <map>
 #include <dirent.h>
 #include "ckcore/file.hh"
+#include "ckcore/memorystats.hh"
 #include "ckcore/path.hh"
 
 namespace ckcore
@@ -97,12 +98,24 @@ namespace ckcore
              * @return If the iterators are equal true is returned, otherwise false.
              */
             bool operator!=(const Iterator &it) const;
+
+            /**
+             * Obtains the meta data of the file or directory that the iterator
+             * currently points at. Symbolic links are not followed.
+             * @param [out] info Receives the meta data.
+             * @return If successfull true is returned, otherwise false.
+             */
+            bool info(File::Info &info) const;
         };
 
     private:
         Path dir_path_;
 
-        std::map<Iterator *,DIR *> dir_handles_;
+        typedef std::map<Iterator *,DIR *,std::less<Iterator *>,
+                         CountingAllocator<std::pair<Iterator * const,DIR *>,
+                                           MemoryStats::ckTAG_DIRECTORY> > HandleMap;
+
+        HandleMap dir_handles_;
 
     public:
         /**
@@ -183,6 +196,14 @@ namespace ckcore
          */
         static bool exist(const Path &dir_path);
 
+        /**
+         * Flushes changes to the directory entries, like created and renamed
+         * files, to the storage device.
+         * @param [in] dir_path The path to the directory.
+         * @return If successfull true is returned, otherwise false.
+         */
+        static bool sync(const Path &dir_path);
+
         /**
          * Obtains time stamps on when the specified directory was last accessed,
          * last modified and created.
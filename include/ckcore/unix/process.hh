@@ -72,6 +72,8 @@ namespace ckcore
         std::set<char> block_delims_;
         std::string block_buffer_out_;  // For buffering partial standard output blocks before commiting them.
         std::string block_buffer_err_;  // For buffering partial standard error blocks before commiting them.
+        size_t block_counted_out_;      // Capacity of block_buffer_out_ reported to MemoryStats.
+        size_t block_counted_err_;      // Capacity of block_buffer_err_ reported to MemoryStats.
 
         /**
          * Closes all internal pipes and resets the internal state of the object.
@@ -23,6 +23,7 @@
 #pragma once
 #include <map>
 #include "ckcore/file.hh"
+#include "ckcore/memorystats.hh"
 #include "ckcore/path.hh"
 
 namespace ckcore
@@ -97,12 +98,25 @@ namespace ckcore
              * @return If the iterators are equal true is returned, otherwise false.
              */
             bool operator!=(const Iterator &it) const;
+
+            /**
+             * Obtains the meta data of the file or directory that the iterator
+             * currently points at. The meta data is provided by the directory
+             * listing so the file is not accessed.
+             * @param [out] info Receives the meta data.
+             * @return If successfull true is returned, otherwise false.
+             */
+            bool info(File::Info &info) const;
         };
 
     private:
         Path dir_path_;
 
-        std::map<Iterator *,HANDLE> dir_handles_;
+        typedef std::map<Iterator *,HANDLE,std::less<Iterator *>,
+                         CountingAllocator<std::pair<Iterator * const,HANDLE>,
+                                           MemoryStats::ckTAG_DIRECTORY> > HandleMap;
+
+        HandleMap dir_handles_;
 
     public:
         /**
@@ -183,6 +197,14 @@ namespace ckcore
          */
         static bool exist(const Path &dir_path);
 
+        /**
+         * Flushes changes to the directory entries, like created and renamed
+         * files, to the storage device.
+         * @param [in] dir_path The path to the directory.
+         * @return If successfull true is returned, otherwise false.
+         */
+        static bool sync(const Path &dir_path);
+
         /**
          * Obtains time stamps on when the specified directory was last accessed,
          * last modified and created.
@@ -69,6 +69,7 @@ namespace ckcore
 
         std::set<char> block_delims_;
         std::string block_buffer_;      // For buffering partial standard output blocks before commiting them.
+        size_t block_counted_;          // Capacity of block_buffer_ reported to MemoryStats.
 
         /**
          * Closes all internal pipes and resets the internal state of the object.
@@ -0,0 +1,114 @@
+/*
+ * The ckCore library provides core software functionality.
+ * Copyright (C) 2006-2012 Christian Kindahl
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file include/ckcore/writecache.hh
+ * @brief Write-back cache for scattered file updates.
+ */
+
+#pragma once
+#include <map>
+#include <vector>
+#include "ckcore/types.hh"
+#include "ckcore/file.hh"
+
+namespace ckcore
+{
+    /**
+     * @brief Write-back cache for random access writes to a file.
+     *
+     * Data written through the cache is kept in memory until the cache is
+     * flushed or the amount of cached data reaches a limit. Adjacent and
+     * overlapping writes are merged into larger extents, which are written
+     * to the file in offset order when flushing. This turns a large number
+     * of small scattered writes into a few large, mostly sequential ones.
+     *
+     * The file must be open for writing for as long as the cache is used,
+     * and must not be written to other than through the cache.
+     */
+    class WriteCache
+    {
+    private:
+        typedef std::map<tint64,std::vector<unsigned char> > ExtentMap;
+
+        File &file_;
+        tuint32 limit_;
+        tuint64 dirty_;         // Number of bytes in the extents.
+        ExtentMap extents_;     // Extents keyed by file offset.
+
+        WriteCache(const WriteCache &rhs);
+        WriteCache &operator=(const WriteCache &rhs);
+
+    public:
+        /**
+         * Constructs a WriteCache object.
+         * @param [in] file The open file to write to.
+         * @param [in] limit The maximum number of bytes to cache before
+         *                   flushing.
+         */
+        WriteCache(File &file,tuint32 limit = 16*1024*1024);
+
+        /**
+         * Flushes the cache and destructs the object.
+         */
+        ~WriteCache();
+
+        /**
+         * Writes data to the cache.
+         * @param [in] buffer A pointer to the beginning of a buffer containing
+         *                    the data to write.
+         * @param [in] count The number of bytes to write.
+         * @param [in] offset The position in the file to write to.
+         * @return If successfull true is returned. If the cache had to be
+         *         flushed and flushing failed false is returned.
+         */
+        bool write(const void *buffer,tuint32 count,tint64 offset);
+
+        /**
+         * Reads data from the file including any data in the cache that has
+         * not yet been written.
+         * @param [out] buffer A pointer to the beginning of a buffer in which to
+         *                     put the data.
+         * @param [in] count The number of bytes to read.
+         * @param [in] offset The position in the file to read from.
+         * @return If the operation failed -1 is returned, otherwise the
+         *         function returns the number of bytes read.
+         */
+        tint64 read(void *buffer,tuint32 count,tint64 offset) const;
+
+        /**
+         * Writes all cached data to the file in offset order.
+         * @return If successfull true is returned, otherwise false is
+         *         returned and the data that could not be written is kept in
+         *         the cache.
+         */
+        bool flush();
+
+        /**
+         * Returns the number of bytes currently held by the cache.
+         * @return The number of cached bytes.
+         */
+        tuint64 dirty() const;
+
+        /**
+         * Returns the number of separate extents held by the cache.
+         * @return The number of extents.
+         */
+        size_t extents() const;
+    };
+}
@@ -0,0 +1,443 @@
+/*
+ * The ckCore library provides core software functionality.
+ * Copyright (C) 2006-2012 Christian Kindahl
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef _WINDOWS
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include <time.h>
+#include <set>
+#include "ckcore/convert.hh"
+#include "ckcore/directory.hh"
+#include "ckcore/locker.hh"
+#include "ckcore/task.hh"
+#include "ckcore/threadpool.hh"
+#include "ckcore/atomicfilestream.hh"
+
+namespace ckcore
+{
+    /**
+     * The number of names to try before giving up on creating a uniquely
+     * named file.
+     */
+    static const int MAX_NAME_ATTEMPTS = 100;
+
+    static thread::Mutex name_mutex;
+    static tuint32 name_seed = 0;
+    static tuint32 name_counter = 0;
+
+    /**
+     * Returns a random file name derived from the specified name. The names
+     * are seeded from the process identifier and the time so that different
+     * processes are unlikely to try the same names.
+     */
+    static tstring unique_name(const tstring &file_name)
+    {
+        tuint32 id;
+        {
+            Locker<thread::Mutex> lock(name_mutex);
+            if (name_seed == 0)
+            {
+#ifdef _WINDOWS
+                tuint32 pid = static_cast<tuint32>(GetCurrentProcessId());
+#else
+                tuint32 pid = static_cast<tuint32>(getpid());
+#endif
+                name_seed = (pid*2654435761U) ^ static_cast<tuint32>(time(NULL)) ^
+                            static_cast<tuint32>(clock());
+                name_seed |= 1;
+            }
+
+            id = name_seed ^ (++name_counter*0x9e3779b9U);
+        }
+
+        // Mix the bits so consecutive names do not look alike.
+        id ^= id >> 16;
+        id *= 0x85ebca6bU;
+        id ^= id >> 13;
+
+        tchar suffix[32];
+        convert::sprintf(suffix,sizeof(suffix)/sizeof(tchar),ckT(".ck%08x"),
+                         static_cast<unsigned int>(id));
+        return file_name + suffix;
+    }
+
+    /**
+     * @brief Task flushing the data of a file in a batch.
+     */
+    class FileSyncTask : public Task
+    {
+    private:
+        File &file_;
+        bool &flushed_;
+        size_t &remaining_;
+        thread::Mutex &mutex_;
+        thread::WaitCondition &done_;
+
+    public:
+        FileSyncTask(File &file,bool &flushed,size_t &remaining,
+                     thread::Mutex &mutex,thread::WaitCondition &done)
+            : file_(file),flushed_(flushed),remaining_(remaining),
+              mutex_(mutex),done_(done)
+        {
+        }
+
+        void start()
+        {
+            bool flushed = file_.sync(true);
+
+            Locker<thread::Mutex> lock(mutex_);
+            flushed_ = flushed;
+            remaining_--;
+            done_.signal_all();
+        }
+    };
+
+    /**
+     * Returns the name of the directory containing the specified file.
+     */
+    static tstring dir_name(const tstring &file_name)
+    {
+        tstring dir_name = Path(file_name.c_str()).dir_name();
+        return dir_name.empty() ? tstring(ckT(".")) : dir_name;
+    }
+
+    FileSyncBatch::FileSyncBatch(size_t sync_all_threshold)
+        : sync_all_threshold_(sync_all_threshold)
+    {
+    }
+
+    FileSyncBatch::~FileSyncBatch()
+    {
+        commit();
+    }
+
+    void FileSyncBatch::add(const Path &temp_path,const Path &file_path)
+    {
+        Pending pending;
+        pending.temp_name = temp_path.name();
+        pending.file_name = file_path.name();
+        pending.file = NULL;
+        pending.flushed = false;
+
+        Locker<thread::Mutex> lock(mutex_);
+        pending_.push_back(pending);
+    }
+
+    /**
+     * Adds an open file to the batch, the batch takes ownership of the file.
+     * The file is kept open so that it does not have to be reopened to be
+     * flushed.
+     */
+    void FileSyncBatch::add(File *file,const Path &file_path)
+    {
+        Pending pending;
+        pending.temp_name = file->name();
+        pending.file_name = file_path.name();
+        pending.file = file;
+        pending.flushed = false;
+
+        Locker<thread::Mutex> lock(mutex_);
+        pending_.push_back(pending);
+
+        // Large batches synchronize the whole file system, there is no need
+        // to hold on to the file handles.
+        if (pending_.size() >= sync_all_threshold_)
+        {
+            for (size_t i = 0; i < pending_.size(); i++)
+            {
+                delete pending_[i].file;
+                pending_[i].file = NULL;
+            }
+        }
+    }
+
+    size_t FileSyncBatch::count()
+    {
+        Locker<thread::Mutex> lock(mutex_);
+        return pending_.size();
+    }
+
+    bool FileSyncBatch::commit()
+    {
+        std::vector<Pending> pending;
+        {
+            Locker<thread::Mutex> lock(mutex_);
+            pending.swap(pending_);
+        }
+
+        if (pending.empty())
+            return true;
+
+        std::set<tstring> dirs;
+        for (size_t i = 0; i < pending.size(); i++)
+            dirs.insert(dir_name(pending[i].file_name));
+
+        // Synchronize each file system once instead of every file.
+        bool synced = false;
+        if (pending.size() >= sync_all_threshold_)
+        {
+            synced = true;
+
+            std::set<tuint64> devices;
+            std::set<tstring>::const_iterator it;
+            for (it = dirs.begin(); it != dirs.end() && synced; it++)
+            {
+                File::Info info;
+                if (!File::info(it->c_str(),info))
+                    synced = false;
+                else if (devices.insert(info.device).second)
+                    synced = File::sync_all(it->c_str());
+            }
+        }
+
+        // The data must be flushed before the files are moved into place,
+        // otherwise a crash may leave empty files behind. The files are
+        // flushed concurrently since each flush mostly waits on the device.
+        if (synced)
+        {
+            for (size_t i = 0; i < pending.size(); i++)
+                pending[i].flushed = true;
+        }
+        else
+        {
+            thread::Mutex mutex;
+            thread::WaitCondition done;
+            size_t remaining = 0;
+
+            for (size_t i = 0; i < pending.size(); i++)
+            {
+                if (pending[i].file == NULL)
+                {
+                    File::OpenOptions options;
+                    options.lock = File::ckLOCK_NONE;
+
+                    File *file = new File(pending[i].temp_name.c_str());
+                    if (!file->open(File::ckOPEN_READWRITE,options))
+                    {
+                        delete file;
+                        continue;
+                    }
+
+                    pending[i].file = file;
+                }
+
+                {
+                    Locker<thread::Mutex> lock(mutex);
+                    remaining++;
+                }
+
+                // Flush the file ourselves if no thread is available.
+                FileSyncTask *task = new FileSyncTask(*pending[i].file,
+                                                      pending[i].flushed,
+                                                      remaining,mutex,done);
+                if (!ThreadPool::instance().start_now(task))
+                {
+                    task->start();
+                    delete task;
+                }
+            }
+
+            Locker<thread::Mutex> lock(mutex);
+            while (remaining > 0)
+                done.wait(mutex);
+        }
+
+        bool result = true;
+        for (size_t i = 0; i < pending.size(); i++)
+        {
+            const Path temp_path = pending[i].temp_name.c_str();
+
+            // The file must be closed before it can be moved on Windows.
+            delete pending[i].file;
+            pending[i].file = NULL;
+
+            if (!pending[i].flushed)
+            {
+                File::remove(temp_path);
+                result = false;
+                continue;
+            }
+
+            if (!File::replace(temp_path,pending[i].file_name.c_str()))
+            {
+                File::remove(temp_path);
+                result = false;
+            }
+        }
+
+        std::set<tstring>::const_iterator it;
+        for (it = dirs.begin(); it != dirs.end(); it++)
+        {
+            if (!Directory::sync(it->c_str()))
+                result = false;
+        }
+
+        return result;
+    }
+
+    AtomicFileOutStream::AtomicFileOutStream(const Path &file_path,
+                                             Durability durability)
+        : file_path_(file_path),file_(NULL),durability_(durability),
+          batch_(NULL)
+    {
+    }
+
+    AtomicFileOutStream::AtomicFileOutStream(const Path &file_path,
+                                             FileSyncBatch &batch)
+        : file_path_(file_path),file_(NULL),durability_(ckDURABILITY_FILE),
+          batch_(&batch)
+    {
+    }
+
+    AtomicFileOutStream::~AtomicFileOutStream()
+    {
+        reset();
+    }
+
+    /**
+     * Closes and removes the temporary file.
+     */
+    void AtomicFileOutStream::reset()
+    {
+        if (file_ == NULL)
+            return;
+
+        bool named = !file_->anonymous();
+        file_->close();
+        if (named)
+            file_->remove();
+
+        delete file_;
+        file_ = NULL;
+    }
+
+    bool AtomicFileOutStream::open()
+    {
+        reset();
+
+        File::OpenOptions options;
+        options.lock = File::ckLOCK_NONE;
+        options.close_on_exec = true;
+
+#ifdef __linux__
+        file_ = new File(dir_name(file_path_.name()).c_str());
+
+        options.temporary = true;
+        if (file_->open(File::ckOPEN_WRITE,options) && file_->anonymous())
+            return true;
+
+        // The file system does not support anonymous files.
+        delete file_;
+        file_ = NULL;
+
+        options.temporary = false;
+#endif
+        options.exclusive = true;
+        for (int i = 0; i < MAX_NAME_ATTEMPTS; i++)
+        {
+            file_ = new File(unique_name(file_path_.name()).c_str());
+            if (file_->open(File::ckOPEN_WRITE,options))
+                return true;
+
+            // Only retry if the name is taken.
+            bool exist = file_->exist();
+            delete file_;
+            file_ = NULL;
+
+            if (!exist)
+                break;
+        }
+
+        return false;
+    }
+
+    bool AtomicFileOutStream::commit()
+    {
+        if (file_ == NULL)
+            return false;
+
+        // Anonymous files must be given a name before they can be moved into
+        // place, since linking fails if the target exist.
+        if (file_->anonymous())
+        {
+            for (int i = 0; i < MAX_NAME_ATTEMPTS && file_->anonymous(); i++)
+                file_->link(unique_name(file_path_.name()).c_str());
+
+            if (file_->anonymous())
+            {
+                reset();
+                return false;
+            }
+        }
+
+        if (batch_ == NULL && durability_ == ckDURABILITY_FILE &&
+            !file_->sync(true))
+        {
+            reset();
+            return false;
+        }
+
+        // The batch keeps the file open until it is flushed.
+        if (batch_ != NULL)
+        {
+            batch_->add(file_,file_path_);
+            file_ = NULL;
+            return true;
+        }
+
+        const Path temp_path = file_->name().c_str();
+        file_->close();
+        delete file_;
+        file_ = NULL;
+
+        if (!File::replace(temp_path,file_path_))
+        {
+            File::remove(temp_path);
+            return false;
+        }
+
+        if (durability_ == ckDURABILITY_FILE)
+            return Directory::sync(dir_name(file_path_.name()).c_str());
+
+        return true;
+    }
+
+    bool AtomicFileOutStream::discard()
+    {
+        if (file_ == NULL)
+            return false;
+
+        reset();
+        return true;
+    }
+
+    tuint32 AtomicFileOutStream::block_size() const
+    {
+        return file_ != NULL ? file_->block_size() : 0;
+    }
+
+    tint64 AtomicFileOutStream::write(const void *buffer,tuint32 count)
+    {
+        if (file_ == NULL)
+            return -1;
+
+        return file_->write(buffer,count);
+    }
+}
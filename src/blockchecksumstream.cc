@@ -0,0 +1,462 @@
+/*
+ * The ckCore library provides core software functionality.
+ * Copyright (C) 2006-2012 Christian Kindahl
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <limits>
+#include "ckcore/assert.hh"
+#include "ckcore/bufferpool.hh"
+#include "ckcore/locker.hh"
+#include "ckcore/task.hh"
+#include "ckcore/thread.hh"
+#include "ckcore/threadpool.hh"
+#include "ckcore/blockchecksumstream.hh"
+
+namespace ckcore
+{
+    /**
+     * Manifest file format identifier and version.
+     */
+    static const unsigned char MANIFEST_MAGIC[4] = { 'C','K','B','M' };
+    static const unsigned char MANIFEST_VERSION = 1;
+
+    /**
+     * The approximate number of bytes verified in each batch.
+     */
+    static const tuint32 VERIFY_BATCH_SIZE = 1024*1024;
+
+    /**
+     * The maximum number of checksums to reserve space for up front when
+     * loading a manifest, the count in the header is not trusted.
+     */
+    static const size_t LOAD_RESERVE_LIMIT = 1 << 20;
+
+    static void put_le(unsigned char *buffer,tuint64 value,unsigned int bytes)
+    {
+        for (unsigned int i = 0; i < bytes; i++)
+            buffer[i] = static_cast<unsigned char>(value >> (i*8));
+    }
+
+    static tuint64 get_le(const unsigned char *buffer,unsigned int bytes)
+    {
+        tuint64 value = 0;
+        for (unsigned int i = 0; i < bytes; i++)
+            value |= static_cast<tuint64>(buffer[i]) << (i*8);
+
+        return value;
+    }
+
+    /**
+     * Reads until the buffer is full or the end of the stream is reached.
+     * @return The number of bytes read or -1 on error.
+     */
+    static tint64 read_full(InStream &stream,unsigned char *buffer,
+                            tuint32 count)
+    {
+        tuint32 pos = 0;
+        while (pos < count && !stream.end())
+        {
+            tint64 res = stream.read(buffer + pos,count - pos);
+            if (res == -1)
+                return -1;
+            if (res == 0)
+                break;
+
+            pos += static_cast<tuint32>(res);
+        }
+
+        return pos;
+    }
+
+    /**
+     * @brief Batch of blocks being verified.
+     */
+    struct VerifyBatch
+    {
+        unsigned char *data;
+        tuint32 size;       // Number of valid bytes in data.
+        tuint64 first;      // Index of the first block in the batch.
+        std::vector<tuint32> checksums;
+        bool done;
+    };
+
+    /**
+     * @brief Task calculating the block checksums of a batch.
+     */
+    class VerifyTask : public Task
+    {
+    private:
+        const CrcStream &crc_;
+        tuint32 block_size_;
+        VerifyBatch &batch_;
+        thread::Mutex &mutex_;
+        thread::WaitCondition &done_;
+
+    public:
+        VerifyTask(const CrcStream &crc,tuint32 block_size,VerifyBatch &batch,
+                   thread::Mutex &mutex,thread::WaitCondition &done)
+            : crc_(crc),block_size_(block_size),batch_(batch),mutex_(mutex),
+              done_(done)
+        {
+        }
+
+        void start()
+        {
+            size_t num = (batch_.size + block_size_ - 1)/block_size_;
+
+            std::vector<const void *> buffers(num);
+            std::vector<size_t> counts(num);
+            for (size_t i = 0; i < num; i++)
+            {
+                tuint32 offset = static_cast<tuint32>(i)*block_size_;
+                buffers[i] = batch_.data + offset;
+                counts[i] = batch_.size - offset < block_size_ ?
+                            batch_.size - offset : block_size_;
+            }
+
+            batch_.checksums.resize(num);
+            if (num > 0)
+                crc_.checksum_many(&buffers[0],&counts[0],&batch_.checksums[0],num);
+
+            // The batch must not be touched after this point, the owner may
+            // reuse it as soon as we have signaled.
+            Locker<thread::Mutex> lock(mutex_);
+            batch_.done = true;
+            done_.signal_all();
+        }
+    };
+
+    BlockManifest::BlockManifest(CrcStream::CrcType type,tuint32 block_size)
+        : type_(type),block_size_(block_size),size_(0)
+    {
+        if (block_size_ == 0)
+            block_size_ = 65536;
+    }
+
+    CrcStream::CrcType BlockManifest::type() const
+    {
+        return type_;
+    }
+
+    tuint32 BlockManifest::block_size() const
+    {
+        return block_size_;
+    }
+
+    tuint64 BlockManifest::size() const
+    {
+        return size_;
+    }
+
+    tuint64 BlockManifest::count() const
+    {
+        return checksums_.size();
+    }
+
+    tuint32 BlockManifest::checksum(tuint64 index) const
+    {
+        ckASSERT(index < checksums_.size());
+        return checksums_[static_cast<size_t>(index)];
+    }
+
+    bool BlockManifest::save(OutStream &stream) const
+    {
+        // 16-bit checksums are stored using two bytes each.
+        const unsigned int width = type_ == CrcStream::ckCRC_32 ? 4 : 2;
+
+        unsigned char header[28];
+        memcpy(header,MANIFEST_MAGIC,4);
+        header[4] = MANIFEST_VERSION;
+        header[5] = static_cast<unsigned char>(type_);
+        put_le(header + 6,0,2);
+        put_le(header + 8,block_size_,4);
+        put_le(header + 12,size_,8);
+        put_le(header + 20,checksums_.size(),8);
+
+        if (stream.write(header,sizeof(header)) != sizeof(header))
+            return false;
+
+        unsigned char buffer[4096];
+        tuint32 pos = 0;
+        for (size_t i = 0; i < checksums_.size(); i++)
+        {
+            put_le(buffer + pos,checksums_[i],width);
+            pos += width;
+
+            if (pos == sizeof(buffer) || i == checksums_.size() - 1)
+            {
+                if (stream.write(buffer,pos) != pos)
+                    return false;
+
+                pos = 0;
+            }
+        }
+
+        return true;
+    }
+
+    bool BlockManifest::load(InStream &stream)
+    {
+        unsigned char header[28];
+        if (read_full(stream,header,sizeof(header)) != sizeof(header))
+            return false;
+
+        if (memcmp(header,MANIFEST_MAGIC,4) != 0 ||
+            header[4] != MANIFEST_VERSION)
+            return false;
+
+        CrcStream::CrcType type = static_cast<CrcStream::CrcType>(header[5]);
+        if (type != CrcStream::ckCRC_16 && type != CrcStream::ckCRC_32 &&
+            type != CrcStream::ckCRC_CCITT)
+            return false;
+
+        tuint32 block_size = static_cast<tuint32>(get_le(header + 8,4));
+        tuint64 size = get_le(header + 12,8);
+        tuint64 count = get_le(header + 20,8);
+        if (block_size == 0 || count != (size + block_size - 1)/block_size)
+            return false;
+
+        const unsigned int width = type == CrcStream::ckCRC_32 ? 4 : 2;
+
+        // Reject manifests with more checksums than the stream can hold.
+        tint64 stream_size = stream.size();
+        if (count > std::numeric_limits<size_t>::max() ||
+            (stream_size >= 0 && count > static_cast<tuint64>(stream_size)/width))
+        {
+            return false;
+        }
+
+        std::vector<tuint32> checksums;
+        checksums.reserve(static_cast<size_t>(count < LOAD_RESERVE_LIMIT ?
+                                              count : LOAD_RESERVE_LIMIT));
+
+        unsigned char buffer[4096];
+        while (checksums.size() < count)
+        {
+            tuint64 remain = count - checksums.size();
+            tuint32 to_read = remain < sizeof(buffer)/width ?
+                              static_cast<tuint32>(remain)*width : sizeof(buffer);
+            if (read_full(stream,buffer,to_read) != to_read)
+                return false;
+
+            for (tuint32 pos = 0; pos < to_read; pos += width)
+                checksums.push_back(static_cast<tuint32>(get_le(buffer + pos,width)));
+        }
+
+        type_ = type;
+        block_size_ = block_size;
+        size_ = size;
+        checksums_.swap(checksums);
+        return true;
+    }
+
+    bool BlockManifest::verify(InStream &stream,
+                               std::vector<Range> &mismatches) const
+    {
+        mismatches.clear();
+
+        const CrcStream crc(type_);
+
+        tuint32 batch_blocks = VERIFY_BATCH_SIZE/block_size_;
+        if (batch_blocks == 0)
+            batch_blocks = 1;
+
+        const tuint32 batch_size = batch_blocks*block_size_;
+
+        // Two batches are used so that one can be read while the checksums
+        // of the other one is being calculated.
+        thread::Mutex mutex;
+        thread::WaitCondition done;
+
+        VerifyBatch batches[2];
+        for (int i = 0; i < 2; i++)
+        {
+            batches[i].data = static_cast<unsigned char *>(
+                BufferPool::instance().allocate(batch_size,MemoryStats::ckTAG_STREAM));
+            batches[i].size = 0;
+            batches[i].first = 0;
+            batches[i].done = true;
+        }
+
+        if (batches[0].data == NULL || batches[1].data == NULL)
+        {
+            for (int i = 0; i < 2; i++)
+            {
+                if (batches[i].data != NULL)
+                {
+                    BufferPool::instance().release(batches[i].data,batch_size,
+                                                   MemoryStats::ckTAG_STREAM);
+                }
+            }
+
+            return false;
+        }
+
+        bool result = true;
+        tuint64 next_block = 0;
+        tuint64 verified = 0;       // Number of blocks compared.
+        int cur = 0;
+
+        while (true)
+        {
+            VerifyBatch &batch = batches[cur];
+
+            // Read the next batch while the other one is being processed.
+            tuint64 remain = size_ - next_block*block_size_;
+            bool have_batch = false;
+            if (next_block < count() && result)
+            {
+                tuint32 to_read = remain < batch_size ?
+                                  static_cast<tuint32>(remain) : batch_size;
+
+                tint64 res = read_full(stream,batch.data,to_read);
+                if (res == -1)
+                {
+                    result = false;
+                }
+                else if (res > 0)
+                {
+                    batch.size = static_cast<tuint32>(res);
+                    batch.first = next_block;
+                    batch.done = false;
+                    next_block += (batch.size + block_size_ - 1)/block_size_;
+                    have_batch = true;
+                }
+            }
+
+            if (have_batch)
+            {
+                // Queueing the task could deadlock if we are running in a
+                // saturated pool ourselves, calculate the checksums inline
+                // if no thread is available.
+                VerifyTask *task = new VerifyTask(crc,block_size_,batch,mutex,done);
+                if (!ThreadPool::instance().start_now(task))
+                {
+                    task->start();
+                    delete task;
+                }
+            }
+
+            // Collect the result of the previous batch.
+            VerifyBatch &prev = batches[cur ^ 1];
+            {
+                Locker<thread::Mutex> lock(mutex);
+                while (!prev.done)
+                    done.wait(mutex);
+            }
+
+            for (size_t i = 0; i < prev.checksums.size(); i++)
+            {
+                tuint64 index = prev.first + i;
+
+                // A short final block that was cut off in the stream is
+                // detected by the checksum since the data differs in length.
+                if (prev.checksums[i] != checksums_[static_cast<size_t>(index)])
+                {
+                    if (!mismatches.empty() &&
+                        mismatches.back().first + mismatches.back().count == index)
+                    {
+                        mismatches.back().count++;
+                    }
+                    else
+                    {
+                        Range range = { index,1 };
+                        mismatches.push_back(range);
+                    }
+                }
+            }
+
+            verified += prev.checksums.size();
+            prev.checksums.clear();
+
+            if (!have_batch)
+                break;
+
+            cur ^= 1;
+        }
+
+        // Blocks that were never read are considered damaged.
+        if (verified < count())
+        {
+            if (!mismatches.empty() &&
+                mismatches.back().first + mismatches.back().count == verified)
+            {
+                mismatches.back().count += count() - verified;
+            }
+            else
+            {
+                Range range = { verified,count() - verified };
+                mismatches.push_back(range);
+            }
+        }
+
+        BufferPool::instance().release(batches[0].data,batch_size,MemoryStats::ckTAG_STREAM);
+        BufferPool::instance().release(batches[1].data,batch_size,MemoryStats::ckTAG_STREAM);
+
+        return result;
+    }
+
+    BlockChecksumStream::BlockChecksumStream(tuint32 block_size,
+                                             CrcStream::CrcType type)
+        : crc_(type),manifest_(type,block_size),block_pos_(0)
+    {
+    }
+
+    void BlockChecksumStream::reset()
+    {
+        crc_.reset();
+        manifest_.size_ = 0;
+        manifest_.checksums_.clear();
+        block_pos_ = 0;
+    }
+
+    BlockManifest BlockChecksumStream::manifest()
+    {
+        BlockManifest manifest = manifest_;
+        if (block_pos_ > 0)
+            manifest.checksums_.push_back(crc_.checksum());
+
+        return manifest;
+    }
+
+    tint64 BlockChecksumStream::write(const void *buffer,tuint32 count)
+    {
+        const unsigned char *data = static_cast<const unsigned char *>(buffer);
+        const tuint32 block_size = manifest_.block_size_;
+
+        tuint32 pos = 0;
+        while (pos < count)
+        {
+            tuint32 remain = block_size - block_pos_;
+            tuint32 to_write = count - pos < remain ? count - pos : remain;
+
+            crc_.write(data + pos,to_write);
+            block_pos_ += to_write;
+            pos += to_write;
+
+            if (block_pos_ == block_size)
+            {
+                manifest_.checksums_.push_back(crc_.checksum());
+                crc_.reset();
+                block_pos_ = 0;
+            }
+        }
+
+        manifest_.size_ += count;
+        return count;
+    }
+}
@@ -0,0 +1,94 @@
+/*
+ * The ckCore library provides core software functionality.
+ * Copyright (C) 2006-2012 Christian Kindahl
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef _WINDOWS
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <stdlib.h>
+#endif
+#include "ckcore/bufferpool.hh"
+#include "ckcore/buffer.hh"
+
+namespace ckcore
+{
+    void *BufferStorage::allocate(size_t &size,size_t alignment,Backing &backing)
+    {
+        if (size == 0)
+            size = 1;
+
+        // Pool buffers are page aligned.
+        if (backing == ckBACKING_POOL && alignment <= BufferPool::MIN_BUFFER_SIZE)
+        {
+            size = BufferPool::instance().capacity(size);
+            return BufferPool::instance().allocate(size,MemoryStats::ckTAG_BUFFER);
+        }
+
+        backing = ckBACKING_HEAP;
+
+        void *buffer = NULL;
+        if (alignment == 0)
+        {
+            buffer = malloc(size);
+        }
+        else
+        {
+#ifdef _WINDOWS
+            buffer = _aligned_malloc(size,alignment);
+#else
+            if (alignment < sizeof(void *))
+                alignment = sizeof(void *);
+
+            if (posix_memalign(&buffer,alignment,size) != 0)
+                buffer = NULL;
+#endif
+        }
+
+        if (buffer != NULL)
+            MemoryStats::instance().allocated(MemoryStats::ckTAG_BUFFER,buffer,size);
+
+        return buffer;
+    }
+
+    void BufferStorage::release(void *buffer,size_t size,size_t alignment,
+                                Backing backing)
+    {
+        if (buffer == NULL)
+            return;
+
+        if (backing == ckBACKING_POOL)
+        {
+            BufferPool::instance().release(buffer,size,MemoryStats::ckTAG_BUFFER);
+            return;
+        }
+
+        MemoryStats::instance().released(MemoryStats::ckTAG_BUFFER,buffer,size);
+
+#ifdef _WINDOWS
+        if (alignment != 0)
+        {
+            _aligned_free(buffer);
+            return;
+        }
+#else
+        ckUNUSED(alignment);
+#endif
+        free(buffer);
+    }
+}
@@ -17,20 +17,147 @@
  */
 
 #include <string.h>
+#include <algorithm>
+#include <vector>
+#include "ckcore/assert.hh"
+#include "ckcore/bufferpool.hh"
+#include "ckcore/filestream.hh"
+#include "ckcore/locker.hh"
 #include "ckcore/system.hh"
+#include "ckcore/task.hh"
+#include "ckcore/thread.hh"
+#include "ckcore/threadpool.hh"
 #include "ckcore/bufferedstream.hh"
 
 namespace ckcore
 {
+    /**
+     * Limits of the buffer size when it's chosen automatically.
+     */
+    static const tuint32 DEFAULT_BUFFER_SIZE = 8192;
+    static const tuint32 MAX_BUFFER_SIZE = 256*1024;
+
+    /**
+     * The number of consecutive buffer refills or flushes before an
+     * automatically sized buffer is doubled.
+     */
+    static const tuint32 GROW_THRESHOLD = 4;
+
+    /**
+     * Calculates the initial buffer size given the preferred block size of
+     * the underlying stream.
+     */
+    static tuint32 initial_buffer_size(tuint32 block_size)
+    {
+        if (block_size < DEFAULT_BUFFER_SIZE)
+            return DEFAULT_BUFFER_SIZE;
+
+        return block_size > MAX_BUFFER_SIZE ? MAX_BUFFER_SIZE : block_size;
+    }
+
+    static unsigned char *allocate_buffer(tuint32 buffer_size)
+    {
+        return static_cast<unsigned char *>(
+            BufferPool::instance().allocate(buffer_size,MemoryStats::ckTAG_STREAM));
+    }
+
+    static void release_buffer(unsigned char *buffer,tuint32 buffer_size)
+    {
+        BufferPool::instance().release(buffer,buffer_size,MemoryStats::ckTAG_STREAM);
+    }
+
+    /**
+     * @brief Buffers filled in the background when reading ahead.
+     */
+    struct BufferedInStream::ReadAhead
+    {
+        struct Slot
+        {
+            unsigned char *data;
+            tint64 size;        // Result of reading into data.
+        };
+
+        std::vector<Slot> slots;
+        size_t head;            // Index of the next slot to consume.
+        size_t filled;          // Number of filled slots starting at head.
+
+        bool busy;              // Set when a task is reading.
+        bool cancel;            // Set to make the task stop reading.
+        bool end;               // Set when the end of the stream was reached.
+
+        FileInStream *file;     // Set if the underlying stream is a file.
+
+        thread::Mutex mutex;
+        thread::WaitCondition cond;
+    };
+
+    /**
+     * @brief Task filling the empty read-ahead buffers.
+     */
+    class BufferedInStream::ReadAheadTask : public Task
+    {
+    private:
+        InStream &stream_;
+        tuint32 buffer_size_;
+        ReadAhead &ra_;
+
+    public:
+        ReadAheadTask(InStream &stream,tuint32 buffer_size,ReadAhead &ra) :
+            stream_(stream),buffer_size_(buffer_size),ra_(ra)
+        {
+        }
+
+        void start()
+        {
+            Locker<thread::Mutex> lock(ra_.mutex);
+
+            // Let the operating system know what we're about to read.
+            if (ra_.file != NULL)
+            {
+                tint64 count = static_cast<tint64>(ra_.slots.size() - ra_.filled)*buffer_size_;
+                ra_.file->advise(File::ckADVICE_WILLNEED,count);
+            }
+
+            while (!ra_.cancel && !ra_.end && ra_.filled < ra_.slots.size())
+            {
+                // The empty slots are owned by the task until they're filled.
+                ReadAhead::Slot &slot = ra_.slots[(ra_.head + ra_.filled) % ra_.slots.size()];
+                ckVERIFY(lock.unlock());
+
+                tint64 res = stream_.end() ? 0 : stream_.read(slot.data,buffer_size_);
+                bool end = res <= 0 || stream_.end();
+
+                ckVERIFY(lock.relock());
+
+                if (res != 0)
+                {
+                    slot.size = res;
+                    ra_.filled++;
+                }
+
+                if (end)
+                    ra_.end = true;
+
+                ra_.cond.signal_all();
+            }
+
+            // The task must not touch the state after this point since the
+            // owner may destroy it as soon as it has been signaled.
+            ra_.busy = false;
+            ra_.cond.signal_all();
+        }
+    };
+
     BufferedInStream::BufferedInStream(InStream &stream) : stream_(stream),
-        buffer_(NULL),buffer_size_(0),buffer_pos_(0),buffer_data_(0)
+        buffer_(NULL),buffer_size_(0),buffer_pos_(0),buffer_data_(0),
+        stream_pos_(-1),read_ahead_(NULL),base_size_(0),refills_(0)
     {
-        // UPDATE: Hangs the application on some systems.
-        /*buffer_size_ = System::Cache(System::ckLEVEL_1);
-        if (buffer_size_ == 0)*/
-            buffer_size_ = 8192;
+        FileInStream *file_stream = dynamic_cast<FileInStream *>(&stream);
+        buffer_size_ = initial_buffer_size(file_stream != NULL ?
+                                           file_stream->block_size() : 0);
+        base_size_ = buffer_size_;
 
-        buffer_ = new unsigned char[buffer_size_];
+        buffer_ = allocate_buffer(buffer_size_);
 
         // Make sure that the memory allocation succeeded.
         if (buffer_ == NULL)
@@ -40,12 +167,13 @@ namespace ckcore
     BufferedInStream::BufferedInStream(InStream &stream,
                                        tuint32 buffer_size) :
         stream_(stream),buffer_(NULL),buffer_size_(buffer_size),buffer_pos_(0),
-        buffer_data_(0)
+        buffer_data_(0),stream_pos_(-1),read_ahead_(NULL),base_size_(0),
+        refills_(0)
     {
         if (buffer_size_ == 0)
             buffer_size_ = 8192;
 
-        buffer_ = new unsigned char[buffer_size_];
+        buffer_ = allocate_buffer(buffer_size_);
 
         // Make sure that the memory allocation succeeded.
         if (buffer_ == NULL)
@@ -54,53 +182,326 @@ namespace ckcore
 
     BufferedInStream::~BufferedInStream()
     {
+        if (read_ahead_ != NULL)
+        {
+            // Drop any data that has been read ahead but not consumed.
+            stop_read_ahead();
+            discard_read_ahead();
+            set_read_ahead(0);
+        }
+
         // Free the memory allocated for the internal buffer.
         if (buffer_ != NULL)
         {
-            delete [] buffer_;
+            release_buffer(buffer_,buffer_size_);
             buffer_ = NULL;
         }
     }
 
+    void BufferedInStream::resize_buffer(tuint32 buffer_size)
+    {
+        ckASSERT(buffer_data_ == 0);
+
+        // Keep the current buffer if we're out of memory.
+        unsigned char *new_buffer = allocate_buffer(buffer_size);
+        if (new_buffer == NULL)
+            return;
+
+        release_buffer(buffer_,buffer_size_);
+        buffer_ = new_buffer;
+        buffer_size_ = buffer_size;
+        buffer_pos_ = 0;
+    }
+
+    void BufferedInStream::reset_buffer_size()
+    {
+        refills_ = 0;
+        if (base_size_ != 0 && read_ahead_ == NULL && buffer_size_ > base_size_)
+            resize_buffer(base_size_);
+    }
+
+    void BufferedInStream::start_read_ahead()
+    {
+        read_ahead_->busy = true;
+        ThreadPool::instance().start(new ReadAheadTask(stream_,buffer_size_,
+                                                       *read_ahead_));
+    }
+
+    void BufferedInStream::stop_read_ahead()
+    {
+        Locker<thread::Mutex> lock(read_ahead_->mutex);
+
+        read_ahead_->cancel = true;
+        while (read_ahead_->busy)
+            read_ahead_->cond.wait(read_ahead_->mutex);
+
+        read_ahead_->cancel = false;
+    }
+
+    void BufferedInStream::discard_read_ahead()
+    {
+        read_ahead_->head = 0;
+        read_ahead_->filled = 0;
+        read_ahead_->end = false;
+    }
+
+    tuint32 BufferedInStream::skip_read_ahead(tuint32 distance)
+    {
+        ReadAhead &ra = *read_ahead_;
+
+        // Skip whole buffers that have already been read ahead. The task must
+        // have been stopped.
+        while (distance > buffer_data_ && ra.filled > 0 &&
+               ra.slots[ra.head].size > 0)
+        {
+            distance -= buffer_data_;
+
+            ReadAhead::Slot &slot = ra.slots[ra.head];
+            std::swap(slot.data,buffer_);
+            buffer_pos_ = 0;
+            buffer_data_ = (tuint32)slot.size;
+
+            if (stream_pos_ != -1)
+                stream_pos_ += slot.size;
+
+            ra.head = (ra.head + 1) % ra.slots.size();
+            ra.filled--;
+        }
+
+        return distance;
+    }
+
+    tint64 BufferedInStream::fetch()
+    {
+        if (read_ahead_ == NULL)
+        {
+            if (stream_.end())
+                return 0;
+
+            // Use a larger buffer when reading sequentially.
+            if (base_size_ != 0 && buffer_size_ < MAX_BUFFER_SIZE &&
+                ++refills_ >= GROW_THRESHOLD)
+            {
+                resize_buffer(buffer_size_*2 > MAX_BUFFER_SIZE ?
+                              MAX_BUFFER_SIZE : buffer_size_*2);
+                refills_ = 0;
+            }
+
+            return stream_.read(buffer_,buffer_size_);
+        }
+
+        ReadAhead &ra = *read_ahead_;
+        Locker<thread::Mutex> lock(ra.mutex);
+
+        while (ra.filled == 0)
+        {
+            if (!ra.busy)
+            {
+                if (ra.end)
+                    return 0;
+
+                start_read_ahead();
+            }
+
+            ra.cond.wait(ra.mutex);
+        }
+
+        // Exchange the current buffer with the filled one.
+        ReadAhead::Slot &slot = ra.slots[ra.head];
+        std::swap(slot.data,buffer_);
+        tint64 result = slot.size;
+
+        ra.head = (ra.head + 1) % ra.slots.size();
+        ra.filled--;
+
+        // Allow reading to be retried after an error.
+        if (result == -1)
+            ra.end = false;
+
+        // Refill the buffer we just gave away.
+        if (!ra.busy && !ra.end)
+            start_read_ahead();
+
+        return result;
+    }
+
+    bool BufferedInStream::set_read_ahead(tuint32 depth)
+    {
+        // Without a buffer we can't read ahead.
+        if (buffer_size_ == 0)
+            return depth == 0;
+
+        if (read_ahead_ != NULL)
+        {
+            stop_read_ahead();
+            if (read_ahead_->filled > 0)
+                return false;
+
+            for (size_t i = 0; i < read_ahead_->slots.size(); i++)
+                release_buffer(read_ahead_->slots[i].data,buffer_size_);
+
+            delete read_ahead_;
+            read_ahead_ = NULL;
+        }
+
+        if (depth == 0)
+            return true;
+
+        read_ahead_ = new ReadAhead();
+        read_ahead_->slots.resize(depth);
+        for (tuint32 i = 0; i < depth; i++)
+        {
+            read_ahead_->slots[i].data = allocate_buffer(buffer_size_);
+            read_ahead_->slots[i].size = 0;
+
+            if (read_ahead_->slots[i].data == NULL)
+            {
+                for (tuint32 j = 0; j < i; j++)
+                    release_buffer(read_ahead_->slots[j].data,buffer_size_);
+
+                delete read_ahead_;
+                read_ahead_ = NULL;
+                return false;
+            }
+        }
+
+        read_ahead_->head = 0;
+        read_ahead_->filled = 0;
+        read_ahead_->busy = false;
+        read_ahead_->cancel = false;
+        read_ahead_->end = false;
+
+        read_ahead_->file = dynamic_cast<FileInStream *>(&stream_);
+        if (read_ahead_->file != NULL)
+            read_ahead_->file->advise(File::ckADVICE_SEQUENTIAL);
+
+        return true;
+    }
+
     bool BufferedInStream::end()
     {
-        return stream_.end() && buffer_data_ == 0;
+        if (buffer_data_ != 0)
+            return false;
+
+        if (read_ahead_ == NULL)
+            return stream_.end();
+
+        ReadAhead &ra = *read_ahead_;
+        Locker<thread::Mutex> lock(ra.mutex);
+
+        // Wait for the task to tell whether there is more data.
+        while (ra.filled == 0 && ra.busy)
+            ra.cond.wait(ra.mutex);
+
+        return ra.filled == 0 && (ra.end || stream_.end());
     }
 
     bool BufferedInStream::seek(tuint32 distance,StreamWhence whence)
     {
-        // Reset the internal state if necessary.
+        // If we have failed to allocate the internal buffer, just redirect the
+        // seek call.
+        if (buffer_size_ == 0)
+            return stream_.seek(distance,whence);
+
+        if (read_ahead_ != NULL)
+        {
+            // The underlying stream can't be touched while reading ahead.
+            stop_read_ahead();
+
+            // Forward seeks may be served by the data that has been read ahead.
+            if (whence == ckSTREAM_BEGIN && stream_pos_ != -1 &&
+                distance >= stream_pos_ - buffer_data_)
+            {
+                distance = (tuint32)(distance - (stream_pos_ - buffer_data_));
+                whence = ckSTREAM_CURRENT;
+            }
+        }
+
         if (whence == ckSTREAM_BEGIN)
         {
-            if (!stream_.seek(0,ckSTREAM_BEGIN))
-                return false;
+            // Check if the target is inside the buffered window.
+            if (stream_pos_ != -1)
+            {
+                tint64 window_beg = stream_pos_ - buffer_pos_ - buffer_data_;
+                if (distance >= window_beg && distance <= stream_pos_)
+                {
+                    tuint32 window_pos = (tuint32)(distance - window_beg);
+
+                    buffer_data_ = buffer_pos_ + buffer_data_ - window_pos;
+                    buffer_pos_ = window_pos;
+                    return true;
+                }
+            }
 
             buffer_pos_ = 0;
             buffer_data_ = 0;
+
+            if (read_ahead_ != NULL)
+                discard_read_ahead();
+            else
+                reset_buffer_size();
+
+            if (!stream_.seek(distance,ckSTREAM_BEGIN))
+            {
+                stream_pos_ = -1;
+                return false;
+            }
+
+            stream_pos_ = distance;
+            return true;
         }
 
-        // Optimization.
-        if (distance == 0)
+        if (read_ahead_ != NULL)
+            distance = skip_read_ahead(distance);
+
+        // Optimization, move forward within the buffer.
+        if (distance <= buffer_data_)
+        {
+            buffer_pos_ += distance;
+            buffer_data_ -= distance;
+            return true;
+        }
+
+        distance -= buffer_data_;
+
+        buffer_pos_ = 0;
+        buffer_data_ = 0;
+
+        if (read_ahead_ != NULL)
+            discard_read_ahead();
+        else
+            reset_buffer_size();
+
+        if (stream_.seek(distance,ckSTREAM_CURRENT))
+        {
+            if (stream_pos_ != -1)
+                stream_pos_ += distance;
+
             return true;
+        }
 
-        // Perform the seek operation.
-        tuint32 buffer_size = buffer_size_ == 0 ? 8192 : buffer_size_;
-        unsigned char *temp_buffer = new unsigned char[buffer_size];
+        // The underlying stream does not support seeking, skip the data by
+        // reading it into the internal buffer.
         while (distance > 0)
         {
-            tuint32 read_bytes = distance > buffer_size ? buffer_size : distance;
+            if (stream_.end())
+                return false;
+
+            tuint32 read_bytes = distance > buffer_size_ ? buffer_size_ : distance;
 
-            tint64 res = read(temp_buffer,read_bytes);
+            tint64 res = stream_.read(buffer_,read_bytes);
             if (res == -1)
             {
-                delete [] temp_buffer;
+                stream_pos_ = -1;
                 return false;
             }
 
+            if (stream_pos_ != -1)
+                stream_pos_ += res;
+
             distance -= (tuint32)res;
         }
 
-        delete [] temp_buffer;
         return true;
     }
 
@@ -123,13 +524,37 @@ namespace ckcore
             buffer_pos_ = 0;
             buffer_data_ = 0;
 
-            // Fetch more data from the input stream.
-            if (stream_.end())
-                return pos;
+            // Large requests are read directly into the destination buffer.
+            if (count >= buffer_size_ && read_ahead_ == NULL)
+            {
+                if (stream_.end())
+                    return pos;
+
+                tint64 result = stream_.read((unsigned char *)buffer + pos,count);
+                if (result == -1)
+                    stream_pos_ = -1;
+
+                if (result <= 0)
+                    return pos == 0 ? result : pos;
+
+                if (stream_pos_ != -1)
+                    stream_pos_ += result;
+
+                pos += (tuint32)result;
+                count -= (tuint32)result;
+                continue;
+            }
 
-            tint64 result = stream_.read(buffer_,buffer_size_);
+            // Fetch more data from the input stream.
+            tint64 result = fetch();
             if (result == -1)
-                return pos == 0 ? -1 : pos;
+                stream_pos_ = -1;
+
+            if (result <= 0)
+                return pos == 0 ? result : pos;
+
+            if (stream_pos_ != -1)
+                stream_pos_ += result;
 
             buffer_data_ = (tuint32)result;
         }
@@ -146,15 +571,85 @@ namespace ckcore
         return stream_.size();
     }
 
+    /**
+     * @brief Buffers waiting to be written in the background.
+     */
+    struct BufferedOutStream::WriteBehind
+    {
+        struct Slot
+        {
+            unsigned char *data;
+            tuint32 size;       // Number of bytes to write from data.
+        };
+
+        std::vector<Slot> slots;
+        size_t head;            // Index of the next slot to write.
+        size_t queued;          // Number of queued slots starting at head.
+
+        bool busy;              // Set when a task is writing.
+        bool error;             // Set when a background write failed.
+
+        thread::Mutex mutex;
+        thread::WaitCondition cond;
+    };
+
+    /**
+     * @brief Task writing the queued write-behind buffers.
+     */
+    class BufferedOutStream::WriteBehindTask : public Task
+    {
+    private:
+        OutStream &stream_;
+        WriteBehind &wb_;
+
+    public:
+        WriteBehindTask(OutStream &stream,WriteBehind &wb) :
+            stream_(stream),wb_(wb)
+        {
+        }
+
+        void start()
+        {
+            Locker<thread::Mutex> lock(wb_.mutex);
+
+            while (wb_.queued > 0)
+            {
+                // Queued slots are owned by the task until they're written.
+                WriteBehind::Slot &slot = wb_.slots[wb_.head];
+
+                // Once a write has failed the remaining data is dropped.
+                if (!wb_.error)
+                {
+                    ckVERIFY(lock.unlock());
+                    tint64 res = stream_.write(slot.data,slot.size);
+                    ckVERIFY(lock.relock());
+
+                    if (res != slot.size)
+                        wb_.error = true;
+                }
+
+                wb_.head = (wb_.head + 1) % wb_.slots.size();
+                wb_.queued--;
+                wb_.cond.signal_all();
+            }
+
+            // The task must not touch the state after this point since the
+            // owner may destroy it as soon as it has been signaled.
+            wb_.busy = false;
+            wb_.cond.signal_all();
+        }
+    };
+
     BufferedOutStream::BufferedOutStream(OutStream &stream) : stream_(stream),
-        buffer_(NULL),buffer_size_(0),buffer_pos_(0)
+        buffer_(NULL),buffer_size_(0),buffer_pos_(0),write_behind_(NULL),
+        base_size_(0),flushes_(0)
     {
-        // UPDATE: Hangs the application on some systems.
-        /*buffer_size_ = System::Cache(System::ckLEVEL_1);
-        if (buffer_size_ == 0)*/
-            buffer_size_ = 8192;
+        FileOutStream *file_stream = dynamic_cast<FileOutStream *>(&stream);
+        buffer_size_ = initial_buffer_size(file_stream != NULL ?
+                                           file_stream->block_size() : 0);
+        base_size_ = buffer_size_;
 
-        buffer_ = new unsigned char[buffer_size_];
+        buffer_ = allocate_buffer(buffer_size_);
 
         // Make sure that the memory allocation succeeded.
         if (buffer_ == NULL)
@@ -163,12 +658,13 @@ namespace ckcore
 
     BufferedOutStream::BufferedOutStream(OutStream &stream,
                                          tuint32 buffer_size) :
-        stream_(stream),buffer_(NULL),buffer_size_(buffer_size),buffer_pos_(0)
+        stream_(stream),buffer_(NULL),buffer_size_(buffer_size),buffer_pos_(0),
+        write_behind_(NULL),base_size_(0),flushes_(0)
     {
         if (buffer_size_ == 0)
             buffer_size_ = 8192;
 
-        buffer_ = new unsigned char[buffer_size_];
+        buffer_ = allocate_buffer(buffer_size_);
 
         // Make sure that the memory allocation succeeded.
         if (buffer_ == NULL)
@@ -179,14 +675,101 @@ namespace ckcore
     {
         flush();
 
+        // Wait for all queued data to be written.
+        set_write_behind(0);
+
         // Free the memory allocated for the internal buffer.
         if (buffer_ != NULL)
         {
-            delete [] buffer_;
+            release_buffer(buffer_,buffer_size_);
             buffer_ = NULL;
         }
     }
 
+    tint64 BufferedOutStream::write_buffer(tuint32 count)
+    {
+        if (write_behind_ == NULL)
+            return stream_.write(buffer_,count);
+
+        WriteBehind &wb = *write_behind_;
+        Locker<thread::Mutex> lock(wb.mutex);
+
+        // Wait for a free slot, this bounds the memory in use.
+        while (wb.queued == wb.slots.size())
+            wb.cond.wait(wb.mutex);
+
+        if (wb.error)
+            return -1;
+
+        // Exchange the current buffer with the free one.
+        WriteBehind::Slot &slot = wb.slots[(wb.head + wb.queued) % wb.slots.size()];
+        std::swap(slot.data,buffer_);
+        slot.size = count;
+        wb.queued++;
+
+        if (!wb.busy)
+        {
+            wb.busy = true;
+            ThreadPool::instance().start(new WriteBehindTask(stream_,wb));
+        }
+
+        return count;
+    }
+
+    bool BufferedOutStream::set_write_behind(tuint32 depth)
+    {
+        // Without a buffer we can't write behind.
+        if (buffer_size_ == 0)
+            return depth == 0;
+
+        bool result = true;
+
+        if (write_behind_ != NULL)
+        {
+            {
+                Locker<thread::Mutex> lock(write_behind_->mutex);
+                while (write_behind_->busy)
+                    write_behind_->cond.wait(write_behind_->mutex);
+
+                result = !write_behind_->error;
+            }
+
+            for (size_t i = 0; i < write_behind_->slots.size(); i++)
+                release_buffer(write_behind_->slots[i].data,buffer_size_);
+
+            delete write_behind_;
+            write_behind_ = NULL;
+        }
+
+        if (depth == 0)
+            return result;
+
+        write_behind_ = new WriteBehind();
+        write_behind_->slots.resize(depth);
+        for (tuint32 i = 0; i < depth; i++)
+        {
+            write_behind_->slots[i].data = allocate_buffer(buffer_size_);
+            write_behind_->slots[i].size = 0;
+
+            if (write_behind_->slots[i].data == NULL)
+            {
+                for (tuint32 j = 0; j < i; j++)
+                    release_buffer(write_behind_->slots[j].data,buffer_size_);
+
+                delete write_behind_;
+                write_behind_ = NULL;
+                return false;
+            }
+        }
+
+        write_behind_->head = 0;
+        write_behind_->queued = 0;
+        write_behind_->busy = false;
+        write_behind_->error = false;
+
+        return result;
+    }
+
     tint64 BufferedOutStream::write(const void *buffer,tuint32 count)
     {
         // If we failed to allocate the internal buffer, just redirect the
@@ -198,18 +781,54 @@ namespace ckcore
 
         while (buffer_pos_ + count > buffer_size_)
         {
+            // Large requests are written directly after the buffered data.
+            if (count >= buffer_size_ && write_behind_ == NULL)
+            {
+                if (buffer_pos_ > 0)
+                {
+                    if (stream_.write(buffer_,buffer_pos_) == -1)
+                        return pos == 0 ? -1 : static_cast<tint64>(pos);
+
+                    buffer_pos_ = 0;
+                }
+
+                tint64 result = stream_.write((unsigned char *)buffer + pos,count);
+                if (result == -1)
+                    return pos == 0 ? -1 : static_cast<tint64>(pos);
+
+                return pos + result;
+            }
+
             tuint32 remain = buffer_size_ - buffer_pos_;
             memcpy(buffer_ + buffer_pos_,(unsigned char *)buffer + pos,remain);
 
             pos += remain;
 
             // Flush.
-            if (stream_.write(buffer_,buffer_size_) == -1)
-                return pos == 0 ? -1 : pos;
+            if (write_buffer(buffer_size_) == -1)
+                return pos == 0 ? -1 : static_cast<tint64>(pos);
 
             buffer_pos_ = 0;
 
             count -= remain;
+
+            // Use a larger buffer when writing continuously.
+            if (base_size_ != 0 && write_behind_ == NULL &&
+                buffer_size_ < MAX_BUFFER_SIZE && ++flushes_ >= GROW_THRESHOLD)
+            {
+                tuint32 buffer_size = buffer_size_*2 > MAX_BUFFER_SIZE ?
+                                      MAX_BUFFER_SIZE : buffer_size_*2;
+
+                unsigned char *new_buffer = allocate_buffer(buffer_size);
+                if (new_buffer != NULL)
+                {
+                    release_buffer(buffer_,buffer_size_);
+                    buffer_ = new_buffer;
+                    buffer_size_ = buffer_size;
+                }
+
+                flushes_ = 0;
+            }
         }
 
         memcpy(buffer_ + buffer_pos_,(unsigned char *)buffer + pos,count);
@@ -224,10 +843,24 @@ namespace ckcore
         if (buffer_size_ == 0)
             return 0;
 
-        tint64 result = stream_.write(buffer_,buffer_pos_);
+        tint64 result = buffer_pos_ > 0 || write_behind_ == NULL ?
+                        write_buffer(buffer_pos_) : 0;
         if (result != -1)
             buffer_pos_ = 0;
 
+        flushes_ = 0;
+
+        // Wait for all queued data to be written.
+        if (write_behind_ != NULL)
+        {
+            Locker<thread::Mutex> lock(write_behind_->mutex);
+            while (write_behind_->busy)
+                write_behind_->cond.wait(write_behind_->mutex);
+
+            if (write_behind_->error)
+                return -1;
+        }
+
         return result;
     }
 }
@@ -0,0 +1,352 @@
+/*
+ * The ckCore library provides core software functionality.
+ * Copyright (C) 2006-2012 Christian Kindahl
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef _WINDOWS
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#include "ckcore/locker.hh"
+#include "ckcore/memorystats.hh"
+#include "ckcore/bufferpool.hh"
+
+namespace ckcore
+{
+    /**
+     * The maximum number of bytes kept in each size class of a thread cache
+     * and of the shared free list.
+     */
+    static const size_t THREAD_CACHE_BYTES = 512*1024;
+    static const size_t SHARED_CACHE_BYTES = 8*1024*1024;
+
+    /**
+     * Buffers of at least this size are rounded up to a multiple of it so that
+     * they can be backed by huge pages.
+     */
+    static const size_t HUGE_PAGE_SIZE = 2*1024*1024;
+
+    /**
+     * Returns the index of the smallest size class that can hold the
+     * specified number of bytes.
+     */
+    static size_t size_class(size_t size)
+    {
+        size_t index = 0;
+        while ((static_cast<size_t>(BufferPool::MIN_BUFFER_SIZE) << index) < size)
+            index++;
+
+        return index;
+    }
+
+    /**
+     * Returns the buffer size of the specified size class.
+     */
+    static size_t class_size(size_t index)
+    {
+        return static_cast<size_t>(BufferPool::MIN_BUFFER_SIZE) << index;
+    }
+
+    /**
+     * Returns the number of buffers of a size class that fits in the
+     * specified number of bytes, at least one buffer is always allowed.
+     */
+    static size_t class_limit(size_t index,size_t bytes)
+    {
+        size_t limit = bytes/class_size(index);
+        return limit == 0 ? 1 : limit;
+    }
+
+    /**
+     * @brief Buffers cached by a single thread.
+     */
+    struct BufferPool::ThreadCache
+    {
+        std::vector<void *> free[NUM_SIZE_CLASSES];
+    };
+
+    BufferPool::BufferPool() : page_size_(4096),huge_pages_(false)
+    {
+#ifdef _WINDOWS
+        SYSTEM_INFO system_info;
+        GetSystemInfo(&system_info);
+        page_size_ = system_info.dwPageSize;
+#else
+        long page_size = sysconf(_SC_PAGESIZE);
+        if (page_size > 0)
+            page_size_ = static_cast<size_t>(page_size);
+
+        cache_key_valid_ = pthread_key_create(&cache_key_,destroy_cache) == 0;
+#endif
+    }
+
+    BufferPool::~BufferPool()
+    {
+        trim();
+    }
+
+#ifdef _UNIX
+    void BufferPool::destroy_cache(void *cache)
+    {
+        ThreadCache *thread_cache = static_cast<ThreadCache *>(cache);
+
+        // Hand the buffers of the exiting thread over to the other threads.
+        BufferPool &pool = instance();
+        for (size_t i = 0; i < NUM_SIZE_CLASSES; i++)
+        {
+            for (size_t j = 0; j < thread_cache->free[i].size(); j++)
+                pool.release_shared(thread_cache->free[i][j],i);
+        }
+
+        delete thread_cache;
+    }
+#endif
+
+    BufferPool::ThreadCache *BufferPool::thread_cache()
+    {
+#ifdef _WINDOWS
+        // Windows XP does not notify about exiting threads for dynamically
+        // allocated thread local storage, so only the shared free list is
+        // used.
+        return NULL;
+#else
+        if (!cache_key_valid_)
+            return NULL;
+
+        ThreadCache *cache = static_cast<ThreadCache *>(pthread_getspecific(cache_key_));
+        if (cache == NULL)
+        {
+            cache = new ThreadCache();
+            if (pthread_setspecific(cache_key_,cache) != 0)
+            {
+                delete cache;
+                return NULL;
+            }
+        }
+
+        return cache;
+#endif
+    }
+
+    void BufferPool::release_shared(void *buffer,size_t size_class)
+    {
+        {
+            Locker<thread::Mutex> lock(mutex_);
+            if (free_[size_class].size() < class_limit(size_class,SHARED_CACHE_BYTES))
+            {
+                free_[size_class].push_back(buffer);
+                return;
+            }
+        }
+
+        free_system(buffer,class_size(size_class));
+    }
+
+    void *BufferPool::allocate_system(size_t size)
+    {
+#ifdef _WINDOWS
+        if (size > MAX_BUFFER_SIZE)
+        {
+            void *buffer = NULL;
+#if _WIN32_WINNT >= 0x0502
+            // Large pages require the lock memory privilege.
+            SIZE_T large_page_size = GetLargePageMinimum();
+            if (huge_pages_ && large_page_size != 0 && size % large_page_size == 0)
+            {
+                buffer = VirtualAlloc(NULL,size,MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                                      PAGE_READWRITE);
+                if (buffer != NULL)
+                    return buffer;
+            }
+#endif
+            return VirtualAlloc(NULL,size,MEM_RESERVE | MEM_COMMIT,PAGE_READWRITE);
+        }
+
+        return _aligned_malloc(size,page_size_);
+#else
+        if (size > MAX_BUFFER_SIZE)
+        {
+            void *buffer = MAP_FAILED;
+#ifdef MAP_HUGETLB
+            // Only succeeds if the system has reserved huge pages.
+            if (huge_pages_ && size % HUGE_PAGE_SIZE == 0)
+            {
+                buffer = mmap(NULL,size,PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,-1,0);
+            }
+#endif
+            if (buffer == MAP_FAILED)
+            {
+                buffer = mmap(NULL,size,PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+                if (buffer == MAP_FAILED)
+                    return NULL;
+
+#ifdef MADV_HUGEPAGE
+                // Fall back to transparent huge pages.
+                if (huge_pages_ && size % HUGE_PAGE_SIZE == 0)
+                    madvise(buffer,size,MADV_HUGEPAGE);
+#endif
+            }
+
+            return buffer;
+        }
+
+        void *buffer = NULL;
+        if (posix_memalign(&buffer,page_size_,size) != 0)
+            return NULL;
+
+        return buffer;
+#endif
+    }
+
+    void BufferPool::free_system(void *buffer,size_t size)
+    {
+#ifdef _WINDOWS
+        if (size > MAX_BUFFER_SIZE)
+            VirtualFree(buffer,0,MEM_RELEASE);
+        else
+            _aligned_free(buffer);
+#else
+        if (size > MAX_BUFFER_SIZE)
+            munmap(buffer,size);
+        else
+            free(buffer);
+#endif
+    }
+
+    BufferPool &BufferPool::instance()
+    {
+        static BufferPool *instance = new BufferPool();
+        return *instance;
+    }
+
+    size_t BufferPool::capacity(size_t size) const
+    {
+        if (size <= MAX_BUFFER_SIZE)
+            return class_size(size_class(size));
+
+        // The rounding must not depend on whether huge pages are enabled
+        // since the capacity is used to free the buffer.
+        size_t unit = size >= HUGE_PAGE_SIZE ? HUGE_PAGE_SIZE : page_size_;
+        return ((size + unit - 1)/unit)*unit;
+    }
+
+    void *BufferPool::allocate_buffer(size_t size)
+    {
+        if (size > MAX_BUFFER_SIZE)
+            return allocate_system(capacity(size));
+
+        size_t index = size_class(size);
+
+        ThreadCache *cache = thread_cache();
+        if (cache != NULL && !cache->free[index].empty())
+        {
+            void *buffer = cache->free[index].back();
+            cache->free[index].pop_back();
+            return buffer;
+        }
+
+        {
+            Locker<thread::Mutex> lock(mutex_);
+            if (!free_[index].empty())
+            {
+                void *buffer = free_[index].back();
+                free_[index].pop_back();
+                return buffer;
+            }
+        }
+
+        return allocate_system(class_size(index));
+    }
+
+    void *BufferPool::allocate(size_t size,MemoryStats::Tag tag)
+    {
+        void *buffer = allocate_buffer(size);
+        if (buffer != NULL)
+            MemoryStats::instance().allocated(tag,buffer,capacity(size));
+
+        return buffer;
+    }
+
+    void BufferPool::release(void *buffer,size_t size,MemoryStats::Tag tag)
+    {
+        if (buffer == NULL)
+            return;
+
+        MemoryStats::instance().released(tag,buffer,capacity(size));
+
+        if (size > MAX_BUFFER_SIZE)
+        {
+            free_system(buffer,capacity(size));
+            return;
+        }
+
+        size_t index = size_class(size);
+
+        ThreadCache *cache = thread_cache();
+        if (cache != NULL &&
+            cache->free[index].size() < class_limit(index,THREAD_CACHE_BYTES))
+        {
+            cache->free[index].push_back(buffer);
+            return;
+        }
+
+        release_shared(buffer,index);
+    }
+
+    void BufferPool::trim()
+    {
+        ThreadCache *cache = thread_cache();
+
+        Locker<thread::Mutex> lock(mutex_);
+        for (size_t i = 0; i < NUM_SIZE_CLASSES; i++)
+        {
+            for (size_t j = 0; j < free_[i].size(); j++)
+                free_system(free_[i][j],class_size(i));
+
+            free_[i].clear();
+
+            if (cache != NULL)
+            {
+                for (size_t j = 0; j < cache->free[i].size(); j++)
+                    free_system(cache->free[i][j],class_size(i));
+
+                cache->free[i].clear();
+            }
+        }
+    }
+
+    tuint64 BufferPool::cached()
+    {
+        Locker<thread::Mutex> lock(mutex_);
+
+        tuint64 bytes = 0;
+        for (size_t i = 0; i < NUM_SIZE_CLASSES; i++)
+            bytes += static_cast<tuint64>(free_[i].size())*class_size(i);
+
+        return bytes;
+    }
+
+    void BufferPool::set_huge_pages(bool enable)
+    {
+        huge_pages_ = enable;
+    }
+}
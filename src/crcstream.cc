@@ -21,6 +21,87 @@
 
 namespace ckcore
 {
+    /**
+     * Number of independent checksums calculated in parallel by
+     * CrcStream::checksum_many.
+     */
+    static const size_t CRC_LANES = 4;
+
+    /**
+     * Calculates the checksum of up to CRC_LANES buffers in an interleaved
+     * fashion. The lanes are advanced in lock step for as long as all of them
+     * have data left, the remainder of each buffer is then processed on its
+     * own.
+     */
+    template <bool Reflect>
+    static void checksum_lanes(const tuint32 *table,unsigned char order,
+                               tuint32 mask,tuint32 initial,
+                               const unsigned char **data,const size_t *counts,
+                               tuint32 *checksums,size_t lanes)
+    {
+        const unsigned char shift = order - 8;
+
+        tuint32 crc[CRC_LANES];
+        size_t common = counts[0];
+        for (size_t i = 0; i < lanes; i++)
+        {
+            crc[i] = initial;
+            if (counts[i] < common)
+                common = counts[i];
+        }
+
+        if (lanes == CRC_LANES)
+        {
+            tuint32 c0 = crc[0],c1 = crc[1],c2 = crc[2],c3 = crc[3];
+            const unsigned char *d0 = data[0],*d1 = data[1],
+                                *d2 = data[2],*d3 = data[3];
+
+            for (size_t i = 0; i < common; i++)
+            {
+                if (Reflect)
+                {
+                    c0 = (c0 >> 8) ^ table[(c0 ^ d0[i]) & 0xff];
+                    c1 = (c1 >> 8) ^ table[(c1 ^ d1[i]) & 0xff];
+                    c2 = (c2 >> 8) ^ table[(c2 ^ d2[i]) & 0xff];
+                    c3 = (c3 >> 8) ^ table[(c3 ^ d3[i]) & 0xff];
+                }
+                else
+                {
+                    c0 = ((c0 << 8) ^ table[((c0 >> shift) ^ d0[i]) & 0xff]) & mask;
+                    c1 = ((c1 << 8) ^ table[((c1 >> shift) ^ d1[i]) & 0xff]) & mask;
+                    c2 = ((c2 << 8) ^ table[((c2 >> shift) ^ d2[i]) & 0xff]) & mask;
+                    c3 = ((c3 << 8) ^ table[((c3 >> shift) ^ d3[i]) & 0xff]) & mask;
+                }
+            }
+
+            crc[0] = c0;
+            crc[1] = c1;
+            crc[2] = c2;
+            crc[3] = c3;
+        }
+        else
+        {
+            common = 0;
+        }
+
+        // Process what remains of each buffer.
+        for (size_t i = 0; i < lanes; i++)
+        {
+            tuint32 c = crc[i];
+            const unsigned char *d = data[i];
+
+            for (size_t j = common; j < counts[i]; j++)
+            {
+                if (Reflect)
+                    c = (c >> 8) ^ table[(c ^ d[j]) & 0xff];
+                else
+                    c = ((c << 8) ^ table[((c >> shift) ^ d[j]) & 0xff]) & mask;
+            }
+
+            checksums[i] = c;
+        }
+    }
+
     tuint32 CrcStream::reflect(tuint32 crc,unsigned char length)
     {
         tuint32 result = 0;
@@ -120,4 +201,42 @@ namespace ckcore
 
         return count;
     }
+
+    void CrcStream::checksum_many(const void * const *buffers,
+                                  const size_t *counts,tuint32 *checksums,
+                                  size_t num) const
+    {
+        const unsigned char *data[CRC_LANES];
+
+        for (size_t i = 0; i < num; i += CRC_LANES)
+        {
+            size_t lanes = num - i < CRC_LANES ? num - i : CRC_LANES;
+            for (size_t j = 0; j < lanes; j++)
+                data[j] = static_cast<const unsigned char *>(buffers[i + j]);
+
+            if (reflect_)
+            {
+                checksum_lanes<true>(table_,order_,mask_,initial_,data,
+                                     counts + i,checksums + i,lanes);
+            }
+            else
+            {
+                checksum_lanes<false>(table_,order_,mask_,initial_,data,
+                                      counts + i,checksums + i,lanes);
+            }
+
+            for (size_t j = 0; j < lanes; j++)
+                checksums[i + j] ^= final_;
+        }
+    }
+
+    namespace crc
+    {
+        void compute_many(CrcStream::CrcType type,const void * const *buffers,
+                          const size_t *counts,tuint32 *checksums,size_t num)
+        {
+            CrcStream stream(type);
+            stream.checksum_many(buffers,counts,checksums,num);
+        }
+    }
 }
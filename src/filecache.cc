@@ -0,0 +1,255 @@
+/*
+ * The ckCore library provides core software functionality.
+ * Copyright (C) 2006-2012 Christian Kindahl
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef _UNIX
+#include <sys/resource.h>
+#endif
+#include "ckcore/locker.hh"
+#include "ckcore/filecache.hh"
+
+namespace ckcore
+{
+    /**
+     * Checks if the file described by the two meta data objects is the same
+     * and has not been modified.
+     */
+    static bool same_file(const File::Info &info1,const File::Info &info2)
+    {
+        return info1.inode == info2.inode && info1.device == info2.device &&
+               info1.modify_time == info2.modify_time &&
+               info1.size == info2.size;
+    }
+
+    FileCache::Handle::Handle()
+        : cache_(NULL),entry_(NULL)
+    {
+    }
+
+    FileCache::Handle::Handle(FileCache *cache,Entry *entry)
+        : cache_(cache),entry_(entry)
+    {
+    }
+
+    FileCache::Handle::Handle(const Handle &rhs)
+        : cache_(rhs.cache_),entry_(rhs.entry_)
+    {
+        if (entry_ != NULL)
+        {
+            Locker<thread::Mutex> lock(cache_->mutex_);
+            entry_->refs++;
+        }
+    }
+
+    FileCache::Handle::~Handle()
+    {
+        reset();
+    }
+
+    FileCache::Handle &FileCache::Handle::operator=(const Handle &rhs)
+    {
+        if (entry_ == rhs.entry_)
+            return *this;
+
+        reset();
+
+        cache_ = rhs.cache_;
+        entry_ = rhs.entry_;
+        if (entry_ != NULL)
+        {
+            Locker<thread::Mutex> lock(cache_->mutex_);
+            entry_->refs++;
+        }
+
+        return *this;
+    }
+
+    void FileCache::Handle::reset()
+    {
+        if (entry_ != NULL)
+            cache_->release(entry_);
+
+        cache_ = NULL;
+        entry_ = NULL;
+    }
+
+    bool FileCache::Handle::test() const
+    {
+        return entry_ != NULL;
+    }
+
+    tint64 FileCache::Handle::read(void *buffer,tint64 count,tint64 offset) const
+    {
+        if (entry_ == NULL)
+            return -1;
+
+        return entry_->file.read_at(buffer,count,offset);
+    }
+
+    const File::Info &FileCache::Handle::info() const
+    {
+        return entry_->info;
+    }
+
+    File &FileCache::Handle::file() const
+    {
+        return entry_->file;
+    }
+
+    FileCache::FileCache(size_t capacity)
+        : capacity_(capacity)
+    {
+#ifdef _UNIX
+        // Leave the majority of the file descriptors to the rest of the
+        // process.
+        struct rlimit limit;
+        if (getrlimit(RLIMIT_NOFILE,&limit) == 0 &&
+            limit.rlim_cur != RLIM_INFINITY && capacity_ > limit.rlim_cur/4)
+        {
+            capacity_ = static_cast<size_t>(limit.rlim_cur/4);
+        }
+#endif
+        if (capacity_ == 0)
+            capacity_ = 1;
+    }
+
+    FileCache::~FileCache()
+    {
+        clear();
+    }
+
+    /**
+     * Removes an idle entry from the cache and closes the file. Must be called
+     * with the mutex held.
+     */
+    void FileCache::evict(Entry *entry)
+    {
+        lru_.erase(entry->lru);
+        entries_.erase(entry->path.name());
+        delete entry;
+    }
+
+    void FileCache::release(Entry *entry)
+    {
+        Locker<thread::Mutex> lock(mutex_);
+        if (--entry->refs > 0)
+            return;
+
+        if (!entry->cached)
+        {
+            delete entry;
+            return;
+        }
+
+        entry->lru = lru_.insert(lru_.end(),entry);
+
+        // Trim entries that were handed out while the cache was full.
+        while (entries_.size() > capacity_ && !lru_.empty())
+            evict(lru_.front());
+    }
+
+    FileCache::Handle FileCache::open(const Path &file_path)
+    {
+        File::Info info;
+        if (!File::info(file_path,info))
+            return Handle();
+
+        {
+            Locker<thread::Mutex> lock(mutex_);
+
+            std::map<tstring,Entry *>::iterator it =
+                entries_.find(file_path.name());
+            if (it != entries_.end())
+            {
+                Entry *entry = it->second;
+                if (same_file(entry->info,info))
+                {
+                    if (entry->refs++ == 0)
+                        lru_.erase(entry->lru);
+
+                    return Handle(this,entry);
+                }
+
+                // The file has changed, current users keep the old file
+                // while new users get the new one.
+                if (entry->refs == 0)
+                {
+                    evict(entry);
+                }
+                else
+                {
+                    entry->cached = false;
+                    entries_.erase(it);
+                }
+            }
+        }
+
+        // Open the file without holding the lock so that other files can be
+        // looked up in the meantime.
+        // Cached files may stay open for a long time, they should not leak
+        // into child processes nor keep other readers and writers out.
+        File::OpenOptions options;
+        options.no_atime = true;
+        options.close_on_exec = true;
+        options.lock = File::ckLOCK_NONE;
+
+        Entry *entry = new Entry(file_path);
+        if (!entry->file.open(File::ckOPEN_READ,options) ||
+            !entry->file.info(entry->info))
+        {
+            delete entry;
+            return Handle();
+        }
+
+        entry->refs = 1;
+
+        Locker<thread::Mutex> lock(mutex_);
+        if (entries_.find(file_path.name()) != entries_.end())
+            return Handle(this,entry);      // Lost the race, remain uncached.
+
+        if (entries_.size() >= capacity_ && !lru_.empty())
+            evict(lru_.front());
+
+        // If all cached files are in use the file is handed out uncached,
+        // it will be closed as soon as it is released.
+        if (entries_.size() < capacity_)
+        {
+            entry->cached = true;
+            entries_[file_path.name()] = entry;
+        }
+
+        return Handle(this,entry);
+    }
+
+    void FileCache::clear()
+    {
+        Locker<thread::Mutex> lock(mutex_);
+        while (!lru_.empty())
+            evict(lru_.front());
+    }
+
+    size_t FileCache::capacity() const
+    {
+        return capacity_;
+    }
+
+    size_t FileCache::count()
+    {
+        Locker<thread::Mutex> lock(mutex_);
+        return entries_.size();
+    }
+}
@@ -17,15 +17,31 @@
  */
 
 #include "ckcore/filestream.hh"
+#include "ckcore/system.hh"
 
 #include <assert.h>
 
 namespace ckcore
 {
-    FileInStream::FileInStream(const Path &file_path)
+    /**
+     * The number of bytes consumed before being released from the cache
+     * using the ckACCESS_DROP_BEHIND policy.
+     */
+    static const tint64 DROP_BEHIND_SIZE = 4*1024*1024;
+
+    FileInStream::FileInStream(const Path &file_path,bool unbuffered)
       : file_(file_path)
       , read_(0)
+      , policy_(ckACCESS_NORMAL)
+      , dropped_(0)
+      , watch_(file_path)
+      , follow_(false)
+      , follow_timeout_(0)
+      , closed_(false)
+      , eof_(false)
     {
+      file_.set_unbuffered(unbuffered);
+
       // TODO: we should make all callers exception safe, because
       //       it's hard to be certain that everybody always checks
       //       whether the size_ is -1 before trying to use
@@ -45,30 +61,75 @@ namespace ckcore
         close();
     }
 
+    void FileInStream::set_options(const File::OpenOptions &options)
+    {
+        options_ = options;
+    }
+
     bool FileInStream::open()
     {
+        // Start watching before opening so that no changes are missed.
+        closed_ = eof_ = false;
+        if (follow_ && !watch_.open())
+            return false;
+
         try
         {
-          size_ = file_.size2();
-        }
-        catch ( ... )
-        {
-          size_ = -1;
-        }
-        
-        try
-        {
-          file_.open2(File::ckOPEN_READ);
+          file_.open2(File::ckOPEN_READ,options_);
+
+          // Query the size through the open handle.
+          File::Info info;
+          size_ = file_.info(info) ? info.size : -1;
+
+          dropped_ = 0;
+          apply_policy();
           return true;
         }
         catch ( ... )
         {
+          watch_.close();
           return false;
         }
     }
 
+    bool FileInStream::open(FileCache &cache)
+    {
+        if (test())
+            return false;
+
+        closed_ = eof_ = false;
+        if (follow_ && !watch_.open())
+            return false;
+
+        cached_ = cache.open(Path(file_.name().c_str()));
+        if (!cached_.test())
+        {
+            watch_.close();
+            return false;
+        }
+
+        size_ = cached_.info().size;
+        read_ = 0;
+        dropped_ = 0;
+        apply_policy();
+        return true;
+    }
+
     bool FileInStream::close()
     {
+        // Release the remaining data now that we are done with it.
+        if (policy_ == ckACCESS_DROP_BEHIND && test())
+            drop_behind(true);
+
+        watch_.close();
+
+        if (cached_.test())
+        {
+            cached_.reset();
+            read_ = 0;
+            return true;
+        }
+
         if (file_.close())
         {
             read_ = 0;
@@ -80,6 +141,9 @@ namespace ckcore
 
     bool FileInStream::end()
     {
+        if (follow_)
+            return eof_;
+
         return read_ >= size_;
     }
 
@@ -97,11 +161,31 @@ namespace ckcore
                 break;
         }
 
+        // Files opened through a cache are read using positional reads.
+        if (cached_.test())
+        {
+            tint64 result = file_whence == File::ckFILE_CURRENT ?
+                            read_ + distance : distance;
+            if (result > size_)
+                return false;
+
+            read_ = result;
+            if (read_ < dropped_)
+                dropped_ = read_;
+
+            return true;
+        }
+
         try
         {
             tint64 result = file_.seek2(distance,file_whence);
             assert( result != -1 );  // Errors throw now exceptions.
             read_ = result;
+
+            // Only release data read after the new position.
+            if (read_ < dropped_)
+                dropped_ = read_;
+
             return true;
         }
         catch ( ... )
@@ -112,14 +196,132 @@ namespace ckcore
 
     bool FileInStream::test() const
     {
-        return file_.test();
+        return file_.test() || cached_.test();
+    }
+
+    /**
+     * Returns the file object used for reading, which is shared with other
+     * readers if the file was opened through a cache.
+     */
+    File &FileInStream::active_file()
+    {
+        return cached_.test() ? cached_.file() : file_;
+    }
+
+    bool FileInStream::advise(File::FileAdvice advice,tint64 count)
+    {
+        return active_file().advise(advice,read_,count);
+    }
+
+    void FileInStream::set_policy(AccessPolicy policy)
+    {
+        policy_ = policy;
+        if (test())
+            apply_policy();
+    }
+
+    void FileInStream::apply_policy()
+    {
+        active_file().advise(policy_ == ckACCESS_NORMAL ?
+                             File::ckADVICE_NORMAL : File::ckADVICE_SEQUENTIAL);
+    }
+
+    /**
+     * Releases the consumed data from the file cache. Unless all is true, the
+     * data is released in large chunks to limit the number of system calls.
+     */
+    void FileInStream::drop_behind(bool all)
+    {
+        if (read_ - dropped_ < (all ? 1 : DROP_BEHIND_SIZE))
+            return;
+
+        active_file().advise(File::ckADVICE_DONTNEED,dropped_,read_ - dropped_);
+        dropped_ = read_;
+    }
+
+    void FileInStream::set_follow(bool follow,tuint32 timeout)
+    {
+        follow_ = follow;
+        follow_timeout_ = timeout;
+    }
+
+    tuint32 FileInStream::block_size() const
+    {
+        return cached_.test() ? cached_.info().block_size : file_.block_size();
+    }
+
+    tint64 FileInStream::read_data(void *buffer,tuint32 count)
+    {
+        return cached_.test() ? cached_.read(buffer,count,read_) :
+                                file_.read(buffer,count);
+    }
+
+    /**
+     * Reads data, waiting for more data to be written when positioned at the
+     * end of the file.
+     */
+    tint64 FileInStream::read_follow(void *buffer,tuint32 count)
+    {
+        const tuint64 start = system::time();
+        while (true)
+        {
+            tint64 result = read_data(buffer,count);
+            if (result != 0 || eof_)
+                return result;
+
+            // All data written before the writer closed the file has been
+            // read.
+            if (closed_)
+            {
+                eof_ = true;
+                return 0;
+            }
+
+            tuint32 timeout = 0;
+            if (follow_timeout_ > 0)
+            {
+                tuint64 elapsed = system::time() - start;
+                if (elapsed >= follow_timeout_)
+                {
+                    eof_ = true;
+                    return 0;
+                }
+
+                timeout = follow_timeout_ - static_cast<tuint32>(elapsed);
+            }
+
+            switch (watch_.wait(timeout))
+            {
+                case FileWatch::ckEVENT_TIMEOUT:
+                    eof_ = true;
+                    return 0;
+
+                case FileWatch::ckEVENT_CLOSED:
+                    closed_ = true;
+                    break;
+
+                case FileWatch::ckEVENT_ERROR:
+                    return -1;
+
+                default:
+                    break;
+            }
+        }
     }
 
     tint64 FileInStream::read(void *buffer,tuint32 count)
     {
-        tint64 result = file_.read(buffer,count);
+        tint64 result = follow_ ? read_follow(buffer,count) :
+                                  read_data(buffer,count);
         if (result != -1)
+        {
             read_ += result;
+            if (read_ > size_)
+                size_ = read_;
+
+            if (policy_ == ckACCESS_DROP_BEHIND)
+                drop_behind(false);
+        }
 
         return result;
     }
@@ -129,8 +331,12 @@ namespace ckcore
         return size_;
     }
 
-    FileOutStream::FileOutStream(const Path &file_path) : file_(file_path)
+    FileOutStream::FileOutStream(const Path &file_path,bool unbuffered,
+                                 tuint64 expected_size)
+        : file_(file_path),expected_size_(expected_size),writeback_window_(0),
+          written_(0),submitted_(0),waited_(0)
     {
+        file_.set_unbuffered(unbuffered);
     }
 
     FileOutStream::~FileOutStream()
@@ -138,11 +344,24 @@ namespace ckcore
         close();
     }
 
+    void FileOutStream::set_options(const File::OpenOptions &options)
+    {
+        options_ = options;
+    }
+
     bool FileOutStream::open()
     {
       try
       {
-        file_.open2(File::ckOPEN_WRITE);
+        file_.open2(File::ckOPEN_WRITE,options_);
+
+        written_ = submitted_ = waited_ = 0;
+
+        // Failing to reserve space is not fatal, the file will simply grow
+        // as data is written.
+        if (expected_size_ > 0)
+            file_.reserve(expected_size_);
+
         return true;
       }
       catch ( ... )
@@ -153,11 +372,53 @@ namespace ckcore
 
     bool FileOutStream::close()
     {
+        // Start writing the remaining data but don't wait for it.
+        if (writeback_window_ > 0 && written_ > submitted_ && file_.test())
+            file_.writeback(submitted_,written_ - submitted_,false);
+
         return file_.close();
     }
 
+    void FileOutStream::set_writeback(tuint32 window_size)
+    {
+        writeback_window_ = window_size;
+    }
+
+    /**
+     * Starts writeback of each completed window and finishes the window
+     * before it, which should have been written by now.
+     */
+    void FileOutStream::writeback()
+    {
+        while (written_ - submitted_ >= writeback_window_)
+        {
+            file_.writeback(submitted_,writeback_window_,false);
+
+            if (waited_ < submitted_)
+            {
+                file_.writeback(waited_,writeback_window_,true);
+                file_.advise(File::ckADVICE_DONTNEED,waited_,writeback_window_);
+                waited_ += writeback_window_;
+            }
+
+            submitted_ += writeback_window_;
+        }
+    }
+
+    tuint32 FileOutStream::block_size() const
+    {
+        return file_.block_size();
+    }
+
     tint64 FileOutStream::write(const void *buffer,tuint32 count)
     {
-        return file_.write(buffer,count);
+        tint64 result = file_.write(buffer,count);
+        if (result > 0 && writeback_window_ > 0 && !file_.unbuffered())
+        {
+            written_ += result;
+            writeback();
+        }
+
+        return result;
     }
 }
@@ -0,0 +1,176 @@
+/*
+ * The ckCore library provides core software functionality.
+ * Copyright (C) 2006-2012 Christian Kindahl
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "ckcore/bufferpool.hh"
+#include "ckcore/memory.hh"
+
+namespace ckcore
+{
+    /**
+     * Allocations larger than this fraction of the block size are given
+     * blocks of their own to avoid wasting the rest of the current block.
+     */
+    static const size_t LARGE_ALLOCATION_DIVISOR = 4;
+
+    static size_t align_size(size_t size,size_t alignment)
+    {
+        return (size + alignment - 1) & ~(alignment - 1);
+    }
+
+    Arena::Arena(size_t block_size)
+        : blocks_(NULL),pos_(NULL),end_(NULL),block_size_(block_size),
+          used_(0),capacity_(0)
+    {
+        if (block_size_ == 0)
+            block_size_ = DEFAULT_BLOCK_SIZE;
+    }
+
+    Arena::~Arena()
+    {
+        reset();
+
+        std::map<thandle,Arena *>::iterator it;
+        for (it = locals_.begin(); it != locals_.end(); ++it)
+            delete it->second;
+    }
+
+    Arena::Block *Arena::allocate_block(size_t size)
+    {
+        size = BufferPool::instance().capacity(size);
+
+        Block *block = static_cast<Block *>(
+            BufferPool::instance().allocate(size,MemoryStats::ckTAG_ARENA));
+        if (block == NULL)
+            return NULL;
+
+        block->next = NULL;
+        block->size = size;
+
+        capacity_ += size;
+        return block;
+    }
+
+    void *Arena::allocate(size_t size,size_t alignment)
+    {
+        if (alignment == 0)
+            alignment = DEFAULT_ALIGNMENT;
+        if (size == 0)
+            size = 1;
+
+        // Blocks are page aligned, stricter alignments are not supported.
+        if (alignment > BufferPool::MIN_BUFFER_SIZE)
+            return NULL;
+
+        if (pos_ != NULL)
+        {
+            size_t offset = align_size(reinterpret_cast<size_t>(pos_),alignment) -
+                            reinterpret_cast<size_t>(pos_);
+            if (offset <= static_cast<size_t>(end_ - pos_) &&
+                size <= static_cast<size_t>(end_ - pos_) - offset)
+            {
+                unsigned char *ptr = pos_ + offset;
+                pos_ = ptr + size;
+                used_ += size;
+                return ptr;
+            }
+        }
+
+        const size_t header = align_size(sizeof(Block),alignment);
+
+        if (size > block_size_/LARGE_ALLOCATION_DIVISOR)
+        {
+            Block *block = allocate_block(header + size);
+            if (block == NULL)
+                return NULL;
+
+            // Keep allocating from the current block.
+            if (blocks_ != NULL)
+            {
+                block->next = blocks_->next;
+                blocks_->next = block;
+            }
+            else
+            {
+                blocks_ = block;
+            }
+
+            used_ += size;
+            return reinterpret_cast<unsigned char *>(block) + header;
+        }
+
+        Block *block = allocate_block(block_size_);
+        if (block == NULL)
+            return NULL;
+
+        block->next = blocks_;
+        blocks_ = block;
+
+        unsigned char *ptr = reinterpret_cast<unsigned char *>(block) + header;
+        pos_ = ptr + size;
+        end_ = reinterpret_cast<unsigned char *>(block) + block->size;
+        used_ += size;
+        return ptr;
+    }
+
+    void Arena::reset()
+    {
+        while (blocks_ != NULL)
+        {
+            Block *next = blocks_->next;
+            BufferPool::instance().release(blocks_,blocks_->size,MemoryStats::ckTAG_ARENA);
+            blocks_ = next;
+        }
+
+        pos_ = NULL;
+        end_ = NULL;
+        used_ = 0;
+        capacity_ = 0;
+
+        Locker<thread::Mutex> lock(mutex_);
+
+        std::map<thandle,Arena *>::iterator it;
+        for (it = locals_.begin(); it != locals_.end(); ++it)
+            it->second->reset();
+    }
+
+    Arena &Arena::local()
+    {
+        thandle id = thread::identifier();
+
+        Locker<thread::Mutex> lock(mutex_);
+
+        std::map<thandle,Arena *>::iterator it = locals_.find(id);
+        if (it != locals_.end())
+            return *it->second;
+
+        Arena *arena = new Arena(block_size_);
+        locals_[id] = arena;
+        return *arena;
+    }
+
+    size_t Arena::used() const
+    {
+        return used_;
+    }
+
+    size_t Arena::capacity() const
+    {
+        return capacity_;
+    }
+}
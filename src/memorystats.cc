@@ -0,0 +1,149 @@
+/*
+ * The ckCore library provides core software functionality.
+ * Copyright (C) 2006-2012 Christian Kindahl
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <string.h>
+#include "ckcore/bufferpool.hh"
+#include "ckcore/locker.hh"
+#include "ckcore/memorystats.hh"
+
+namespace ckcore
+{
+    static void count_allocation(MemoryStats::Counter &counter,size_t size)
+    {
+        counter.current += size;
+        counter.allocations++;
+        if (counter.current > counter.peak)
+            counter.peak = counter.current;
+    }
+
+    static void count_release(MemoryStats::Counter &counter,size_t size)
+    {
+        counter.current = counter.current > size ? counter.current - size : 0;
+    }
+
+    MemoryStats::MemoryStats()
+        : enabled_(false),counting_(false)
+    {
+        memset(tags_,0,sizeof(tags_));
+        memset(&total_,0,sizeof(total_));
+    }
+
+    MemoryStats &MemoryStats::instance()
+    {
+        static MemoryStats *instance = new MemoryStats();
+        return *instance;
+    }
+
+    const tchar *MemoryStats::name(Tag tag)
+    {
+        switch (tag)
+        {
+            case ckTAG_STREAM:
+                return ckT("stream");
+            case ckTAG_MEMORY_STREAM:
+                return ckT("memory stream");
+            case ckTAG_BUFFER:
+                return ckT("buffer");
+            case ckTAG_ARENA:
+                return ckT("arena");
+            case ckTAG_FILE:
+                return ckT("file");
+            case ckTAG_THREAD_POOL:
+                return ckT("thread pool");
+            case ckTAG_PROCESS:
+                return ckT("process");
+            case ckTAG_DIRECTORY:
+                return ckT("directory");
+            default:
+                return ckT("other");
+        }
+    }
+
+    void MemoryStats::set_enabled(bool enable)
+    {
+        Locker<thread::Mutex> lock(mutex_);
+        enabled_ = enable;
+    }
+
+    void MemoryStats::add(Tag tag,const void *key,size_t size)
+    {
+        if (tag < 0 || tag >= ckTAG_COUNT)
+            tag = ckTAG_OTHER;
+
+        Locker<thread::Mutex> lock(mutex_);
+        count_allocation(tags_[tag],size);
+        count_allocation(total_,size);
+
+        counted_[key] += size;
+        counting_ = true;
+    }
+
+    void MemoryStats::remove(Tag tag,const void *key,size_t size)
+    {
+        if (tag < 0 || tag >= ckTAG_COUNT)
+            tag = ckTAG_OTHER;
+
+        Locker<thread::Mutex> lock(mutex_);
+
+        // Memory allocated while accounting was disabled is not counted.
+        std::map<const void *,size_t>::iterator it = counted_.find(key);
+        if (it == counted_.end())
+            return;
+
+        if (size >= it->second)
+        {
+            size = it->second;
+            counted_.erase(it);
+            counting_ = !counted_.empty();
+        }
+        else
+        {
+            it->second -= size;
+        }
+
+        count_release(tags_[tag],size);
+        count_release(total_,size);
+    }
+
+    MemoryStats::Snapshot MemoryStats::snapshot()
+    {
+        Snapshot snapshot;
+        snapshot.pool_cached = BufferPool::instance().cached();
+
+        Locker<thread::Mutex> lock(mutex_);
+        for (int i = 0; i < ckTAG_COUNT; i++)
+            snapshot.tags[i] = tags_[i];
+        snapshot.total = total_;
+
+        return snapshot;
+    }
+
+    void MemoryStats::reset()
+    {
+        Locker<thread::Mutex> lock(mutex_);
+        for (int i = 0; i < ckTAG_COUNT; i++)
+        {
+            tags_[i].peak = tags_[i].current;
+            tags_[i].allocations = 0;
+        }
+
+        total_.peak = total_.current;
+        total_.allocations = 0;
+    }
+}
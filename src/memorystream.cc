@@ -18,6 +18,7 @@
 
 #include <string.h>
 #include "ckcore/assert.hh"
+#include "ckcore/bufferpool.hh"
 #include "ckcore/memorystream.hh"
 
 namespace ckcore
@@ -28,6 +29,11 @@ namespace ckcore
         ckASSERT(data);
     }
 
+    MemoryInStream::MemoryInStream(const SharedBuffer &buffer) :
+        buffer_(buffer),data_(buffer.data()),count_(buffer.size()),pos_(0)
+    {
+    }
+
     MemoryInStream::~MemoryInStream()
     {
     }
@@ -56,6 +62,15 @@ namespace ckcore
         return to_read;
     }
 
+    tint64 MemoryInStream::borrow(const unsigned char *&buffer,tuint32 count)
+    {
+        if (pos_ >= count_)
+            return 0;
+
+        buffer = data_ + pos_;
+        return count_ - pos_ < count ? count_ - pos_ : count;
+    }
+
     tint64 MemoryInStream::size()
     {
         return count_;
@@ -64,7 +79,9 @@ namespace ckcore
     MemoryOutStream::MemoryOutStream() : 
         buffer_(NULL),buffer_size_(1024),buffer_pos_(0)
     {
-        buffer_ = new unsigned char[buffer_size_];
+        buffer_size_ = static_cast<tuint32>(BufferPool::instance().capacity(buffer_size_));
+        buffer_ = static_cast<unsigned char *>(
+            BufferPool::instance().allocate(buffer_size_,MemoryStats::ckTAG_MEMORY_STREAM));
 
         // Make sure that the memory allocation succeeded.
         if (buffer_ == NULL)
@@ -77,7 +94,9 @@ namespace ckcore
         if (buffer_size_ == 0)
             buffer_size_ = 1024;
 
-        buffer_ = new unsigned char[buffer_size_];
+        buffer_size_ = static_cast<tuint32>(BufferPool::instance().capacity(buffer_size_));
+        buffer_ = static_cast<unsigned char *>(
+            BufferPool::instance().allocate(buffer_size_,MemoryStats::ckTAG_MEMORY_STREAM));
 
         // Make sure that the memory allocation succeeded.
         if (buffer_ == NULL)
@@ -89,7 +108,7 @@ namespace ckcore
         // Free the memory allocated for the internal buffer.
         if (buffer_ != NULL)
         {
-            delete [] buffer_;
+            BufferPool::instance().release(buffer_,buffer_size_,MemoryStats::ckTAG_MEMORY_STREAM);
             buffer_ = NULL;
         }
     }
@@ -103,12 +122,13 @@ namespace ckcore
         while (buffer_pos_ + count > buffer_size_)
         {
             tuint32 new_buffer_size = buffer_size_ * 2;
-            unsigned char *new_buffer = new unsigned char[new_buffer_size];
+            unsigned char *new_buffer = static_cast<unsigned char *>(
+                BufferPool::instance().allocate(new_buffer_size,MemoryStats::ckTAG_MEMORY_STREAM));
             if (new_buffer == NULL)
                 return -1;
 
-            memcpy(new_buffer,buffer_,buffer_size_);
-            delete [] buffer_;
+            memcpy(new_buffer,buffer_,buffer_pos_);
+            BufferPool::instance().release(buffer_,buffer_size_,MemoryStats::ckTAG_MEMORY_STREAM);
 
             buffer_ = new_buffer;
             buffer_size_ = new_buffer_size;
@@ -128,4 +148,169 @@ namespace ckcore
     {
         return buffer_pos_;
     }
+
+    SegmentedMemoryOutStream::SegmentedMemoryOutStream(tuint32 segment_size) :
+        segment_size_(segment_size),count_(0)
+    {
+        if (segment_size_ == 0)
+            segment_size_ = 256*1024;
+
+        // Use all of the memory that will be allocated anyway.
+        segment_size_ = static_cast<tuint32>(BufferPool::instance().capacity(segment_size_));
+    }
+
+    SegmentedMemoryOutStream::~SegmentedMemoryOutStream()
+    {
+        clear();
+    }
+
+    tint64 SegmentedMemoryOutStream::write(const void *buffer,tuint32 count)
+    {
+        const unsigned char *data = static_cast<const unsigned char *>(buffer);
+
+        tuint32 written = 0;
+        while (written < count)
+        {
+            tuint32 segment_pos = static_cast<tuint32>(count_ % segment_size_);
+            if (segment_pos == 0 && count_ == static_cast<tuint64>(segments_.size())*segment_size_)
+            {
+                unsigned char *segment = static_cast<unsigned char *>(
+                    BufferPool::instance().allocate(segment_size_,
+                                                    MemoryStats::ckTAG_MEMORY_STREAM));
+                if (segment == NULL)
+                    return -1;
+
+                segments_.push_back(segment);
+            }
+
+            tuint32 to_write = segment_size_ - segment_pos;
+            if (to_write > count - written)
+                to_write = count - written;
+
+            memcpy(segments_.back() + segment_pos,data + written,to_write);
+            written += to_write;
+            count_ += to_write;
+        }
+
+        return count;
+    }
+
+    bool SegmentedMemoryOutStream::write_to(OutStream &stream) const
+    {
+        for (size_t i = 0; i < segments_.size(); i++)
+        {
+            tuint32 count = segment_count(i);
+            if (stream.write(segments_[i],count) != count)
+                return false;
+        }
+
+        return true;
+    }
+
+    void SegmentedMemoryOutStream::clear()
+    {
+        for (size_t i = 0; i < segments_.size(); i++)
+            BufferPool::instance().release(segments_[i],segment_size_,
+                                           MemoryStats::ckTAG_MEMORY_STREAM);
+
+        segments_.clear();
+        count_ = 0;
+    }
+
+    tuint64 SegmentedMemoryOutStream::count() const
+    {
+        return count_;
+    }
+
+    size_t SegmentedMemoryOutStream::segments() const
+    {
+        return segments_.size();
+    }
+
+    const unsigned char *SegmentedMemoryOutStream::segment(size_t index) const
+    {
+        ckASSERT(index < segments_.size());
+        return segments_[index];
+    }
+
+    tuint32 SegmentedMemoryOutStream::segment_count(size_t index) const
+    {
+        ckASSERT(index < segments_.size());
+        if (index + 1 < segments_.size())
+            return segment_size_;
+
+        return static_cast<tuint32>(count_ - static_cast<tuint64>(index)*segment_size_);
+    }
+
+    SegmentedMemoryInStream::SegmentedMemoryInStream(SegmentedMemoryOutStream &stream) :
+        segment_size_(stream.segment_size_),count_(stream.count_),pos_(0)
+    {
+        segments_.swap(stream.segments_);
+        stream.count_ = 0;
+    }
+
+    SegmentedMemoryInStream::~SegmentedMemoryInStream()
+    {
+        for (size_t i = 0; i < segments_.size(); i++)
+            BufferPool::instance().release(segments_[i],segment_size_,
+                                           MemoryStats::ckTAG_MEMORY_STREAM);
+    }
+
+    bool SegmentedMemoryInStream::end()
+    {
+        return pos_ >= count_;
+    }
+
+    bool SegmentedMemoryInStream::seek(tuint32 distance,StreamWhence whence)
+    {
+        if (whence == ckSTREAM_BEGIN)
+            pos_ = 0;
+
+        pos_ += distance;
+        if (pos_ > count_)
+            pos_ = count_;
+
+        return true;
+    }
+
+    tint64 SegmentedMemoryInStream::read(void *buffer,tuint32 count)
+    {
+        unsigned char *data = static_cast<unsigned char *>(buffer);
+
+        tuint32 read = 0;
+        while (read < count)
+        {
+            const unsigned char *segment = NULL;
+            tint64 res = borrow(segment,count - read);
+            if (res == 0)
+                break;
+
+            memcpy(data + read,segment,static_cast<size_t>(res));
+            read += static_cast<tuint32>(res);
+            pos_ += res;
+        }
+
+        return read;
+    }
+
+    tint64 SegmentedMemoryInStream::borrow(const unsigned char *&buffer,tuint32 count)
+    {
+        if (pos_ >= count_)
+            return 0;
+
+        size_t index = static_cast<size_t>(pos_/segment_size_);
+        tuint32 segment_pos = static_cast<tuint32>(pos_ % segment_size_);
+
+        tuint64 available = segment_size_ - segment_pos;
+        if (available > count_ - pos_)
+            available = count_ - pos_;
+
+        buffer = segments_[index] + segment_pos;
+        return available < count ? available : count;
+    }
+
+    tint64 SegmentedMemoryInStream::size()
+    {
+        return count_;
+    }
 }
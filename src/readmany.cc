@@ -0,0 +1,641 @@
+/*
+ * The ckCore library provides core software functionality.
+ * Copyright (C) 2006-2012 Christian Kindahl
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#ifdef __NR_io_uring_setup
+#include <linux/io_uring.h>
+#endif
+#endif
+#include <string.h>
+#include <deque>
+#include "ckcore/bufferpool.hh"
+#include "ckcore/locker.hh"
+#include "ckcore/task.hh"
+#include "ckcore/thread.hh"
+#include "ckcore/threadpool.hh"
+#include "ckcore/file.hh"
+
+#if defined(__NR_io_uring_setup) && defined(IORING_FEAT_RW_CUR_POS) && \
+    defined(STATX_SIZE)
+#define ckHAVE_IO_URING
+#endif
+
+namespace ckcore
+{
+    /**
+     * Reads the contents of a file from the specified offset until size bytes
+     * are available in data or the end of the file is reached.
+     * @return The number of bytes available in data or -1 on error.
+     */
+    static tint64 read_rest(const Path &file_path,unsigned char *data,
+                            tint64 size,tint64 offset)
+    {
+        File file(file_path);
+        if (!file.open(File::ckOPEN_READ))
+            return -1;
+
+        if (offset > 0 && file.seek(offset,File::ckFILE_BEGIN) == -1)
+            return -1;
+
+        while (offset < size)
+        {
+            tint64 res = file.read(data + offset,size - offset);
+            if (res == -1)
+                return -1;
+            if (res == 0)
+                break;
+
+            offset += res;
+        }
+
+        return offset;
+    }
+
+    /**
+     * @brief Contents of a file read by read_many.
+     */
+    struct ReadResult
+    {
+        size_t index;
+        unsigned char *data;
+        tint64 size;        // Number of valid bytes in data, -1 on error.
+        tint64 capacity;    // Number of bytes allocated for data.
+    };
+
+    static void release_result(ReadResult &result)
+    {
+        if (result.data != NULL)
+            BufferPool::instance().release(result.data,static_cast<size_t>(result.capacity),
+                                           MemoryStats::ckTAG_FILE);
+
+        result.data = NULL;
+    }
+
+    /**
+     * @brief Queue of files read by the thread pool.
+     */
+    struct ReadQueue
+    {
+        thread::Mutex mutex;
+        thread::WaitCondition done;
+        std::deque<ReadResult> results;
+    };
+
+    /**
+     * @brief Task reading the complete contents of a file.
+     */
+    class ReadFileTask : public Task
+    {
+    private:
+        const Path &file_path_;
+        size_t index_;
+        ReadQueue &queue_;
+
+    public:
+        ReadFileTask(const Path &file_path,size_t index,ReadQueue &queue)
+            : file_path_(file_path),index_(index),queue_(queue)
+        {
+        }
+
+        void start()
+        {
+            ReadResult result = { index_,NULL,-1,0 };
+
+            File file(file_path_);
+            File::Info info;
+            if (file.open(File::ckOPEN_READ) && file.info(info))
+            {
+                result.size = 0;
+                if (info.size > 0)
+                {
+                    result.capacity = info.size;
+                    result.data = static_cast<unsigned char *>(
+                        BufferPool::instance().allocate(static_cast<size_t>(info.size),
+                                                        MemoryStats::ckTAG_FILE));
+                    if (result.data == NULL)
+                        result.size = -1;
+
+                    while (result.data != NULL && result.size < info.size)
+                    {
+                        tint64 res = file.read(result.data + result.size,
+                                               info.size - result.size);
+                        if (res <= 0)
+                        {
+                            if (res == -1)
+                                result.size = -1;
+                            break;
+                        }
+
+                        result.size += res;
+                    }
+                }
+            }
+
+            Locker<thread::Mutex> lock(queue_.mutex);
+            queue_.results.push_back(result);
+            queue_.done.signal_all();
+        }
+    };
+
+    /**
+     * Reads the files using the thread pool.
+     * @param [in] first The index of the first file to read.
+     */
+    static bool read_many_pool(const std::vector<Path> &file_paths,
+                               File::ReadCallback &callback,
+                               tuint32 queue_depth,size_t first = 0)
+    {
+        ReadQueue queue;
+
+        bool result = true;
+        size_t next = first;
+        size_t pending = 0;
+
+        while (pending > 0 || (next < file_paths.size() && result))
+        {
+            while (result && next < file_paths.size() && pending < queue_depth)
+            {
+                ThreadPool::instance().start(new ReadFileTask(file_paths[next],next,queue));
+                next++;
+                pending++;
+            }
+
+            ReadResult res;
+            {
+                Locker<thread::Mutex> lock(queue.mutex);
+                while (queue.results.empty())
+                    queue.done.wait(queue.mutex);
+
+                res = queue.results.front();
+                queue.results.pop_front();
+            }
+
+            pending--;
+
+            // Once cancelled, the remaining files are only waited for.
+            if (result && !callback.file_read(res.index,res.data,res.size))
+                result = false;
+
+            release_result(res);
+        }
+
+        return result;
+    }
+
+#ifdef ckHAVE_IO_URING
+    /**
+     * @brief Minimal io_uring interface.
+     */
+    class IoUring
+    {
+    private:
+        int ring_handle_;
+        unsigned char *sq_ring_;
+        size_t sq_ring_size_;
+        unsigned char *cq_ring_;
+        size_t cq_ring_size_;
+        struct io_uring_sqe *sqes_;
+        size_t sqes_size_;
+
+        unsigned int *sq_tail_;
+        unsigned int *sq_mask_;
+        unsigned int *sq_array_;
+        unsigned int *cq_head_;
+        unsigned int *cq_tail_;
+        unsigned int *cq_mask_;
+        struct io_uring_cqe *cqes_;
+
+        unsigned int to_submit_;
+
+        bool supports(unsigned int op_count,const unsigned char *ops)
+        {
+            size_t probe_size = sizeof(struct io_uring_probe) +
+                                256*sizeof(struct io_uring_probe_op);
+            unsigned char *buffer = new unsigned char[probe_size];
+            memset(buffer,0,probe_size);
+
+            struct io_uring_probe *probe = reinterpret_cast<struct io_uring_probe *>(buffer);
+            bool result = syscall(__NR_io_uring_register,ring_handle_,
+                                  IORING_REGISTER_PROBE,probe,256) == 0;
+            for (unsigned int i = 0; i < op_count && result; i++)
+            {
+                result = ops[i] <= probe->last_op &&
+                         (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+            }
+
+            delete [] buffer;
+            return result;
+        }
+
+    public:
+        IoUring() : ring_handle_(-1),sq_ring_(NULL),sq_ring_size_(0),
+            cq_ring_(NULL),cq_ring_size_(0),sqes_(NULL),sqes_size_(0),
+            to_submit_(0)
+        {
+        }
+
+        ~IoUring()
+        {
+            if (sqes_ != NULL)
+                munmap(sqes_,sqes_size_);
+            if (cq_ring_ != NULL && cq_ring_ != sq_ring_)
+                munmap(cq_ring_,cq_ring_size_);
+            if (sq_ring_ != NULL)
+                munmap(sq_ring_,sq_ring_size_);
+            if (ring_handle_ != -1)
+                close(ring_handle_);
+        }
+
+        /**
+         * Creates the ring. Fails if io_uring or any of the required
+         * operations is not supported by the kernel.
+         */
+        bool init(unsigned int entries)
+        {
+            struct io_uring_params params;
+            memset(&params,0,sizeof(params));
+
+            ring_handle_ = static_cast<int>(syscall(__NR_io_uring_setup,entries,&params));
+            if (ring_handle_ == -1)
+                return false;
+
+            const unsigned char ops[] =
+            {
+                IORING_OP_OPENAT,IORING_OP_STATX,IORING_OP_READ,IORING_OP_CLOSE
+            };
+            if (!supports(sizeof(ops),ops))
+                return false;
+
+            sq_ring_size_ = params.sq_off.array + params.sq_entries*sizeof(unsigned int);
+            cq_ring_size_ = params.cq_off.cqes + params.cq_entries*sizeof(struct io_uring_cqe);
+            if (params.features & IORING_FEAT_SINGLE_MMAP)
+            {
+                if (cq_ring_size_ > sq_ring_size_)
+                    sq_ring_size_ = cq_ring_size_;
+                cq_ring_size_ = sq_ring_size_;
+            }
+
+            void *ptr = mmap(NULL,sq_ring_size_,PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE,ring_handle_,IORING_OFF_SQ_RING);
+            if (ptr == MAP_FAILED)
+                return false;
+            sq_ring_ = static_cast<unsigned char *>(ptr);
+
+            if (params.features & IORING_FEAT_SINGLE_MMAP)
+            {
+                cq_ring_ = sq_ring_;
+            }
+            else
+            {
+                ptr = mmap(NULL,cq_ring_size_,PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE,ring_handle_,IORING_OFF_CQ_RING);
+                if (ptr == MAP_FAILED)
+                    return false;
+                cq_ring_ = static_cast<unsigned char *>(ptr);
+            }
+
+            sqes_size_ = params.sq_entries*sizeof(struct io_uring_sqe);
+            ptr = mmap(NULL,sqes_size_,PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE,ring_handle_,IORING_OFF_SQES);
+            if (ptr == MAP_FAILED)
+                return false;
+            sqes_ = static_cast<struct io_uring_sqe *>(ptr);
+
+            sq_tail_ = reinterpret_cast<unsigned int *>(sq_ring_ + params.sq_off.tail);
+            sq_mask_ = reinterpret_cast<unsigned int *>(sq_ring_ + params.sq_off.ring_mask);
+            sq_array_ = reinterpret_cast<unsigned int *>(sq_ring_ + params.sq_off.array);
+            cq_head_ = reinterpret_cast<unsigned int *>(cq_ring_ + params.cq_off.head);
+            cq_tail_ = reinterpret_cast<unsigned int *>(cq_ring_ + params.cq_off.tail);
+            cq_mask_ = reinterpret_cast<unsigned int *>(cq_ring_ + params.cq_off.ring_mask);
+            cqes_ = reinterpret_cast<struct io_uring_cqe *>(cq_ring_ + params.cq_off.cqes);
+            return true;
+        }
+
+        /**
+         * Returns a cleared submission queue entry. The caller must make sure
+         * that the queue is not overfilled.
+         */
+        struct io_uring_sqe *next_sqe(tuint64 user_data)
+        {
+            unsigned int tail = *sq_tail_ + to_submit_;
+            unsigned int index = tail & *sq_mask_;
+
+            struct io_uring_sqe *sqe = &sqes_[index];
+            memset(sqe,0,sizeof(*sqe));
+            sqe->user_data = user_data;
+
+            sq_array_[index] = index;
+            to_submit_++;
+            return sqe;
+        }
+
+        /**
+         * Submits all prepared entries and waits for at least one completion.
+         */
+        bool submit_and_wait()
+        {
+            __atomic_store_n(sq_tail_,*sq_tail_ + to_submit_,__ATOMIC_RELEASE);
+
+            while (true)
+            {
+                long res = syscall(__NR_io_uring_enter,ring_handle_,to_submit_,1,
+                                   IORING_ENTER_GETEVENTS,NULL,0);
+                if (res >= 0)
+                {
+                    to_submit_ -= static_cast<unsigned int>(res);
+                    if (to_submit_ == 0)
+                        return true;
+                }
+                else if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                {
+                    return false;
+                }
+            }
+        }
+
+        /**
+         * Returns the next completion entry or NULL if there is none.
+         */
+        struct io_uring_cqe *peek_cqe()
+        {
+            unsigned int head = *cq_head_;
+            if (head == __atomic_load_n(cq_tail_,__ATOMIC_ACQUIRE))
+                return NULL;
+
+            return &cqes_[head & *cq_mask_];
+        }
+
+        void pop_cqe()
+        {
+            __atomic_store_n(cq_head_,*cq_head_ + 1,__ATOMIC_RELEASE);
+        }
+    };
+
+    /**
+     * @brief State of a file being read through io_uring.
+     */
+    struct UringSlot
+    {
+        enum Op
+        {
+            OP_OPEN,
+            OP_STATX,
+            OP_READ,
+            OP_CLOSE,
+            NUM_OPS
+        };
+
+        bool busy;
+        int pending;        // Number of outstanding operations.
+        int file_handle;
+        int open_res;
+        int read_res;
+        bool close_done;
+        struct statx stx;
+        ReadResult result;
+    };
+
+    /**
+     * The largest number of bytes read by a single operation.
+     */
+    static const tuint32 MAX_URING_READ = 0x40000000;
+
+    /**
+     * Reads the files using io_uring. Each file is opened and queried
+     * concurrently, after which a read linked to a close is issued.
+     * @return If io_uring is not available -1 is returned, if cancelled by
+     *         the callback 0 is returned, otherwise 1 is returned.
+     */
+    static int read_many_uring(const std::vector<Path> &file_paths,
+                               File::ReadCallback &callback,
+                               tuint32 queue_depth)
+    {
+        // Each file has at most two operations in flight.
+        IoUring ring;
+        if (!ring.init(queue_depth*2))
+            return -1;
+
+        std::vector<UringSlot> slots(queue_depth);
+        for (size_t i = 0; i < slots.size(); i++)
+            slots[i].busy = false;
+
+        bool result = true;
+        size_t next = 0;
+        size_t active = 0;
+
+        while (active > 0 || (next < file_paths.size() && result))
+        {
+            // Start reading new files.
+            for (size_t i = 0; i < slots.size() && result &&
+                               next < file_paths.size(); i++)
+            {
+                UringSlot &slot = slots[i];
+                if (slot.busy)
+                    continue;
+
+                slot.busy = true;
+                slot.pending = 2;
+                slot.file_handle = -1;
+                slot.open_res = -1;
+                slot.read_res = -1;
+                slot.close_done = false;
+                ReadResult empty = { next,NULL,-1,0 };
+                slot.result = empty;
+
+                const char *path = file_paths[next].name().c_str();
+                tuint64 data = i*UringSlot::NUM_OPS;
+
+                struct io_uring_sqe *sqe = ring.next_sqe(data + UringSlot::OP_OPEN);
+                sqe->opcode = IORING_OP_OPENAT;
+                sqe->fd = AT_FDCWD;
+                sqe->addr = reinterpret_cast<tuint64>(path);
+                sqe->open_flags = O_RDONLY | O_CLOEXEC;
+
+                sqe = ring.next_sqe(data + UringSlot::OP_STATX);
+                sqe->opcode = IORING_OP_STATX;
+                sqe->fd = AT_FDCWD;
+                sqe->addr = reinterpret_cast<tuint64>(path);
+                sqe->len = STATX_SIZE;
+                sqe->off = reinterpret_cast<tuint64>(&slot.stx);
+
+                next++;
+                active++;
+            }
+
+            // If the ring fails the outstanding operations can not be waited
+            // for, so their buffers are leaked rather than freed while in use.
+            // The files in flight are reported as failed and the remaining
+            // files are read using the thread pool.
+            if (!ring.submit_and_wait())
+            {
+                for (size_t i = 0; i < slots.size(); i++)
+                {
+                    UringSlot &slot = slots[i];
+                    if (!slot.busy)
+                        continue;
+
+                    // Files with a read in flight are closed by the linked
+                    // close, if it ever runs.
+                    if (slot.file_handle != -1 && slot.result.data == NULL)
+                        close(slot.file_handle);
+
+                    if (result && !callback.file_read(slot.result.index,NULL,-1))
+                        result = false;
+                }
+
+                if (result && next < file_paths.size())
+                    result = read_many_pool(file_paths,callback,queue_depth,next);
+
+                return result ? 1 : 0;
+            }
+
+            struct io_uring_cqe *cqe;
+            while ((cqe = ring.peek_cqe()) != NULL)
+            {
+                UringSlot &slot = slots[static_cast<size_t>(cqe->user_data/UringSlot::NUM_OPS)];
+                int op = static_cast<int>(cqe->user_data % UringSlot::NUM_OPS);
+                int res = cqe->res;
+                ring.pop_cqe();
+
+                switch (op)
+                {
+                    case UringSlot::OP_OPEN:
+                        slot.open_res = res;
+                        if (res >= 0)
+                            slot.file_handle = res;
+                        break;
+
+                    case UringSlot::OP_STATX:
+                        if (res == 0)
+                            slot.result.size = 0;
+                        break;
+
+                    case UringSlot::OP_READ:
+                        slot.read_res = res;
+                        break;
+
+                    case UringSlot::OP_CLOSE:
+                        // The close is cancelled if the linked read failed.
+                        if (res == -ECANCELED)
+                            close(slot.file_handle);
+                        slot.close_done = true;
+                        break;
+                }
+
+                if (--slot.pending > 0)
+                    continue;
+
+                ReadResult &res_file = slot.result;
+                bool done = true;
+
+                if (!slot.close_done)
+                {
+                    // Open and statx have completed.
+                    tint64 size = static_cast<tint64>(slot.stx.stx_size);
+                    if (slot.open_res < 0 || res_file.size == -1)
+                    {
+                        res_file.size = -1;
+                        if (slot.file_handle != -1)
+                            close(slot.file_handle);
+                    }
+                    else if (size == 0)
+                    {
+                        close(slot.file_handle);
+                    }
+                    else
+                    {
+                        res_file.capacity = size;
+                        res_file.data = static_cast<unsigned char *>(
+                            BufferPool::instance().allocate(static_cast<size_t>(size),
+                                                            MemoryStats::ckTAG_FILE));
+                        if (res_file.data == NULL)
+                        {
+                            res_file.size = -1;
+                            close(slot.file_handle);
+                        }
+                        else
+                        {
+                            tuint64 data = (&slot - &slots[0])*UringSlot::NUM_OPS;
+
+                            struct io_uring_sqe *sqe = ring.next_sqe(data + UringSlot::OP_READ);
+                            sqe->opcode = IORING_OP_READ;
+                            sqe->flags = IOSQE_IO_LINK;
+                            sqe->fd = slot.file_handle;
+                            sqe->addr = reinterpret_cast<tuint64>(res_file.data);
+                            sqe->len = size < MAX_URING_READ ?
+                                       static_cast<tuint32>(size) : MAX_URING_READ;
+                            sqe->off = 0;
+
+                            sqe = ring.next_sqe(data + UringSlot::OP_CLOSE);
+                            sqe->opcode = IORING_OP_CLOSE;
+                            sqe->fd = slot.file_handle;
+
+                            slot.pending = 2;
+                            done = false;
+                        }
+                    }
+                }
+                else
+                {
+                    // Read and close have completed. Short reads are completed
+                    // synchronously, they are rare for regular files.
+                    if (slot.read_res < 0)
+                        res_file.size = -1;
+                    else if (slot.read_res < res_file.capacity)
+                        res_file.size = read_rest(file_paths[res_file.index],res_file.data,
+                                                  res_file.capacity,slot.read_res);
+                    else
+                        res_file.size = slot.read_res;
+                }
+
+                if (!done)
+                    continue;
+
+                if (result && !callback.file_read(res_file.index,res_file.data,res_file.size))
+                    result = false;
+
+                release_result(res_file);
+                slot.busy = false;
+                active--;
+            }
+        }
+
+        return result ? 1 : 0;
+    }
+#endif
+
+    bool File::read_many(const std::vector<Path> &file_paths,
+                         ReadCallback &callback,tuint32 queue_depth)
+    {
+        if (queue_depth == 0)
+            queue_depth = 1;
+
+#ifdef ckHAVE_IO_URING
+        int res = read_many_uring(file_paths,callback,queue_depth);
+        if (res != -1)
+            return res == 1;
+#endif
+        return read_many_pool(file_paths,callback,queue_depth);
+    }
+}
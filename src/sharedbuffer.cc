@@ -0,0 +1,179 @@
+/*
+ * The ckCore library provides core software functionality.
+ * Copyright (C) 2006-2012 Christian Kindahl
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <string.h>
+#ifdef _WINDOWS
+#include <windows.h>
+#endif
+#include "ckcore/bufferpool.hh"
+#include "ckcore/memorystream.hh"
+#include "ckcore/sharedbuffer.hh"
+
+namespace ckcore
+{
+    static void ref_inc(volatile long *refs)
+    {
+#ifdef _WINDOWS
+        InterlockedIncrement(refs);
+#else
+        __sync_add_and_fetch(refs,1);
+#endif
+    }
+
+    /**
+     * Decrements the reference count.
+     * @return true if the last reference was released.
+     */
+    static bool ref_dec(volatile long *refs)
+    {
+#ifdef _WINDOWS
+        return InterlockedDecrement(refs) == 0;
+#else
+        return __sync_sub_and_fetch(refs,1) == 0;
+#endif
+    }
+
+    SharedBuffer::Storage *SharedBuffer::create(unsigned char *data,size_t capacity)
+    {
+        Storage *storage = new Storage();
+        storage->refs = 1;
+        storage->data = data;
+        storage->capacity = capacity;
+        return storage;
+    }
+
+    SharedBuffer::SharedBuffer()
+        : storage_(NULL),data_(NULL),size_(0)
+    {
+    }
+
+    SharedBuffer::SharedBuffer(const void *data,tuint32 count)
+        : storage_(NULL),data_(NULL),size_(0)
+    {
+        if (count == 0)
+            return;
+
+        size_t capacity = BufferPool::instance().capacity(count);
+        unsigned char *buffer = static_cast<unsigned char *>(
+            BufferPool::instance().allocate(capacity,MemoryStats::ckTAG_MEMORY_STREAM));
+        if (buffer == NULL)
+            return;
+
+        memcpy(buffer,data,count);
+
+        storage_ = create(buffer,capacity);
+        data_ = buffer;
+        size_ = count;
+    }
+
+    SharedBuffer::SharedBuffer(MemoryOutStream &stream)
+        : storage_(NULL),data_(NULL),size_(0)
+    {
+        if (stream.buffer_ == NULL || stream.buffer_pos_ == 0)
+            return;
+
+        storage_ = create(stream.buffer_,stream.buffer_size_);
+        data_ = stream.buffer_;
+        size_ = stream.buffer_pos_;
+
+        // Give the stream a new buffer of the default size.
+        stream.buffer_size_ = static_cast<tuint32>(BufferPool::instance().capacity(1024));
+        stream.buffer_ = static_cast<unsigned char *>(
+            BufferPool::instance().allocate(stream.buffer_size_,MemoryStats::ckTAG_MEMORY_STREAM));
+        stream.buffer_pos_ = 0;
+
+        if (stream.buffer_ == NULL)
+            stream.buffer_size_ = 0;
+    }
+
+    SharedBuffer::SharedBuffer(const SharedBuffer &rhs)
+        : storage_(rhs.storage_),data_(rhs.data_),size_(rhs.size_)
+    {
+        if (storage_ != NULL)
+            ref_inc(&storage_->refs);
+    }
+
+    SharedBuffer::~SharedBuffer()
+    {
+        reset();
+    }
+
+    SharedBuffer &SharedBuffer::operator=(const SharedBuffer &rhs)
+    {
+        if (this == &rhs)
+            return *this;
+
+        // Increment first in case both buffers reference the same storage.
+        if (rhs.storage_ != NULL)
+            ref_inc(&rhs.storage_->refs);
+
+        reset();
+
+        storage_ = rhs.storage_;
+        data_ = rhs.data_;
+        size_ = rhs.size_;
+        return *this;
+    }
+
+    void SharedBuffer::reset()
+    {
+        if (storage_ != NULL && ref_dec(&storage_->refs))
+        {
+            BufferPool::instance().release(storage_->data,storage_->capacity,
+                                           MemoryStats::ckTAG_MEMORY_STREAM);
+            delete storage_;
+        }
+
+        storage_ = NULL;
+        data_ = NULL;
+        size_ = 0;
+    }
+
+    SharedBuffer SharedBuffer::slice(tuint32 offset,tuint32 count) const
+    {
+        if (offset > size_)
+            offset = size_;
+        if (count > size_ - offset)
+            count = size_ - offset;
+
+        SharedBuffer buffer;
+        if (count == 0)
+            return buffer;
+
+        buffer = *this;
+        buffer.data_ = data_ + offset;
+        buffer.size_ = count;
+        return buffer;
+    }
+
+    const unsigned char *SharedBuffer::data() const
+    {
+        return data_;
+    }
+
+    tuint32 SharedBuffer::size() const
+    {
+        return size_;
+    }
+
+    bool SharedBuffer::empty() const
+    {
+        return size_ == 0;
+    }
+}
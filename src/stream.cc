@@ -17,6 +17,7 @@
  */
 
 #include <string.h>
+#include "ckcore/bufferpool.hh"
 #include "ckcore/system.hh"
 #include "ckcore/stream.hh"
 
@@ -24,6 +25,29 @@ namespace ckcore
 {
     namespace stream
     {
+        /**
+         * Reads up to count bytes from a stream. If the stream supports
+         * borrowing, data will point directly to the stream data, otherwise
+         * the data is read into buffer.
+         * @return The number of bytes available in data or -1 on error.
+         */
+        static tint64 read_block(InStream &from,unsigned char *buffer,
+                                 tuint32 count,const unsigned char *&data)
+        {
+            tint64 res = from.borrow(data,count);
+            if (res != -1)
+            {
+                if (res > 0 && !from.seek(static_cast<tuint32>(res),
+                                          InStream::ckSTREAM_CURRENT))
+                    return -1;
+
+                return res;
+            }
+
+            data = buffer;
+            return from.read(buffer,count);
+        }
+
         bool copy(InStream &from,OutStream &to)
         {
             // UPDATE: Hangs the application on some systems.
@@ -32,29 +56,31 @@ namespace ckcore
             if (buffer_size == 0)
                 buffer_size = 8192;*/
 
-            unsigned char *buffer = new unsigned char[buffer_size];
+            unsigned char *buffer = static_cast<unsigned char *>(
+                BufferPool::instance().allocate(buffer_size,MemoryStats::ckTAG_STREAM));
             if (buffer == NULL)
                 return false;
 
             tint64 res = 0;
             while (!from.end())
             {
-                res = from.read(buffer,buffer_size);
+                const unsigned char *data = NULL;
+                res = read_block(from,buffer,buffer_size,data);
                 if (res == -1)
                 {
-                    delete [] buffer;
+                    BufferPool::instance().release(buffer,buffer_size,MemoryStats::ckTAG_STREAM);
                     return false;
                 }
 
-                res = to.write(buffer,(tuint32)res);
+                res = to.write(data,(tuint32)res);
                 if (res == -1)
                 {
-                    delete [] buffer;
+                    BufferPool::instance().release(buffer,buffer_size,MemoryStats::ckTAG_STREAM);
                     return false;
                 }
             }
 
-            delete [] buffer;
+            BufferPool::instance().release(buffer,buffer_size,MemoryStats::ckTAG_STREAM);
             return true;
         }
 
@@ -66,7 +92,8 @@ namespace ckcore
             if (buffer_size == 0)
                 buffer_size = 8192;*/
 
-            unsigned char *buffer = new unsigned char[buffer_size];
+            unsigned char *buffer = static_cast<unsigned char *>(
+                BufferPool::instance().allocate(buffer_size,MemoryStats::ckTAG_STREAM));
             if (buffer == NULL)
                 return false;
 
@@ -79,19 +106,23 @@ namespace ckcore
             {
                 // Check if we should cancel.
                 if (progress.cancelled())
+                {
+                    BufferPool::instance().release(buffer,buffer_size,MemoryStats::ckTAG_STREAM);
                     return false;
+                }
 
-                res = from.read(buffer,buffer_size);
+                const unsigned char *data = NULL;
+                res = read_block(from,buffer,buffer_size,data);
                 if (res == -1)
                 {
-                    delete [] buffer;
+                    BufferPool::instance().release(buffer,buffer_size,MemoryStats::ckTAG_STREAM);
                     return false;
                 }
 
-                res = to.write(buffer,(tuint32)res);
+                res = to.write(data,(tuint32)res);
                 if (res == -1)
                 {
-                    delete [] buffer;
+                    BufferPool::instance().release(buffer,buffer_size,MemoryStats::ckTAG_STREAM);
                     return false;
                 }
 
@@ -107,7 +138,7 @@ namespace ckcore
             if (total != -1)
                 progress.set_progress(100);
 
-            delete [] buffer;
+            BufferPool::instance().release(buffer,buffer_size,MemoryStats::ckTAG_STREAM);
             return true;
         }
 
@@ -119,7 +150,8 @@ namespace ckcore
             if (buffer_size == 0)
                 buffer_size = 8192;*/
 
-            unsigned char *buffer = new unsigned char[buffer_size];
+            unsigned char *buffer = static_cast<unsigned char *>(
+                BufferPool::instance().allocate(buffer_size,MemoryStats::ckTAG_STREAM));
             if (buffer == NULL)
                 return false;
 
@@ -128,19 +160,23 @@ namespace ckcore
             {
                 // Check if we should cancel.
                 if (progresser.cancelled())
+                {
+                    BufferPool::instance().release(buffer,buffer_size,MemoryStats::ckTAG_STREAM);
                     return false;
+                }
 
-                res = from.read(buffer,buffer_size);
+                const unsigned char *data = NULL;
+                res = read_block(from,buffer,buffer_size,data);
                 if (res == -1)
                 {
-                    delete [] buffer;
+                    BufferPool::instance().release(buffer,buffer_size,MemoryStats::ckTAG_STREAM);
                     return false;
                 }
 
-                res = to.write(buffer,(tuint32)res);
+                res = to.write(data,(tuint32)res);
                 if (res == -1)
                 {
-                    delete [] buffer;
+                    BufferPool::instance().release(buffer,buffer_size,MemoryStats::ckTAG_STREAM);
                     return false;
                 }
 
@@ -148,7 +184,7 @@ namespace ckcore
                 progresser.update(res);
             }
 
-            delete [] buffer;
+            BufferPool::instance().release(buffer,buffer_size,MemoryStats::ckTAG_STREAM);
             return true;
         }
 
@@ -161,7 +197,8 @@ namespace ckcore
             if (buffer_size == 0)
                 buffer_size = 8192;*/
 
-            unsigned char *buffer = new unsigned char[buffer_size];
+            unsigned char *buffer = static_cast<unsigned char *>(
+                BufferPool::instance().allocate(buffer_size,MemoryStats::ckTAG_STREAM));
             if (buffer == NULL)
                 return false;
 
@@ -170,21 +207,25 @@ namespace ckcore
             {
                 // Check if we should cancel.
                 if (progresser.cancelled())
+                {
+                    BufferPool::instance().release(buffer,buffer_size,MemoryStats::ckTAG_STREAM);
                     return false;
+                }
 
                 tuint32 to_read = size < buffer_size ?
                                   static_cast<tuint32>(size) : buffer_size;
-                res = from.read(buffer,to_read);
+                const unsigned char *data = NULL;
+                res = read_block(from,buffer,to_read,data);
                 if (res == -1)
                 {
-                    delete [] buffer;
+                    BufferPool::instance().release(buffer,buffer_size,MemoryStats::ckTAG_STREAM);
                     return false;
                 }
 
-                res = to.write(buffer,static_cast<tuint32>(res));
+                res = to.write(data,static_cast<tuint32>(res));
                 if (res == -1)
                 {
-                    delete [] buffer;
+                    BufferPool::instance().release(buffer,buffer_size,MemoryStats::ckTAG_STREAM);
                     return false;
                 }
 
@@ -205,7 +246,7 @@ namespace ckcore
                 res = to.write(buffer,to_write);
                 if (res == -1)
                 {
-                    delete [] buffer;
+                    BufferPool::instance().release(buffer,buffer_size,MemoryStats::ckTAG_STREAM);
                     return false;
                 }
 
@@ -215,7 +256,7 @@ namespace ckcore
                 progresser.update(res);
             }
 
-            delete [] buffer;
+            BufferPool::instance().release(buffer,buffer_size,MemoryStats::ckTAG_STREAM);
             return true;
         }
     }
@@ -241,12 +241,12 @@ namespace ckcore
         {
             // Make a copy of the threads so that we can wait for all threads
             // in parallel.
-            std::vector<InternalThread *> all_threads = all_threads_;
+            ThreadVector all_threads = all_threads_;
             all_threads_.clear();
 
             ckVERIFY(lock.unlock());
 
-            std::vector<InternalThread *>::iterator it_thread;
+            ThreadVector::iterator it_thread;
             for (it_thread = all_threads.begin(); it_thread != all_threads.end(); it_thread++)
             {
                 InternalThread *thread = *it_thread;
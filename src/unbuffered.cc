@@ -0,0 +1,221 @@
+/*
+ * The ckCore library provides core software functionality.
+ * Copyright (C) 2006-2012 Christian Kindahl
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "ckcore/bufferpool.hh"
+#include "ckcore/file.hh"
+
+namespace ckcore
+{
+    /**
+     * The alignment of offsets, sizes and memory addresses required for
+     * unbuffered I/O. This covers the sector size of all common devices.
+     */
+    static const tuint32 DIRECT_ALIGNMENT = 4096;
+
+    /**
+     * The size of the buffer used for unaligned unbuffered transfers.
+     */
+    static const tuint32 BOUNCE_BUFFER_SIZE = 256*1024;
+
+    static inline bool is_aligned(tuint64 value)
+    {
+        return (value & (DIRECT_ALIGNMENT - 1)) == 0;
+    }
+
+    static inline tuint64 align_down(tuint64 value)
+    {
+        return value & ~static_cast<tuint64>(DIRECT_ALIGNMENT - 1);
+    }
+
+    static inline tuint64 align_up(tuint64 value)
+    {
+        return align_down(value + DIRECT_ALIGNMENT - 1);
+    }
+
+    /*
+     * The functions below implement the platform independent part of
+     * unbuffered I/O. Requests that are not aligned are performed on whole
+     * blocks through a bounce buffer, after which the file pointer is moved to
+     * where a buffered request would have left it.
+     */
+
+    tint64 File::read_unbuffered(void *buffer,tint64 count)
+    {
+        const tint64 pos = tell();
+        if (pos == -1)
+            return -1;
+
+        if (is_aligned(pos) && is_aligned(count) &&
+            is_aligned(reinterpret_cast<size_t>(buffer)))
+        {
+            return read_raw(buffer,count);
+        }
+
+        unsigned char *bounce = static_cast<unsigned char *>(
+            BufferPool::instance().allocate(BOUNCE_BUFFER_SIZE,MemoryStats::ckTAG_STREAM));
+        if (bounce == NULL)
+            return -1;
+
+        unsigned char *out = static_cast<unsigned char *>(buffer);
+
+        tint64 block = align_down(pos);
+        tint64 skip = pos - block;
+        tint64 done = 0;
+        bool result = true;
+
+        while (done < count)
+        {
+            tint64 want = align_up(skip + count - done);
+            if (want > BOUNCE_BUFFER_SIZE)
+                want = BOUNCE_BUFFER_SIZE;
+
+            if (seek(block,ckFILE_BEGIN) == -1)
+            {
+                result = false;
+                break;
+            }
+
+            tint64 res = read_raw(bounce,want);
+            if (res == -1)
+            {
+                result = false;
+                break;
+            }
+
+            // Check if the end of the file was reached.
+            if (res <= skip)
+                break;
+
+            tint64 avail = res - skip < count - done ? res - skip : count - done;
+            memcpy(out + done,bounce + skip,static_cast<size_t>(avail));
+            done += avail;
+
+            if (res < want)
+                break;
+
+            block += want;
+            skip = 0;
+        }
+
+        BufferPool::instance().release(bounce,BOUNCE_BUFFER_SIZE,MemoryStats::ckTAG_STREAM);
+
+        if (seek(pos + (result ? done : 0),ckFILE_BEGIN) == -1)
+            return -1;
+
+        return result ? done : -1;
+    }
+
+    /**
+     * Fills an aligned block with existing file data so that it can be
+     * partially overwritten. Data beyond the end of the file is cleared.
+     */
+    bool File::fill_block(unsigned char *block,tint64 offset,tint64 file_size)
+    {
+        tint64 res = 0;
+        if (offset < file_size)
+        {
+            if (seek(offset,ckFILE_BEGIN) == -1)
+                return false;
+
+            res = read_raw(block,DIRECT_ALIGNMENT);
+            if (res == -1)
+                return false;
+        }
+
+        memset(block + res,0,static_cast<size_t>(DIRECT_ALIGNMENT - res));
+        return true;
+    }
+
+    tint64 File::write_unbuffered(const void *buffer,tint64 count)
+    {
+        const tint64 pos = tell();
+        if (pos == -1)
+            return -1;
+
+        if (is_aligned(pos) && is_aligned(count) &&
+            is_aligned(reinterpret_cast<size_t>(buffer)))
+        {
+            return write_raw(buffer,count);
+        }
+
+        const tint64 file_size = size();
+        if (file_size == -1)
+            return -1;
+
+        unsigned char *bounce = static_cast<unsigned char *>(
+            BufferPool::instance().allocate(BOUNCE_BUFFER_SIZE,MemoryStats::ckTAG_STREAM));
+        if (bounce == NULL)
+            return -1;
+
+        const unsigned char *in = static_cast<const unsigned char *>(buffer);
+
+        tint64 block = align_down(pos);
+        tint64 skip = pos - block;
+        tint64 done = 0;
+        tint64 written_end = 0;
+        bool result = true;
+
+        while (done < count && result)
+        {
+            tint64 data = count - done < BOUNCE_BUFFER_SIZE - skip ?
+                          count - done : BOUNCE_BUFFER_SIZE - skip;
+            tint64 want = align_up(skip + data);
+
+            // Preserve the existing data in partially overwritten blocks.
+            if (skip > 0)
+                result = fill_block(bounce,block,file_size);
+
+            tint64 last = want - DIRECT_ALIGNMENT;
+            if (result && !is_aligned(skip + data) && (skip == 0 || last > 0))
+                result = fill_block(bounce + last,block + last,file_size);
+
+            if (!result)
+                break;
+
+            memcpy(bounce + skip,in + done,static_cast<size_t>(data));
+
+            written_end = block + want;
+            if (seek(block,ckFILE_BEGIN) == -1 || write_raw(bounce,want) != want)
+            {
+                result = false;
+                break;
+            }
+
+            done += data;
+            block += want;
+            skip = 0;
+        }
+
+        BufferPool::instance().release(bounce,BOUNCE_BUFFER_SIZE,MemoryStats::ckTAG_STREAM);
+
+        // Remove the padding written beyond the end of the file or the data,
+        // whichever is larger.
+        if (written_end > file_size)
+        {
+            tint64 new_size = pos + done > file_size ? pos + done : file_size;
+            if (new_size != written_end)
+                result = truncate_raw(new_size) && result;
+        }
+
+        if (seek(pos + done,ckFILE_BEGIN) == -1)
+            return -1;
+
+        return result ? done : -1;
+    }
+}
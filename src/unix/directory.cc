@@ -101,6 +101,14 @@ namespace ckcore
         return !(*this == it);
     }
 
+    bool Directory::Iterator::info(File::Info &info) const
+    {
+        if (cur_ent_ == NULL)
+            return false;
+
+        return File::info(dirfd(dir_handle_),cur_ent_->d_name,info);
+    }
+
     Directory::Directory(const Path &dir_path) : dir_path_(dir_path)
     {
     }
@@ -109,7 +117,7 @@ namespace ckcore
     {
         // Since the Directory object owns the iterator handles, we need to
         // free them.
-        std::map<Iterator *,DIR *>::iterator it;
+        HandleMap::iterator it;
         for (it = dir_handles_.begin(); it != dir_handles_.end(); it++)
             closedir(it->second);
 
@@ -188,6 +196,17 @@ namespace ckcore
         return (file_stat.st_mode & S_IFDIR) > 0;
     }
 
+    bool Directory::sync(const Path &dir_path)
+    {
+        int dir_handle = ::open(dir_path.name().c_str(),O_RDONLY);
+        if (dir_handle == -1)
+            return false;
+
+        bool result = fsync(dir_handle) == 0;
+        ::close(dir_handle);
+        return result;
+    }
+
     bool Directory::time(const Path &dir_path,struct tm &access_time,
                          struct tm &modify_time,struct tm &create_time)
     {
@@ -25,16 +25,276 @@
 #include <string.h>
 #include <limits.h>
 #include <sys/stat.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#endif
+#include "ckcore/bufferpool.hh"
 #include "ckcore/convert.hh"
 #include "ckcore/file.hh"
 
 namespace ckcore
 {
-    File::File(const Path &file_path) : file_handle_(-1),file_path_(file_path)
+    static inline tint64 to_ns(tint64 sec,tint64 nsec)
     {
+        return sec*1000000000 + nsec;
     }
 
-    void File::open2(FileMode file_mode) throw(std::exception)
+    /**
+     * Obtains file meta data using statx if available, otherwise stat. If
+     * path is NULL, dir_handle refers to the file itself.
+     */
+    static bool stat_info(int dir_handle,const char *path,int flags,
+                          File::Info &info)
+    {
+#ifdef STATX_BASIC_STATS
+        struct statx stx;
+        int res = path != NULL ?
+            statx(dir_handle,path,flags | AT_STATX_SYNC_AS_STAT,
+                  STATX_BASIC_STATS | STATX_BTIME,&stx) :
+            statx(dir_handle,"",flags | AT_EMPTY_PATH | AT_STATX_SYNC_AS_STAT,
+                  STATX_BASIC_STATS | STATX_BTIME,&stx);
+        if (res == 0)
+        {
+            info.size = stx.stx_size;
+            info.block_size = stx.stx_blksize;
+            info.blocks = stx.stx_blocks;
+            info.mode = stx.stx_mode;
+            info.inode = stx.stx_ino;
+            info.device = (static_cast<tuint64>(stx.stx_dev_major) << 32) |
+                          stx.stx_dev_minor;
+            info.access_time = to_ns(stx.stx_atime.tv_sec,stx.stx_atime.tv_nsec);
+            info.modify_time = to_ns(stx.stx_mtime.tv_sec,stx.stx_mtime.tv_nsec);
+            info.change_time = to_ns(stx.stx_ctime.tv_sec,stx.stx_ctime.tv_nsec);
+            info.create_time = (stx.stx_mask & STATX_BTIME) ?
+                to_ns(stx.stx_btime.tv_sec,stx.stx_btime.tv_nsec) :
+                info.change_time;
+            return true;
+        }
+
+        // The kernel may be too old to support statx.
+        if (errno != ENOSYS)
+            return false;
+#endif
+
+        struct stat file_stat;
+        if ((path != NULL ? fstatat(dir_handle,path,&file_stat,flags) :
+                            fstat(dir_handle,&file_stat)) != 0)
+        {
+            return false;
+        }
+
+        info.size = file_stat.st_size;
+        info.block_size = static_cast<tuint32>(file_stat.st_blksize);
+        info.blocks = file_stat.st_blocks;
+        info.mode = file_stat.st_mode;
+        info.inode = file_stat.st_ino;
+        info.device = file_stat.st_dev;
+#ifdef __APPLE__
+        info.access_time = to_ns(file_stat.st_atimespec.tv_sec,file_stat.st_atimespec.tv_nsec);
+        info.modify_time = to_ns(file_stat.st_mtimespec.tv_sec,file_stat.st_mtimespec.tv_nsec);
+        info.change_time = to_ns(file_stat.st_ctimespec.tv_sec,file_stat.st_ctimespec.tv_nsec);
+        info.create_time = to_ns(file_stat.st_birthtimespec.tv_sec,file_stat.st_birthtimespec.tv_nsec);
+#else
+        info.access_time = to_ns(file_stat.st_atim.tv_sec,file_stat.st_atim.tv_nsec);
+        info.modify_time = to_ns(file_stat.st_mtim.tv_sec,file_stat.st_mtim.tv_nsec);
+        info.change_time = to_ns(file_stat.st_ctim.tv_sec,file_stat.st_ctim.tv_nsec);
+        info.create_time = info.change_time;
+#endif
+        return true;
+    }
+
+    /**
+     * The maximum number of bytes copied between progress updates.
+     */
+    static const tint64 COPY_CHUNK_SIZE = 8*1024*1024;
+
+    /**
+     * The size of the buffer used for copying through user space.
+     */
+    static const tuint32 COPY_BUFFER_SIZE = 1024*1024;
+
+    /**
+     * Copies a range of data between two files through user space.
+     */
+    static bool copy_buffered(int src_handle,int dst_handle,tint64 offset,
+                              tint64 count,Progresser &progresser)
+    {
+        unsigned char *buffer = static_cast<unsigned char *>(
+            BufferPool::instance().allocate(COPY_BUFFER_SIZE,MemoryStats::ckTAG_FILE));
+
+        bool result = true;
+        while (count > 0)
+        {
+            if (progresser.cancelled())
+            {
+                result = false;
+                break;
+            }
+
+            size_t to_read = count < COPY_BUFFER_SIZE ?
+                             static_cast<size_t>(count) : COPY_BUFFER_SIZE;
+            ssize_t res = pread(src_handle,buffer,to_read,offset);
+            if (res == -1 && errno == EINTR)
+                continue;
+
+            if (res <= 0)
+            {
+                result = false;
+                break;
+            }
+
+            ssize_t written = 0;
+            while (written < res)
+            {
+                ssize_t wres = pwrite(dst_handle,buffer + written,res - written,
+                                      offset + written);
+                if (wres == -1 && errno == EINTR)
+                    continue;
+
+                if (wres <= 0)
+                    break;
+
+                written += wres;
+            }
+
+            if (written < res)
+            {
+                result = false;
+                break;
+            }
+
+            offset += res;
+            count -= res;
+            progresser.update(res);
+        }
+
+        BufferPool::instance().release(buffer,COPY_BUFFER_SIZE,MemoryStats::ckTAG_FILE);
+        return result;
+    }
+
+    /**
+     * Copies a range of data between two files, inside the kernel if
+     * possible.
+     */
+    static bool copy_range(int src_handle,int dst_handle,tint64 offset,
+                           tint64 count,Progresser &progresser)
+    {
+#ifdef SYS_copy_file_range
+        while (count > 0)
+        {
+            if (progresser.cancelled())
+                return false;
+
+            loff_t src_offset = offset,dst_offset = offset;
+            size_t to_copy = count < COPY_CHUNK_SIZE ?
+                             static_cast<size_t>(count) : COPY_CHUNK_SIZE;
+            long res = syscall(SYS_copy_file_range,src_handle,&src_offset,
+                               dst_handle,&dst_offset,to_copy,0);
+            if (res == -1 && errno == EINTR)
+                continue;
+
+            // Not supported by the kernel or file systems, copy the rest
+            // through user space.
+            if (res <= 0)
+                break;
+
+            offset += res;
+            count -= res;
+            progresser.update(res);
+        }
+
+        if (count == 0)
+            return true;
+#endif
+        return copy_buffered(src_handle,dst_handle,offset,count,progresser);
+    }
+
+    /**
+     * Opens a file descriptor according to the open options. Options that
+     * are not supported by the system or file system are ignored.
+     * @param [out] anonymous Set to true if an anonymous file was created.
+     * @return The file descriptor or -1 on error, in which case errno is set.
+     */
+    static int open_handle(const tstring &name,int flags,
+                           const File::OpenOptions &options,bool &anonymous)
+    {
+        anonymous = false;
+
+#ifdef O_CLOEXEC
+        if (options.close_on_exec)
+            flags |= O_CLOEXEC;
+#endif
+
+        int handle = -1;
+        if (options.temporary)
+        {
+            flags &= ~(O_CREAT | O_EXCL | O_TRUNC);
+#ifdef O_TMPFILE
+            handle = ::open(name.c_str(),flags | O_TMPFILE,S_IRUSR | S_IWUSR);
+            if (handle == -1 && errno != EOPNOTSUPP && errno != EISDIR &&
+                errno != EINVAL)
+            {
+                return -1;
+            }
+
+            anonymous = handle != -1;
+#endif
+            // Fall back to creating a uniquely named file which is unlinked
+            // immediately.
+            if (handle == -1)
+            {
+                tstring templ = name + "/.ckcoreXXXXXX";
+                handle = mkstemp(&templ[0]);
+                if (handle == -1)
+                    return -1;
+
+                unlink(templ.c_str());
+#ifdef O_DIRECT
+                // mkstemp does not take any flags, O_DIRECT must be applied
+                // afterwards. Fail like open does if it is not supported.
+                if ((flags & O_DIRECT) &&
+                    fcntl(handle,F_SETFL,fcntl(handle,F_GETFL) | O_DIRECT) == -1)
+                {
+                    ::close(handle);
+                    errno = EINVAL;
+                    return -1;
+                }
+#endif
+#ifndef O_CLOEXEC
+                if (options.close_on_exec)
+                    fcntl(handle,F_SETFD,FD_CLOEXEC);
+#endif
+            }
+        }
+        else
+        {
+#ifdef O_NOATIME
+            // O_NOATIME is only permitted for the owner of the file.
+            if (options.no_atime)
+            {
+                handle = ::open(name.c_str(),flags | O_NOATIME,S_IRUSR | S_IWUSR);
+                if (handle != -1 || errno != EPERM)
+                    return handle;
+            }
+#endif
+            handle = ::open(name.c_str(),flags,S_IRUSR | S_IWUSR);
+        }
+
+#ifndef O_CLOEXEC
+        if (handle != -1 && options.close_on_exec)
+            fcntl(handle,F_SETFD,FD_CLOEXEC);
+#endif
+        return handle;
+    }
+
+    File::File(const Path &file_path) : file_handle_(-1),file_path_(file_path),
+        unbuffered_(false),direct_(false),anonymous_(false)
+    {
+    }
+
+    void File::open2(FileMode file_mode,const OpenOptions &options) throw(std::exception)
     {
         try
         {
@@ -44,35 +304,95 @@ namespace ckcore
                 throw Exception2(ckT("Cannot close previously open file handle."));
 
             // Open the file handle.
+            int flags = 0;
             switch (file_mode)
             {
             case ckOPEN_READ:
-                file_handle_ = ::open(file_path_.name().c_str(),O_RDONLY);
+                flags = O_RDONLY;
                 break;
 
             case ckOPEN_WRITE:
-                file_handle_ = ::open(file_path_.name().c_str(),O_CREAT | O_WRONLY,S_IRUSR | S_IWUSR);
+                flags = O_CREAT | O_WRONLY;
                 break;
 
             case ckOPEN_READWRITE:
-                file_handle_ = ::open(file_path_.name().c_str(),O_RDWR,S_IRUSR | S_IWUSR);
+                flags = O_RDWR;
                 break;
 
             default:
                 assert( false );
             }
 
+            // Temporary files must be writable.
+            if (options.temporary && file_mode == ckOPEN_READ)
+                flags = O_RDWR;
+
+            if (options.create)
+                flags |= O_CREAT;
+            if (options.exclusive)
+                flags |= O_CREAT | O_EXCL;
+            if (options.truncate && file_mode != ckOPEN_READ)
+                flags |= O_TRUNC;
+
+            direct_ = false;
+#ifdef O_DIRECT
+            if (unbuffered_)
+            {
+                // Partially written blocks must be read back, so the file is
+                // always opened for reading as well.
+                int direct_flags = flags == O_RDONLY ? flags : (flags & ~O_WRONLY) | O_RDWR;
+                file_handle_ = open_handle(file_path_.name(),direct_flags | O_DIRECT,options,
+                                           anonymous_);
+
+                // Fall back to buffered I/O if the file system does not support
+                // unbuffered I/O.
+                if (file_handle_ != -1)
+                    direct_ = true;
+                else if (errno != EINVAL)
+                    throw_from_errno( errno, NULL );
+            }
+#endif
+
+            if (file_handle_ == -1)
+                file_handle_ = open_handle(file_path_.name(),flags,options,anonymous_);
+
             if (file_handle_ == -1)
                 throw_from_errno( errno, NULL );
 
+#if !defined(O_DIRECT) && defined(F_NOCACHE)
+            // Mac OS X does not support O_DIRECT but caching can be disabled on
+            // the open file, without any alignment requirements.
+            if (unbuffered_)
+                fcntl(file_handle_,F_NOCACHE,1);
+#endif
+
+            // Anonymous files cannot be accessed by anyone else.
+            if (options.lock == ckLOCK_NONE || options.temporary)
+                return;
+
             // Set lock.
             struct flock file_lock;
+            memset(&file_lock,0,sizeof(file_lock));
             file_lock.l_start = 0;
             file_lock.l_len = 0;
             file_lock.l_type = file_mode == ckOPEN_READ ? F_RDLCK : F_WRLCK;
             file_lock.l_whence = SEEK_SET;
 
-            if (fcntl(file_handle_,F_SETLK,&file_lock) == -1)
+            int res = -1;
+#ifdef F_OFD_SETLK
+            if (options.lock == ckLOCK_OFD)
+            {
+                res = fcntl(file_handle_,F_OFD_SETLK,&file_lock);
+                if (res == -1 && errno == EINVAL)
+                    res = fcntl(file_handle_,F_SETLK,&file_lock);
+            }
+            else
+#endif
+            {
+                res = fcntl(file_handle_,F_SETLK,&file_lock);
+            }
+
+            if (res == -1)
             {
                 const int saved_errno = errno; // close() can overwrite errno.
                 if (saved_errno == EACCES || saved_errno == EAGAIN)
@@ -98,6 +418,8 @@ namespace ckcore
         if (::close(file_handle_) == 0)
         {
             file_handle_ = -1;
+            direct_ = false;
+            anonymous_ = false;
             return true;
         }
 
@@ -113,7 +435,7 @@ namespace ckcore
     {
         check_file_is_open();
 
-        int ret = -1;
+        off_t ret = -1;
 
         switch (whence)
         {
@@ -145,20 +467,54 @@ namespace ckcore
 
         // Obtain the current file pointer position by seeking 0 bytes from the
         // current position.
-        const int ret = lseek(file_handle_,0,SEEK_CUR);
+        const off_t ret = lseek(file_handle_,0,SEEK_CUR);
 
-        if ( ret == 1 )
+        if ( ret == -1 )
           throw_from_errno( errno, ckT("Cannot get the current file pointer: ") );
 
         return ret;
     }
 
+    tint64 File::read_raw(void *buffer,tint64 count)
+    {
+        return ::read(file_handle_,buffer,count);
+    }
+
+    tint64 File::write_raw(const void *buffer,tint64 count)
+    {
+        return ::write(file_handle_,buffer,count);
+    }
+
+    bool File::truncate_raw(tint64 size)
+    {
+        return ftruncate(file_handle_,size) == 0;
+    }
+
+    tint64 File::read_at(void *buffer,tint64 count,tint64 offset) const
+    {
+        if (file_handle_ == -1)
+            return -1;
+
+        return pread(file_handle_,buffer,count,offset);
+    }
+
+    tint64 File::write_at(const void *buffer,tint64 count,tint64 offset)
+    {
+        if (file_handle_ == -1)
+            return -1;
+
+        return pwrite(file_handle_,buffer,count,offset);
+    }
+
     tint64 File::read(void *buffer,tint64 count)
     {
         if (file_handle_ == -1)
             return -1;
 
-        return ::read(file_handle_,buffer,count);
+        if (direct_)
+            return read_unbuffered(buffer,count);
+
+        return read_raw(buffer,count);
     }
 
     tint64 File::write(const void *buffer,tint64 count)
@@ -166,7 +522,187 @@ namespace ckcore
         if (file_handle_ == -1)
             return -1;
 
-        return ::write(file_handle_,buffer,count);
+        if (direct_)
+            return write_unbuffered(buffer,count);
+
+        return write_raw(buffer,count);
+    }
+
+    bool File::advise(FileAdvice advice,tint64 offset,tint64 count)
+    {
+        if (file_handle_ == -1)
+            return false;
+
+#ifdef POSIX_FADV_NORMAL
+        int posix_advice = POSIX_FADV_NORMAL;
+        switch (advice)
+        {
+            case ckADVICE_SEQUENTIAL:
+                posix_advice = POSIX_FADV_SEQUENTIAL;
+                break;
+
+            case ckADVICE_RANDOM:
+                posix_advice = POSIX_FADV_RANDOM;
+                break;
+
+            case ckADVICE_WILLNEED:
+                posix_advice = POSIX_FADV_WILLNEED;
+                break;
+
+            case ckADVICE_DONTNEED:
+                posix_advice = POSIX_FADV_DONTNEED;
+                break;
+
+            default:
+                break;
+        }
+
+        // posix_fadvise returns the error code instead of setting errno.
+        return posix_fadvise(file_handle_,offset,count,posix_advice) == 0;
+#else
+        // Not supported, the advice is only a hint.
+        ckUNUSED(advice);
+        ckUNUSED(offset);
+        ckUNUSED(count);
+        return true;
+#endif
+    }
+
+    bool File::prefetch(tint64 offset,tint64 count)
+    {
+        if (file_handle_ == -1)
+            return false;
+
+#ifdef __linux__
+        if (count == 0)
+        {
+            struct stat file_stat;
+            if (fstat(file_handle_,&file_stat) != 0)
+                return false;
+
+            count = file_stat.st_size > offset ? file_stat.st_size - offset : 0;
+        }
+
+        return readahead(file_handle_,offset,static_cast<size_t>(count)) == 0;
+#else
+        return advise(ckADVICE_WILLNEED,offset,count);
+#endif
+    }
+
+    tuint32 File::block_size() const
+    {
+        struct stat file_stat;
+        if (file_handle_ != -1)
+        {
+            if (fstat(file_handle_,&file_stat) != 0)
+                return 0;
+        }
+        else if (stat(file_path_.name().c_str(),&file_stat) != 0 &&
+                 stat(file_path_.dir_name().c_str(),&file_stat) != 0)
+        {
+            return 0;
+        }
+
+        return static_cast<tuint32>(file_stat.st_blksize);
+    }
+
+    bool File::sync(bool data_only)
+    {
+        if (file_handle_ == -1)
+            return false;
+
+#if defined(_POSIX_SYNCHRONIZED_IO) && _POSIX_SYNCHRONIZED_IO > 0
+        if (data_only)
+            return fdatasync(file_handle_) == 0;
+#else
+        ckUNUSED(data_only);
+#endif
+        return fsync(file_handle_) == 0;
+    }
+
+    bool File::writeback(tint64 offset,tint64 count,bool wait)
+    {
+        if (file_handle_ == -1)
+            return false;
+
+#ifdef SYNC_FILE_RANGE_WRITE
+        unsigned int flags = SYNC_FILE_RANGE_WRITE;
+        if (wait)
+            flags |= SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WAIT_AFTER;
+
+        return sync_file_range(file_handle_,offset,count,flags) == 0;
+#else
+        ckUNUSED(offset);
+        ckUNUSED(count);
+        ckUNUSED(wait);
+        return false;
+#endif
+    }
+
+    bool File::link(const Path &new_file_path)
+    {
+        if (file_handle_ == -1 || !anonymous_)
+            return false;
+
+#ifdef O_TMPFILE
+        // Linking the file descriptor directly using AT_EMPTY_PATH requires
+        // special privileges, linking through /proc does not.
+        char proc_path[64];
+        sprintf(proc_path,"/proc/self/fd/%d",file_handle_);
+        if (linkat(AT_FDCWD,proc_path,AT_FDCWD,new_file_path.name().c_str(),
+                   AT_SYMLINK_FOLLOW) != 0)
+        {
+            return false;
+        }
+
+        file_path_ = new_file_path;
+        anonymous_ = false;
+        return true;
+#else
+        ckUNUSED(new_file_path);
+        return false;
+#endif
+    }
+
+    bool File::reserve(tuint64 size)
+    {
+        if (file_handle_ == -1)
+            return false;
+
+        if (size == 0)
+            return true;
+
+#if defined(FALLOC_FL_KEEP_SIZE)
+        // Allocate the blocks but keep the file size so that the file does
+        // not contain any garbage if fewer bytes end up being written.
+        if (fallocate(file_handle_,FALLOC_FL_KEEP_SIZE,0,
+                      static_cast<off_t>(size)) == 0)
+            return true;
+
+        // Not all file systems support preallocation.
+        return errno == EOPNOTSUPP || errno == ENOSYS;
+#elif defined(F_PREALLOCATE)
+        fstore_t store;
+        memset(&store,0,sizeof(store));
+        store.fst_flags = F_ALLOCATECONTIG;
+        store.fst_posmode = F_PEOFPOSMODE;
+        store.fst_offset = 0;
+        store.fst_length = static_cast<off_t>(size);
+
+        // Fall back to a fragmented allocation if no contiguous space exist.
+        if (fcntl(file_handle_,F_PREALLOCATE,&store) == -1)
+        {
+            store.fst_flags = F_ALLOCATEALL;
+            if (fcntl(file_handle_,F_PREALLOCATE,&store) == -1)
+                return errno == ENOTSUP;
+        }
+
+        return true;
+#else
+        // Not supported, posix_fallocate can not be used since it changes the
+        // file size.
+        return true;
+#endif
     }
 
     bool File::exist() const
@@ -226,6 +762,14 @@ namespace ckcore
         return false;
     }
 
+    bool File::info(Info &info) const
+    {
+        if (file_handle_ != -1)
+            return stat_info(file_handle_,NULL,0,info);
+
+        return File::info(file_path_,info);
+    }
+
     bool File::time(struct tm &access_time,struct tm &modify_time,
                     struct tm &create_time) const
     {
@@ -258,22 +802,14 @@ namespace ckcore
         if ( !test() )
             return size2(file_path_);
 
-        try
+        Info file_info;
+        if (!stat_info(file_handle_,NULL,0,file_info))
         {
-            tint64 cur_pos = tell2();
-            
-            tint64 size = seek2(0,ckFILE_END);
-
-            seek2(cur_pos,ckFILE_BEGIN);
-
-            return size;
-        }
-        catch ( const std::exception & e )
-        {
-            rethrow_with_pfx( e,
-                              ckT("Error querying size of file \"%s\": "),
+            throw_from_errno( errno, ckT("Error querying size of file \"%s\": "),
                               file_path_.name().c_str() );
         }
+
+        return file_info.size;
     }
 
     bool File::exist(const Path &file_path)
@@ -299,6 +835,28 @@ namespace ckcore
                         new_file_path.name().c_str()) == 0;
     }
 
+    bool File::replace(const Path &old_file_path,const Path &new_file_path)
+    {
+        return ::rename(old_file_path.name().c_str(),
+                        new_file_path.name().c_str()) == 0;
+    }
+
+    bool File::sync_all(const Path &file_path)
+    {
+#ifdef SYS_syncfs
+        int handle = ::open(file_path.name().c_str(),O_RDONLY);
+        if (handle == -1)
+            return false;
+
+        bool result = syscall(SYS_syncfs,handle) == 0;
+        ::close(handle);
+        return result;
+#else
+        ckUNUSED(file_path);
+        return false;
+#endif
+    }
+
     bool File::time(const Path &file_path,struct tm &access_time,
                     struct tm &modify_time,struct tm &create_time)
     {
@@ -345,6 +903,103 @@ namespace ckcore
         return base_name[0] == '.';
     }
 
+    bool File::info(const Path &file_path,Info &info)
+    {
+        return stat_info(AT_FDCWD,file_path.name().c_str(),0,info);
+    }
+
+    bool File::info(int dir_handle,const char *file_name,Info &info)
+    {
+        return stat_info(dir_handle,file_name,AT_SYMLINK_NOFOLLOW,info);
+    }
+
+    bool File::copy(const Path &src_file_path,const Path &dst_file_path,
+                    Progresser &progresser)
+    {
+        int src_handle = ::open(src_file_path.name().c_str(),O_RDONLY);
+        if (src_handle == -1)
+            return false;
+
+        struct stat src_stat;
+        if (fstat(src_handle,&src_stat) != 0)
+        {
+            ::close(src_handle);
+            return false;
+        }
+
+        // The destination is not truncated until it is known to be a
+        // different file than the source.
+        int dst_handle = ::open(dst_file_path.name().c_str(),O_WRONLY | O_CREAT,
+                                src_stat.st_mode & (S_IRWXU | S_IRWXG | S_IRWXO));
+        if (dst_handle == -1)
+        {
+            ::close(src_handle);
+            return false;
+        }
+
+        struct stat dst_stat;
+        if (fstat(dst_handle,&dst_stat) != 0 ||
+            (dst_stat.st_dev == src_stat.st_dev && dst_stat.st_ino == src_stat.st_ino) ||
+            ftruncate(dst_handle,0) != 0)
+        {
+            ::close(src_handle);
+            ::close(dst_handle);
+            return false;
+        }
+
+        const tint64 size = src_stat.st_size;
+        bool result = true;
+
+#ifdef FICLONE
+        // Try to share the data between the files.
+        if (ioctl(dst_handle,FICLONE,src_handle) == 0)
+        {
+            progresser.update(size);
+            ::close(src_handle);
+            return ::close(dst_handle) == 0;
+        }
+#endif
+
+        // Copy the data segments, skipping the holes in between.
+        tint64 pos = 0;
+        while (pos < size && result)
+        {
+            tint64 data = pos,hole = size;
+#ifdef SEEK_DATA
+            data = lseek(src_handle,pos,SEEK_DATA);
+            if (data == -1)
+            {
+                // ENXIO means there is no more data, other errors mean that
+                // the file system can not report holes.
+                data = errno == ENXIO ? size : pos;
+            }
+            else
+            {
+                hole = lseek(src_handle,data,SEEK_HOLE);
+                if (hole == -1 || hole > size)
+                    hole = size;
+            }
+#endif
+            if (data > pos)
+                progresser.update(data - pos);
+
+            if (hole > data)
+                result = copy_range(src_handle,dst_handle,data,hole - data,progresser);
+
+            pos = hole;
+        }
+
+        // Extend the file to cover any trailing hole.
+        if (result && ftruncate(dst_handle,size) != 0)
+            result = false;
+
+        ::close(src_handle);
+        if (::close(dst_handle) != 0)
+            result = false;
+
+        return result;
+    }
+
     tint64 File::size2(const Path &file_path) throw(std::exception)
     {
         struct stat file_stat;
@@ -0,0 +1,167 @@
+/*
+ * The ckCore library provides core software functionality.
+ * Copyright (C) 2006-2012 Christian Kindahl
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include "ckcore/filewatch.hh"
+
+namespace ckcore
+{
+#ifndef __linux__
+    /**
+     * The number of milliseconds between checking the file size on systems
+     * without file change notifications.
+     */
+    static const tuint32 POLL_INTERVAL = 50;
+#endif
+
+    FileWatch::FileWatch(const Path &file_path) :
+        file_path_(file_path),handle_(-1),pipe_(false),size_(0)
+    {
+    }
+
+    FileWatch::~FileWatch()
+    {
+        close();
+    }
+
+    bool FileWatch::open()
+    {
+        close();
+
+        struct stat file_stat;
+        if (stat(file_path_.name().c_str(),&file_stat) != 0)
+            return false;
+
+        pipe_ = S_ISFIFO(file_stat.st_mode);
+        size_ = file_stat.st_size;
+
+#ifdef __linux__
+        handle_ = inotify_init();
+        if (handle_ == -1)
+            return false;
+
+        fcntl(handle_,F_SETFD,FD_CLOEXEC);
+
+        if (inotify_add_watch(handle_,file_path_.name().c_str(),
+                              IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE_SELF) == -1)
+        {
+            close();
+            return false;
+        }
+#else
+        // Keep the file open so that the size can be checked even if the file
+        // is renamed.
+        handle_ = ::open(file_path_.name().c_str(),O_RDONLY | O_NONBLOCK);
+        if (handle_ == -1)
+            return false;
+#endif
+        return true;
+    }
+
+    bool FileWatch::close()
+    {
+        if (handle_ == -1)
+            return false;
+
+        ::close(handle_);
+        handle_ = -1;
+        return true;
+    }
+
+    bool FileWatch::test() const
+    {
+        return handle_ != -1;
+    }
+
+    FileWatch::Event FileWatch::wait(tuint32 timeout)
+    {
+        if (handle_ == -1)
+            return ckEVENT_ERROR;
+
+        if (pipe_)
+            return ckEVENT_CLOSED;
+
+#ifdef __linux__
+        struct pollfd poll_fd;
+        poll_fd.fd = handle_;
+        poll_fd.events = POLLIN;
+        poll_fd.revents = 0;
+
+        int res;
+        do
+        {
+            res = poll(&poll_fd,1,timeout == 0 ? -1 : static_cast<int>(timeout));
+        }
+        while (res == -1 && errno == EINTR);
+
+        if (res == -1)
+            return ckEVENT_ERROR;
+        if (res == 0)
+            return ckEVENT_TIMEOUT;
+
+        // Consume all pending events.
+        union
+        {
+            struct inotify_event event;
+            char data[4096];
+        } buffer;
+
+        ssize_t len = read(handle_,&buffer,sizeof(buffer));
+        if (len <= 0)
+            return ckEVENT_ERROR;
+
+        Event result = ckEVENT_MODIFIED;
+        for (ssize_t pos = 0; pos < len;)
+        {
+            const struct inotify_event *event =
+                reinterpret_cast<const struct inotify_event *>(buffer.data + pos);
+            if (event->mask & (IN_CLOSE_WRITE | IN_DELETE_SELF))
+                result = ckEVENT_CLOSED;
+
+            pos += sizeof(struct inotify_event) + event->len;
+        }
+
+        return result;
+#else
+        for (tuint32 waited = 0; timeout == 0 || waited < timeout;
+             waited += POLL_INTERVAL)
+        {
+            struct stat file_stat;
+            if (fstat(handle_,&file_stat) != 0)
+                return ckEVENT_ERROR;
+
+            if (file_stat.st_size != size_)
+            {
+                size_ = file_stat.st_size;
+                return ckEVENT_MODIFIED;
+            }
+
+            usleep(POLL_INTERVAL*1000);
+        }
+
+        return ckEVENT_TIMEOUT;
+#endif
+    }
+}
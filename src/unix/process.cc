@@ -23,24 +23,69 @@
 #include <signal.h>
 #include <string.h>
 #include <stdlib.h>
-#include <map>
+#include <sched.h>
 #include "ckcore/file.hh"
+#include "ckcore/memorystats.hh"
 #include "ckcore/string.hh"
 #include "ckcore/process.hh"
 
 namespace ckcore
 {
+    /**
+     * Reports a change of the capacity of a block buffer to MemoryStats.
+     * @param [in] buffer The block buffer.
+     * @param [in,out] counted The capacity reported so far.
+     */
+    static void count_block_buffer(const std::string &buffer,size_t &counted)
+    {
+        size_t capacity = buffer.capacity();
+        if (capacity > counted)
+            MemoryStats::instance().allocated(MemoryStats::ckTAG_PROCESS,&buffer,capacity - counted);
+        else if (capacity < counted)
+            MemoryStats::instance().released(MemoryStats::ckTAG_PROCESS,&buffer,counted - capacity);
+
+        counted = capacity;
+    }
+
     /**
      * Singleton class for monitoring child processes.
+     *
+     * Processes are tracked in a fixed array of slots since the slots are
+     * used from the signal handler where containers can not be modified.
+     * A slot is reaped by at most one party at a time, either the signal
+     * handler or the thread listening on the process.
      */
     class ProcessMonitor
     {
     private:
+        enum
+        {
+            MAX_PROCESSES = 64
+        };
+
+        enum SlotState
+        {
+            SLOT_FREE,
+            SLOT_CLAIMED,
+            SLOT_RUNNING,
+            SLOT_REAPING,
+            SLOT_EXITED
+        };
+
+        struct Slot
+        {
+            volatile int state;
+            volatile pid_t pid;
+            volatile int status;
+        };
+
         void (*old_sigchld_handler_)(int);
-        std::map<pid_t,Process *> pid_map_;
+        Slot slots_[MAX_PROCESSES];
 
         ProcessMonitor() : old_sigchld_handler_(NULL)
         {
+            memset(slots_,0,sizeof(slots_));
+
             // Assign a action handler for the SIGCHLD signal.
             struct sigaction new_action,old_action;
             memset(&new_action,0,sizeof(new_action));
@@ -77,28 +122,62 @@ namespace ckcore
         ProcessMonitor(const ProcessMonitor &rhs);
         ProcessMonitor &operator=(const ProcessMonitor &rhs);
 
+        /**
+         * Tries to reap the process of a slot in the reaping state. If the
+         * process has not exited the slot is returned to the running state.
+         * @param [in] slot The slot to reap.
+         */
+        static void reap(Slot &slot)
+        {
+            // The process may already have been reaped elsewhere, for
+            // example if SIGCHLD is ignored.
+            int status = 0;
+            pid_t pid = waitpid(slot.pid,&status,WNOHANG);
+            if (pid == slot.pid || (pid == -1 && errno == ECHILD))
+            {
+                slot.status = status;
+                __sync_synchronize();
+                slot.state = SLOT_EXITED;
+            }
+            else
+            {
+                slot.state = SLOT_RUNNING;
+            }
+        }
+
         static void sigchld_handler(int signum)
         {
-            // Obtain process identifier.
-            int status;
-            pid_t pid = wait(&status);
+            // Only async-signal-safe functions may be used here.
+            int saved_errno = errno;
 
-            // Change process status to stopped.
-            if (ProcessMonitor::instance().pid_map_.count(pid) > 0)
+            ProcessMonitor &monitor = ProcessMonitor::instance();
+            for (int i = 0; i < MAX_PROCESSES; i++)
             {
-                Process *process = ProcessMonitor::instance().pid_map_[pid];
-                process->state_ = Process::STATE_STOPPED;
-
-                if (WIFEXITED(status))
-                    process->exit_code_ = WEXITSTATUS(status);
+                Slot &slot = monitor.slots_[i];
+                if (__sync_bool_compare_and_swap(&slot.state,SLOT_RUNNING,SLOT_REAPING))
+                    reap(slot);
             }
 
+            errno = saved_errno;
+
             // Call the old SIGCHLD signal handler.
-            void (*old_sigchld_handler)(int) = ProcessMonitor::instance().old_sigchld_handler_;
+            void (*old_sigchld_handler)(int) = monitor.old_sigchld_handler_;
             if (old_sigchld_handler != NULL && old_sigchld_handler != SIG_IGN)
                 old_sigchld_handler(signum);
         }
 
+        Slot *find(pid_t pid)
+        {
+            for (int i = 0; i < MAX_PROCESSES; i++)
+            {
+                int state = slots_[i].state;
+                if (state != SLOT_FREE && state != SLOT_CLAIMED && slots_[i].pid == pid)
+                    return &slots_[i];
+            }
+
+            return NULL;
+        }
+
     public:
         /**
          * Returns the process monitor instance.
@@ -111,18 +190,77 @@ namespace ckcore
         }
 
         /**
-         * Registers a new process in the process monitor.
+         * Registers a new process in the process monitor. If all slots are in
+         * use the process is only detected as exited when polled.
          * @param [in] pid The process identifier of the process to monitor.
          */
-        void register_process(pid_t pid,Process *process)
+        void register_process(pid_t pid)
+        {
+            for (int i = 0; i < MAX_PROCESSES; i++)
+            {
+                Slot &slot = slots_[i];
+                if (__sync_bool_compare_and_swap(&slot.state,SLOT_FREE,SLOT_CLAIMED))
+                {
+                    slot.pid = pid;
+                    slot.status = 0;
+                    __sync_synchronize();
+                    slot.state = SLOT_RUNNING;
+                    return;
+                }
+            }
+        }
+
+        /**
+         * Checks if a registered process has exited. Once this function has
+         * returned true the process is no longer monitored.
+         * @param [in] pid The process identifier.
+         * @param [out] status The wait status of the process.
+         * @return If the process has exited true is returned, otherwise false
+         *         is returned.
+         */
+        bool exited(pid_t pid,int &status)
+        {
+            Slot *slot = find(pid);
+            if (slot == NULL)
+            {
+                status = 0;
+                pid_t res = waitpid(pid,&status,WNOHANG);
+                return res == pid || (res == -1 && errno == ECHILD);
+            }
+
+            // The process may have exited before it was registered, in which
+            // case the signal has already been handled without reaping it.
+            if (__sync_bool_compare_and_swap(&slot->state,SLOT_RUNNING,SLOT_REAPING))
+                reap(*slot);
+
+            if (slot->state != SLOT_EXITED)
+                return false;
+
+            status = slot->status;
+            slot->state = SLOT_FREE;
+            return true;
+        }
+
+        /**
+         * Stops monitoring a process without waiting for it to exit.
+         * @param [in] pid The process identifier.
+         */
+        void unregister_process(pid_t pid)
         {
-            pid_map_[pid] = process;
+            Slot *slot = find(pid);
+            if (slot == NULL)
+                return;
+
+            // Wait for the signal handler if it is reaping the process.
+            while (!__sync_bool_compare_and_swap(&slot->state,SLOT_RUNNING,SLOT_FREE) &&
+                   !__sync_bool_compare_and_swap(&slot->state,SLOT_EXITED,SLOT_FREE))
+                sched_yield();
         }
     };
 
     Process::Process() : invalid_inheritor_(false),
         pid_(-1),state_(STATE_STOPPED),exit_code_(0),
-        started_event_(false)
+        block_counted_out_(0),block_counted_err_(0),started_event_(false)
     {
         pipe_stdin_[0] = pipe_stdin_[1] = -1;
         pipe_stdout_[0] = pipe_stdout_[1] = -1;
@@ -153,6 +291,11 @@ namespace ckcore
 
         pthread_mutex_destroy(&started_mutex_);
         pthread_cond_destroy(&started_cond_);
+
+        MemoryStats::instance().released(MemoryStats::ckTAG_PROCESS,
+                                         &block_buffer_out_,block_counted_out_);
+        MemoryStats::instance().released(MemoryStats::ckTAG_PROCESS,
+                                         &block_buffer_err_,block_counted_err_);
     }
 
     void Process::close()
@@ -184,11 +327,6 @@ namespace ckcore
             }
         }
 
-        // Reset stop event.
-        pthread_mutex_lock(&started_mutex_);
-        started_event_ = false;
-        pthread_mutex_unlock(&started_mutex_);
-
         // Reset state.
         pid_ = -1;
         state_ = STATE_STOPPED;
@@ -241,6 +379,7 @@ namespace ckcore
             }
         }
 
+        count_block_buffer(block_buffer_out_,block_counted_out_);
         return true;
     }
 
@@ -288,6 +427,7 @@ namespace ckcore
             }
         }
 
+        count_block_buffer(block_buffer_err_,block_counted_err_);
         return true;
     }
 
@@ -301,6 +441,9 @@ namespace ckcore
         process->block_buffer_out_.resize(0);
         process->block_buffer_err_.resize(0);
 
+        const pid_t pid = process->pid_;
+        bool exited = false;
+
         // We can now signal that the process has started.
         pthread_mutex_lock(&process->started_mutex_);
         process->started_event_ = true;
@@ -348,8 +491,22 @@ namespace ckcore
                     break;
                 }
             }
+
+            // Check if the process has exited.
+            int status;
+            if (ProcessMonitor::instance().exited(pid,status))
+            {
+                if (WIFEXITED(status))
+                    process->exit_code_ = WEXITSTATUS(status);
+
+                exited = true;
+                break;
+            }
         }
 
+        if (!exited)
+            ProcessMonitor::instance().unregister_process(pid);
+
         // Notify that the process has finished.
         if (!process->invalid_inheritor_)
             process->event_finished();
@@ -436,6 +593,7 @@ namespace ckcore
 
         // Change state to running (this will change on failure).
         state_ = STATE_RUNNING;
+        exit_code_ = 0;
 
         // Fork process.
         pid_ = fork();
@@ -470,13 +628,20 @@ namespace ckcore
         }
 
         // Register child.
-        ProcessMonitor::instance().register_process(pid_,this);
+        ProcessMonitor::instance().register_process(pid_);
+
+        // Reset the start event. This must not be done when closing since the
+        // listen thread may close the process before we have been notified.
+        pthread_mutex_lock(&started_mutex_);
+        started_event_ = false;
+        pthread_mutex_unlock(&started_mutex_);
 
         // Create listen thread.
         pthread_t thread;
         if (pthread_create(&thread,NULL,listen,this) != 0)
         {
             // If we failed, kill the process.
+            ProcessMonitor::instance().unregister_process(pid_);
             ::kill(pid_,SIGKILL);
             return false;
         }
@@ -487,7 +652,6 @@ namespace ckcore
             pthread_cond_wait(&started_cond_,&started_mutex_);
         pthread_mutex_unlock(&started_mutex_);
 
-        exit_code_ = 0;
         return true;
     }
 
@@ -119,6 +119,28 @@ namespace ckcore
         return !(*this == it);
     }
 
+    bool Directory::Iterator::info(File::Info &info) const
+    {
+        if (at_end_)
+            return false;
+
+        ULARGE_INTEGER size;
+        size.LowPart = cur_ent_.nFileSizeLow;
+        size.HighPart = cur_ent_.nFileSizeHigh;
+
+        info.size = static_cast<tint64>(size.QuadPart);
+        info.block_size = 0;
+        info.blocks = (info.size + 511)/512;
+        info.mode = cur_ent_.dwFileAttributes;
+        info.inode = 0;
+        info.device = 0;
+        info.access_time = FileTimeToNs(cur_ent_.ftLastAccessTime);
+        info.modify_time = FileTimeToNs(cur_ent_.ftLastWriteTime);
+        info.change_time = info.modify_time;
+        info.create_time = FileTimeToNs(cur_ent_.ftCreationTime);
+        return true;
+    }
+
     Directory::Directory(const Path &dir_path) : dir_path_(dir_path)
     {
     }
@@ -127,7 +149,7 @@ namespace ckcore
     {
         // Since the Directory object owns the iterator handles, we need to
         // free them.
-        std::map<Iterator *,HANDLE>::iterator it;
+        HandleMap::iterator it;
         for (it = dir_handles_.begin(); it != dir_handles_.end(); it++)
             FindClose(it->second);
 
@@ -202,6 +224,13 @@ namespace ckcore
         return (attr != -1) && (attr & FILE_ATTRIBUTE_DIRECTORY);
     }
 
+    bool Directory::sync(const Path &dir_path)
+    {
+        // Directory changes are committed through the file system journal,
+        // there is nothing to flush.
+        return exist(dir_path);
+    }
+
     bool Directory::time(const Path &dir_path,struct tm &accessckTime,
                          struct tm &modifyckTime,struct tm &createckTime)
     {
@@ -27,45 +27,94 @@ namespace ckcore
 #pragma warning(disable : 4290) // C++ exception specification ignored except to...
 
     File::File(const Path &file_path) : file_handle_(INVALID_HANDLE_VALUE),
-        file_path_(file_path)
+        file_path_(file_path),unbuffered_(false),direct_(false),
+        anonymous_(false)
     {
     }
 
-    void File::open2(FileMode file_mode) throw(std::exception)
+    void File::open2(FileMode file_mode,const OpenOptions &options) throw(std::exception)
     {
         // Check a file handle has already been opened, in that case try to close
         // it.
         if (file_handle_ != INVALID_HANDLE_VALUE && !close())
             throw Exception2(ckT("Cannot close previously open file handle."));
 
-        // Open the file handle.
+        // Unbuffered I/O is supported by all local file systems.
+        // Partially written blocks must be read back, so the file is always
+        // opened for reading as well.
+        DWORD flags = unbuffered_ ? FILE_FLAG_NO_BUFFERING : 0;
+        DWORD access = unbuffered_ ? GENERIC_READ : 0;
+        direct_ = unbuffered_;
+
+        // Handles are not inherited by child processes unless explicitly
+        // requested, and there is no way of opening files without locking
+        // them other than allowing full sharing.
+        DWORD share = options.lock == ckLOCK_NONE ?
+                      FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE :
+                      FILE_SHARE_READ;
+
+        DWORD disposition = OPEN_EXISTING;
         switch (file_mode)
         {
             case ckOPEN_READ:
-                file_handle_ = CreateFile(file_path_.name().c_str(),
-                                          GENERIC_READ,
-                                          FILE_SHARE_READ,NULL,OPEN_EXISTING,
-                                          FILE_ATTRIBUTE_ARCHIVE,NULL);
+                access |= GENERIC_READ;
                 break;
 
             case ckOPEN_WRITE:
-                file_handle_ = CreateFile(file_path_.name().c_str(),
-                                          GENERIC_WRITE,
-                                          FILE_SHARE_READ,NULL,CREATE_ALWAYS,
-                                          FILE_ATTRIBUTE_ARCHIVE,NULL);
+                access |= GENERIC_WRITE;
+                disposition = CREATE_ALWAYS;
                 break;
 
             case ckOPEN_READWRITE:
-                file_handle_ = CreateFile(file_path_.name().c_str(),
-                                          GENERIC_WRITE,
-                                          FILE_SHARE_READ,NULL,OPEN_EXISTING,
-                                          FILE_ATTRIBUTE_ARCHIVE,NULL);
+                access |= GENERIC_WRITE;
                 break;
 
             default:
                 ckASSERT(false);
         }
 
+        // Files opened in write mode are always truncated.
+        bool truncate = options.truncate && file_mode != ckOPEN_READ;
+        if (options.exclusive)
+            disposition = CREATE_NEW;
+        else if (options.create && disposition == OPEN_EXISTING)
+            disposition = truncate ? CREATE_ALWAYS : OPEN_ALWAYS;
+        else if (truncate && disposition == OPEN_EXISTING)
+            disposition = TRUNCATE_EXISTING;
+
+        // Temporary files are given a unique name in the requested directory
+        // and are deleted by the system when the handle is closed.
+        tstring name = file_path_.name();
+        if (options.temporary)
+        {
+            TCHAR temp_name[MAX_PATH];
+            if (GetTempFileName(name.c_str(),ckT("ck"),0,temp_name) == 0)
+            {
+                throw_from_last_error( ckT("Error opening file \"%s\": "),
+                                       file_path_.name().c_str() );
+            }
+
+            name = temp_name;
+            access |= GENERIC_READ | GENERIC_WRITE | DELETE;
+            share |= FILE_SHARE_DELETE;
+            disposition = CREATE_ALWAYS;
+            flags |= FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE;
+        }
+        else
+        {
+            flags |= FILE_ATTRIBUTE_ARCHIVE;
+        }
+
+        // Open the file handle.
+        file_handle_ = CreateFile(name.c_str(),access,share,NULL,disposition,
+                                  flags,NULL);
+        if (file_handle_ == INVALID_HANDLE_VALUE && options.temporary)
+        {
+            DWORD error = GetLastError();
+            DeleteFile(name.c_str());
+            SetLastError(error);
+        }
+
         if ( file_handle_ == INVALID_HANDLE_VALUE )
         {
             throw_from_last_error( ckT("Error opening file \"%s\": "),
@@ -81,6 +130,7 @@ namespace ckcore
         if (CloseHandle(file_handle_) == TRUE)
         {
             file_handle_ = INVALID_HANDLE_VALUE;
+            direct_ = false;
             return true;
         }
         else
@@ -158,6 +208,28 @@ namespace ckcore
     }
 
     tint64 File::read(void *buffer,tint64 count)
+    {
+        if (file_handle_ == INVALID_HANDLE_VALUE)
+            return -1;
+
+        if (direct_)
+            return read_unbuffered(buffer,count);
+
+        return read_raw(buffer,count);
+    }
+
+    tint64 File::write(const void *buffer,tint64 count)
+    {
+        if (file_handle_ == INVALID_HANDLE_VALUE)
+            return -1;
+
+        if (direct_)
+            return write_unbuffered(buffer,count);
+
+        return write_raw(buffer,count);
+    }
+
+    tint64 File::read_at(void *buffer,tint64 count,tint64 offset) const
     {
         // ReadFile() takes a DWORD (defined as unsigned long) as the byte count.
         ckASSERT(count >= 0 || count <= ULONG_MAX);
@@ -165,6 +237,45 @@ namespace ckcore
         if (file_handle_ == INVALID_HANDLE_VALUE)
             return -1;
 
+        // ReadFile moves the file pointer to the end of the read data, callers
+        // that mix read_at with read or write must restore it themselves.
+        OVERLAPPED overlapped;
+        memset(&overlapped,0,sizeof(overlapped));
+        overlapped.Offset = static_cast<DWORD>(offset & 0xffffffff);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+        unsigned long read = 0;
+        if (ReadFile(file_handle_,buffer,DWORD(count),&read,&overlapped) == FALSE)
+            return GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+
+        return read;
+    }
+
+    tint64 File::write_at(const void *buffer,tint64 count,tint64 offset)
+    {
+        // WriteFile() takes a DWORD (defined as unsigned long) as the byte count.
+        ckASSERT(count >= 0 || count <= ULONG_MAX);
+
+        if (file_handle_ == INVALID_HANDLE_VALUE)
+            return -1;
+
+        OVERLAPPED overlapped;
+        memset(&overlapped,0,sizeof(overlapped));
+        overlapped.Offset = static_cast<DWORD>(offset & 0xffffffff);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+        unsigned long written = 0;
+        if (WriteFile(file_handle_,buffer,DWORD(count),&written,&overlapped) == FALSE)
+            return -1;
+
+        return written;
+    }
+
+    tint64 File::read_raw(void *buffer,tint64 count)
+    {
+        // ReadFile() takes a DWORD (defined as unsigned long) as the byte count.
+        ckASSERT(count >= 0 || count <= ULONG_MAX);
+
         unsigned long read = 0;
         if (ReadFile(file_handle_,buffer,DWORD(count),&read,NULL) == FALSE)
             return -1;
@@ -172,14 +283,11 @@ namespace ckcore
             return read;
     }
 
-    tint64 File::write(const void *buffer,tint64 count)
+    tint64 File::write_raw(const void *buffer,tint64 count)
     {
         // WriteFile() takes a DWORD (defined as unsigned long) as the byte count.
         ckASSERT(count >= 0 || count <= ULONG_MAX);
 
-        if (file_handle_ == INVALID_HANDLE_VALUE)
-            return -1;
-
         unsigned long written = 0;
         if (WriteFile(file_handle_,buffer,DWORD(count),&written,NULL) == FALSE)
             return -1;
@@ -187,6 +295,114 @@ namespace ckcore
             return written;
     }
 
+    bool File::truncate_raw(tint64 size)
+    {
+        LARGE_INTEGER li;
+        li.QuadPart = size;
+
+        if (SetFilePointerEx(file_handle_,li,NULL,FILE_BEGIN) == FALSE)
+            return false;
+
+        return SetEndOfFile(file_handle_) != FALSE;
+    }
+
+    bool File::advise(FileAdvice advice,tint64 offset,tint64 count)
+    {
+        // There is no equivalent for already opened files, the advice is only
+        // a hint.
+        ckUNUSED(advice);
+        ckUNUSED(offset);
+        ckUNUSED(count);
+
+        return file_handle_ != INVALID_HANDLE_VALUE;
+    }
+
+    bool File::prefetch(tint64 offset,tint64 count)
+    {
+        // There is no equivalent on Windows XP, the file cache performs its
+        // own read-ahead.
+        ckUNUSED(offset);
+        ckUNUSED(count);
+
+        return file_handle_ != INVALID_HANDLE_VALUE;
+    }
+
+    tuint32 File::block_size() const
+    {
+        // Use the cluster size of the volume containing the file.
+        TCHAR volume_path[MAX_PATH];
+        if (GetVolumePathName(file_path_.name().c_str(),volume_path,MAX_PATH) == FALSE)
+            return 0;
+
+        DWORD sectors_per_cluster = 0,bytes_per_sector = 0;
+        DWORD free_clusters = 0,total_clusters = 0;
+        if (GetDiskFreeSpace(volume_path,&sectors_per_cluster,&bytes_per_sector,
+                             &free_clusters,&total_clusters) == FALSE)
+            return 0;
+
+        return sectors_per_cluster*bytes_per_sector;
+    }
+
+    bool File::sync(bool data_only)
+    {
+        ckUNUSED(data_only);
+
+        if (file_handle_ == INVALID_HANDLE_VALUE)
+            return false;
+
+        return FlushFileBuffers(file_handle_) != FALSE;
+    }
+
+    bool File::writeback(tint64 offset,tint64 count,bool wait)
+    {
+        // Not supported.
+        ckUNUSED(offset);
+        ckUNUSED(count);
+        ckUNUSED(wait);
+        return false;
+    }
+
+    bool File::link(const Path &new_file_path)
+    {
+        // Anonymous files are not supported on Windows.
+        ckUNUSED(new_file_path);
+        return false;
+    }
+
+    bool File::reserve(tuint64 size)
+    {
+        if (file_handle_ == INVALID_HANDLE_VALUE)
+            return false;
+
+        if (size == 0)
+            return true;
+
+        // SetFileInformationByHandle is not available on Windows XP so it
+        // must be loaded dynamically.
+        typedef struct
+        {
+            LARGE_INTEGER AllocationSize;
+        } ckFILE_ALLOCATION_INFO;
+
+        typedef BOOL (WINAPI *tSetFileInformationByHandle)(HANDLE,int,LPVOID,DWORD);
+        const int ckFileAllocationInfo = 5;
+
+        HMODULE kernel = GetModuleHandle(ckT("kernel32.dll"));
+        tSetFileInformationByHandle set_info = kernel != NULL ?
+            reinterpret_cast<tSetFileInformationByHandle>(
+                GetProcAddress(kernel,"SetFileInformationByHandle")) : NULL;
+
+        // Not supported, the reservation is only a hint.
+        if (set_info == NULL)
+            return true;
+
+        ckFILE_ALLOCATION_INFO info;
+        info.AllocationSize.QuadPart = static_cast<LONGLONG>(size);
+
+        return set_info(file_handle_,ckFileAllocationInfo,&info,
+                        sizeof(info)) != FALSE;
+    }
+
     bool File::exist() const
     {
         return exist(file_path_);
@@ -216,6 +432,41 @@ namespace ckcore
         return false;
     }
 
+    /**
+     * Obtains file meta data from an open file handle.
+     */
+    static bool handle_info(HANDLE file_handle,File::Info &info)
+    {
+        BY_HANDLE_FILE_INFORMATION file_info;
+        if (GetFileInformationByHandle(file_handle,&file_info) == FALSE)
+            return false;
+
+        ULARGE_INTEGER size;
+        size.LowPart = file_info.nFileSizeLow;
+        size.HighPart = file_info.nFileSizeHigh;
+
+        info.size = static_cast<tint64>(size.QuadPart);
+        info.block_size = 0;
+        info.blocks = (info.size + 511)/512;
+        info.mode = file_info.dwFileAttributes;
+        info.inode = (static_cast<tuint64>(file_info.nFileIndexHigh) << 32) |
+                     file_info.nFileIndexLow;
+        info.device = file_info.dwVolumeSerialNumber;
+        info.access_time = FileTimeToNs(file_info.ftLastAccessTime);
+        info.modify_time = FileTimeToNs(file_info.ftLastWriteTime);
+        info.change_time = info.modify_time;
+        info.create_time = FileTimeToNs(file_info.ftCreationTime);
+        return true;
+    }
+
+    bool File::info(Info &info) const
+    {
+        if (file_handle_ != INVALID_HANDLE_VALUE)
+            return handle_info(file_handle_,info);
+
+        return File::info(file_path_,info);
+    }
+
     bool File::time(struct tm &access_time,struct tm &modify_time,
                     struct tm &create_time) const
     {
@@ -303,6 +554,20 @@ namespace ckcore
                         new_file_path.name().c_str()) != FALSE;
     }
 
+    bool File::replace(const Path &old_file_path,const Path &new_file_path)
+    {
+        return MoveFileEx(old_file_path.name().c_str(),
+                          new_file_path.name().c_str(),
+                          MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != FALSE;
+    }
+
+    bool File::sync_all(const Path &file_path)
+    {
+        // Flushing a volume requires administrative privileges.
+        ckUNUSED(file_path);
+        return false;
+    }
+
     bool File::time(const Path &file_path,struct tm &access_time,
                     struct tm &modify_time,struct tm &create_time)
     {
@@ -375,6 +640,69 @@ namespace ckcore
         return (attr & FILE_ATTRIBUTE_HIDDEN) != 0;
     }
 
+    bool File::info(const Path &file_path,Info &info)
+    {
+        // No access rights are needed to query the meta data.
+        HANDLE file_handle = CreateFile(file_path.name().c_str(),0,
+                                        FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                        NULL,OPEN_EXISTING,
+                                        FILE_FLAG_BACKUP_SEMANTICS,NULL);
+        if (file_handle == INVALID_HANDLE_VALUE)
+            return false;
+
+        bool result = handle_info(file_handle,info);
+        CloseHandle(file_handle);
+        return result;
+    }
+
+    /**
+     * @brief State of a file copy operation.
+     */
+    struct CopyState
+    {
+        Progresser &progresser;
+        tint64 transferred;     // Number of bytes reported so far.
+    };
+
+    /**
+     * Forwards the CopyFileEx progress to a Progresser object.
+     */
+    static DWORD CALLBACK copy_progress(LARGE_INTEGER total_size,
+                                        LARGE_INTEGER transferred,
+                                        LARGE_INTEGER stream_size,
+                                        LARGE_INTEGER stream_transferred,
+                                        DWORD stream_number,DWORD reason,
+                                        HANDLE src_handle,HANDLE dst_handle,
+                                        LPVOID data)
+    {
+        ckUNUSED(total_size);
+        ckUNUSED(stream_size);
+        ckUNUSED(stream_transferred);
+        ckUNUSED(stream_number);
+        ckUNUSED(reason);
+        ckUNUSED(src_handle);
+        ckUNUSED(dst_handle);
+
+        CopyState *state = static_cast<CopyState *>(data);
+
+        state->progresser.update(transferred.QuadPart - state->transferred);
+        state->transferred = transferred.QuadPart;
+
+        return state->progresser.cancelled() ? PROGRESS_CANCEL : PROGRESS_CONTINUE;
+    }
+
+    bool File::copy(const Path &src_file_path,const Path &dst_file_path,
+                    Progresser &progresser)
+    {
+        // CopyFileEx performs the copy in the system cache manager, which is
+        // as good as it gets on Windows XP.
+        CopyState state = { progresser,0 };
+
+        return CopyFileEx(src_file_path.name().c_str(),
+                          dst_file_path.name().c_str(),
+                          copy_progress,&state,NULL,0) != FALSE;
+    }
+
     tint64 File::size2(const Path &file_path) throw(std::exception)
     {
         try
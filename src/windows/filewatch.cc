@@ -0,0 +1,88 @@
+/*
+ * The ckCore library provides core software functionality.
+ * Copyright (C) 2006-2012 Christian Kindahl
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stdafx.hh"
+#include "ckcore/filewatch.hh"
+
+namespace ckcore
+{
+    FileWatch::FileWatch(const Path &file_path) :
+        file_path_(file_path),handle_(INVALID_HANDLE_VALUE)
+    {
+    }
+
+    FileWatch::~FileWatch()
+    {
+        close();
+    }
+
+    bool FileWatch::open()
+    {
+        close();
+
+        if (GetFileAttributes(file_path_.name().c_str()) == INVALID_FILE_ATTRIBUTES)
+            return false;
+
+        // Changes can only be monitored on directory level.
+        tstring dir_name = file_path_.dir_name();
+        if (dir_name.empty())
+            dir_name = ckT(".");
+
+        handle_ = FindFirstChangeNotification(dir_name.c_str(),FALSE,
+                                              FILE_NOTIFY_CHANGE_SIZE |
+                                              FILE_NOTIFY_CHANGE_LAST_WRITE);
+        return handle_ != INVALID_HANDLE_VALUE;
+    }
+
+    bool FileWatch::close()
+    {
+        if (handle_ == INVALID_HANDLE_VALUE)
+            return false;
+
+        FindCloseChangeNotification(handle_);
+        handle_ = INVALID_HANDLE_VALUE;
+        return true;
+    }
+
+    bool FileWatch::test() const
+    {
+        return handle_ != INVALID_HANDLE_VALUE;
+    }
+
+    FileWatch::Event FileWatch::wait(tuint32 timeout)
+    {
+        if (handle_ == INVALID_HANDLE_VALUE)
+            return ckEVENT_ERROR;
+
+        // There is no notification when a writer closes the file.
+        switch (WaitForSingleObject(handle_,timeout == 0 ? INFINITE : timeout))
+        {
+            case WAIT_OBJECT_0:
+                if (FindNextChangeNotification(handle_) == FALSE)
+                    return ckEVENT_ERROR;
+
+                return ckEVENT_MODIFIED;
+
+            case WAIT_TIMEOUT:
+                return ckEVENT_TIMEOUT;
+
+            default:
+                return ckEVENT_ERROR;
+        }
+    }
+}
@@ -0,0 +1,258 @@
+/*
+ * The ckCore library provides core software functionality.
+ * Copyright (C) 2006-2012 Christian Kindahl
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stdafx.hh"
+#include <string.h>
+#include "ckcore/mappedfilestream.hh"
+
+namespace ckcore
+{
+    /**
+     * The default view size on systems with a 32-bit address space.
+     */
+    static const size_t DEFAULT_WINDOW_SIZE = 64*1024*1024;
+
+    /**
+     * Returns the alignment required for view offsets.
+     */
+    static size_t allocation_granularity()
+    {
+        SYSTEM_INFO system_info;
+        GetSystemInfo(&system_info);
+        return system_info.dwAllocationGranularity;
+    }
+
+    MappedFileInStream::MappedFileInStream(const Path &file_path,
+                                           size_t window_size) :
+        file_path_(file_path),file_handle_(INVALID_HANDLE_VALUE),
+        map_handle_(NULL),size_(0),pos_(0),advice_(File::ckADVICE_NORMAL),
+        view_(NULL),view_offset_(0),view_size_(0),window_size_(window_size)
+    {
+        if (window_size_ == 0 && sizeof(void *) < 8)
+            window_size_ = DEFAULT_WINDOW_SIZE;
+
+        // The view must be able to hold at least one granularity unit in
+        // addition to the alignment.
+        if (window_size_ != 0 && window_size_ < 2*allocation_granularity())
+            window_size_ = 2*allocation_granularity();
+    }
+
+    MappedFileInStream::~MappedFileInStream()
+    {
+        close();
+    }
+
+    bool MappedFileInStream::map(tint64 offset,size_t count)
+    {
+        // Check if the range already is mapped.
+        if (view_ != NULL && offset >= view_offset_ &&
+            offset + static_cast<tint64>(count) <= view_offset_ + static_cast<tint64>(view_size_))
+            return true;
+
+        unmap();
+
+        tint64 map_offset = 0;
+        tint64 map_size = size_;
+        if (window_size_ != 0)
+        {
+            map_offset = offset - offset % allocation_granularity();
+            map_size = size_ - map_offset;
+            if (map_size > static_cast<tint64>(window_size_))
+                map_size = window_size_;
+        }
+
+        if (map_size <= 0 || static_cast<tuint64>(map_size) > static_cast<size_t>(-1))
+            return false;
+
+        LARGE_INTEGER li;
+        li.QuadPart = map_offset;
+
+        void *view = MapViewOfFile(map_handle_,FILE_MAP_READ,li.HighPart,
+                                   li.LowPart,static_cast<SIZE_T>(map_size));
+        if (view == NULL)
+            return false;
+
+        view_ = static_cast<unsigned char *>(view);
+        view_offset_ = map_offset;
+        view_size_ = static_cast<size_t>(map_size);
+
+        apply_advice();
+        return true;
+    }
+
+    void MappedFileInStream::unmap()
+    {
+        if (view_ != NULL)
+        {
+            UnmapViewOfFile(view_);
+            view_ = NULL;
+            view_offset_ = 0;
+            view_size_ = 0;
+        }
+    }
+
+    void MappedFileInStream::apply_advice()
+    {
+        // Windows XP has no way of advising the memory manager about the
+        // access pattern of mapped views, the advice is only a hint.
+    }
+
+    bool MappedFileInStream::open()
+    {
+        close();
+
+        file_handle_ = CreateFile(file_path_.name().c_str(),GENERIC_READ,
+                                  FILE_SHARE_READ,NULL,OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_ARCHIVE,NULL);
+        if (file_handle_ == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER li;
+        if (GetFileSizeEx(file_handle_,&li) == FALSE)
+        {
+            close();
+            return false;
+        }
+
+        size_ = li.QuadPart;
+        pos_ = 0;
+
+        // Empty files can't be mapped.
+        if (size_ == 0)
+            return true;
+
+        map_handle_ = CreateFileMapping(file_handle_,NULL,PAGE_READONLY,0,0,NULL);
+        if (map_handle_ == NULL)
+        {
+            close();
+            return false;
+        }
+
+        // Map the first view up front so that errors are detected early.
+        if (!map(0,0))
+        {
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+    bool MappedFileInStream::close()
+    {
+        if (file_handle_ == INVALID_HANDLE_VALUE)
+            return false;
+
+        unmap();
+
+        if (map_handle_ != NULL)
+        {
+            CloseHandle(map_handle_);
+            map_handle_ = NULL;
+        }
+
+        if (CloseHandle(file_handle_) == FALSE)
+            return false;
+
+        file_handle_ = INVALID_HANDLE_VALUE;
+        size_ = 0;
+        pos_ = 0;
+        return true;
+    }
+
+    bool MappedFileInStream::test() const
+    {
+        return file_handle_ != INVALID_HANDLE_VALUE;
+    }
+
+    bool MappedFileInStream::advise(File::FileAdvice advice)
+    {
+        advice_ = advice;
+        apply_advice();
+        return true;
+    }
+
+    bool MappedFileInStream::end()
+    {
+        return pos_ >= size_;
+    }
+
+    bool MappedFileInStream::seek(tuint32 distance,StreamWhence whence)
+    {
+        if (file_handle_ == INVALID_HANDLE_VALUE)
+            return false;
+
+        if (whence == ckSTREAM_BEGIN)
+            pos_ = 0;
+
+        pos_ += distance;
+        return true;
+    }
+
+    tint64 MappedFileInStream::read(void *buffer,tuint32 count)
+    {
+        tuint32 pos = 0;
+        while (pos < count)
+        {
+            const unsigned char *data = NULL;
+            tint64 res = borrow(data,count - pos);
+            if (res == -1)
+                return pos == 0 ? -1 : static_cast<tint64>(pos);
+
+            if (res == 0)
+                break;
+
+            memcpy(static_cast<unsigned char *>(buffer) + pos,data,
+                   static_cast<size_t>(res));
+
+            pos_ += res;
+            pos += static_cast<tuint32>(res);
+        }
+
+        return pos;
+    }
+
+    tint64 MappedFileInStream::borrow(const unsigned char *&buffer,tuint32 count)
+    {
+        if (file_handle_ == INVALID_HANDLE_VALUE)
+            return -1;
+
+        if (pos_ >= size_)
+            return 0;
+
+        tint64 avail = size_ - pos_;
+        if (avail > count)
+            avail = count;
+
+        // Limit the request to what fits in a view.
+        if (window_size_ != 0 &&
+            avail > static_cast<tint64>(window_size_ - allocation_granularity()))
+            avail = window_size_ - allocation_granularity();
+
+        if (!map(pos_,static_cast<size_t>(avail)))
+            return -1;
+
+        buffer = view_ + (pos_ - view_offset_);
+        return avail;
+    }
+
+    tint64 MappedFileInStream::size()
+    {
+        return file_handle_ == INVALID_HANDLE_VALUE ? -1 : size_;
+    }
+}
@@ -18,17 +18,33 @@
 
 #include "stdafx.hh"
 #include "ckcore/assert.hh"
+#include "ckcore/memorystats.hh"
 #include "ckcore/stream.hh"
 #include "ckcore/process.hh"
 
 namespace ckcore
-{
+{    /**
+     * Reports a change of the capacity of a block buffer to MemoryStats.
+     * @param [in] buffer The block buffer.
+     * @param [in,out] counted The capacity reported so far.
+     */
+    static void count_block_buffer(const std::string &buffer,size_t &counted)
+    {
+        size_t capacity = buffer.capacity();
+        if (capacity > counted)
+            MemoryStats::instance().allocated(MemoryStats::ckTAG_PROCESS,&buffer,capacity - counted);
+        else if (capacity < counted)
+            MemoryStats::instance().released(MemoryStats::ckTAG_PROCESS,&buffer,counted - capacity);
+
+        counted = capacity;
+    }
+
     Process::Process() : invalid_inheritor_(false),
         pipe_stdin_(NULL),pipe_output_(NULL),
         process_handle_(NULL),thread_handle_(NULL),
         start_event_(NULL),stop_event_(NULL),
         thread_id_(0),state_(STATE_STOPPED),exit_code_(0),
-        mutex_(NULL),mutex_exec_(NULL)
+        block_counted_(0),mutex_(NULL),mutex_exec_(NULL)
     {
         mutex_ = CreateMutex(NULL,FALSE,NULL);
         mutex_exec_ = CreateMutex(NULL,FALSE,NULL);
@@ -80,6 +96,9 @@ namespace ckcore
             ckVERIFY(0 != CloseHandle(mutex_));
             mutex_ = NULL;
         }
+
+        MemoryStats::instance().released(MemoryStats::ckTAG_PROCESS,
+                                         &block_buffer_,block_counted_);
     }
 
     void Process::close()
@@ -221,6 +240,8 @@ namespace ckcore
                     block_buffer_.push_back(buffer[i]);
                 }
             }
+
+            count_block_buffer(block_buffer_,block_counted_);
         }
 
         /*unsigned long last_err = GetLastError();
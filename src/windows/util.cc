@@ -56,4 +56,14 @@ namespace ckcore
         TIME_ZONE_INFORMATION tzi;
         time.tm_isdst = GetTimeZoneInformation(&tzi) - 1;
     }
+
+    tint64 FileTimeToNs(const FILETIME &ftime)
+    {
+        ULARGE_INTEGER li;
+        li.LowPart = ftime.dwLowDateTime;
+        li.HighPart = ftime.dwHighDateTime;
+
+        // FILETIME counts 100 nanosecond intervals since 1601-01-01.
+        return (static_cast<tint64>(li.QuadPart) - 116444736000000000LL)*100;
+    }
 };
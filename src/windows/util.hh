@@ -33,4 +33,11 @@ namespace ckcore
      * @param [out] time The output time.
      */
     void SysTimeToTm(SYSTEMTIME &stime,struct tm &time);
+
+    /**
+     * Converts a FILETIME structure to nanoseconds since 1970-01-01 UTC.
+     * @param [in] ftime The input time.
+     * @return The number of nanoseconds since 1970-01-01 UTC.
+     */
+    tint64 FileTimeToNs(const FILETIME &ftime);
 };
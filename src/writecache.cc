@@ -0,0 +1,224 @@
+/*
+ * The ckCore library provides core software functionality.
+ * Copyright (C) 2006-2012 Christian Kindahl
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "ckcore/writecache.hh"
+
+namespace ckcore
+{
+    WriteCache::WriteCache(File &file,tuint32 limit)
+        : file_(file),limit_(limit),dirty_(0)
+    {
+    }
+
+    WriteCache::~WriteCache()
+    {
+        flush();
+    }
+
+    bool WriteCache::write(const void *buffer,tuint32 count,tint64 offset)
+    {
+        if (count == 0)
+            return true;
+
+        const unsigned char *data = static_cast<const unsigned char *>(buffer);
+
+        // Find all extents overlapping or adjacent to the new data.
+        ExtentMap::iterator first = extents_.upper_bound(offset);
+        if (first != extents_.begin())
+        {
+            ExtentMap::iterator prev = first;
+            --prev;
+            if (prev->first + static_cast<tint64>(prev->second.size()) >= offset)
+                first = prev;
+        }
+
+        tint64 start = offset,end = offset + count;
+
+        ExtentMap::iterator last = first;
+        for (; last != extents_.end() && last->first <= end; ++last)
+        {
+            tint64 last_end = last->first + static_cast<tint64>(last->second.size());
+            if (last->first < start)
+                start = last->first;
+            if (last_end > end)
+                end = last_end;
+
+            dirty_ -= last->second.size();
+        }
+
+        if (first == last)
+        {
+            extents_[offset].assign(data,data + count);
+        }
+        else if (first->first == start)
+        {
+            // Grow the first extent in place, which makes appending to an
+            // extent cheap.
+            std::vector<unsigned char> &extent = first->second;
+            extent.resize(static_cast<size_t>(end - start));
+
+            ExtentMap::iterator it = first;
+            for (++it; it != last; ++it)
+            {
+                memcpy(&extent[static_cast<size_t>(it->first - start)],
+                       &it->second[0],it->second.size());
+            }
+
+            memcpy(&extent[static_cast<size_t>(offset - start)],data,count);
+
+            it = first;
+            extents_.erase(++it,last);
+        }
+        else
+        {
+            // The new data starts before all merged extents.
+            std::vector<unsigned char> extent(static_cast<size_t>(end - start));
+            for (ExtentMap::iterator it = first; it != last; ++it)
+            {
+                memcpy(&extent[static_cast<size_t>(it->first - start)],
+                       &it->second[0],it->second.size());
+            }
+
+            memcpy(&extent[0],data,count);
+
+            extents_.erase(first,last);
+            extents_[start].swap(extent);
+        }
+
+        dirty_ += end - start;
+
+        if (dirty_ >= limit_)
+            return flush();
+
+        return true;
+    }
+
+    tint64 WriteCache::read(void *buffer,tuint32 count,tint64 offset) const
+    {
+        unsigned char *data = static_cast<unsigned char *>(buffer);
+
+        // Read what is in the file, data that has not been written yet is
+        // zero unless it is in the cache.
+        tint64 result = 0;
+#ifdef _WINDOWS
+        // read_at moves the file pointer on Windows.
+        tint64 pos = file_.tell();
+#endif
+        while (result < count)
+        {
+            tint64 res = file_.read_at(data + result,count - result,offset + result);
+            if (res == -1)
+            {
+                result = -1;
+                break;
+            }
+            if (res == 0)
+                break;
+
+            result += res;
+        }
+#ifdef _WINDOWS
+        file_.seek(pos,File::ckFILE_BEGIN);
+#endif
+        if (result == -1)
+            return -1;
+
+        memset(data + result,0,static_cast<size_t>(count - result));
+
+        // Overlay the cached data.
+        const tint64 end = offset + count;
+
+        ExtentMap::const_iterator it = extents_.upper_bound(offset);
+        if (it != extents_.begin())
+            --it;
+
+        for (; it != extents_.end() && it->first < end; ++it)
+        {
+            tint64 extent_end = it->first + static_cast<tint64>(it->second.size());
+            tint64 from = it->first > offset ? it->first : offset;
+            tint64 to = extent_end < end ? extent_end : end;
+            if (from >= to)
+                continue;
+
+            memcpy(data + (from - offset),
+                   &it->second[static_cast<size_t>(from - it->first)],
+                   static_cast<size_t>(to - from));
+
+            if (to - offset > result)
+                result = to - offset;
+        }
+
+        return result;
+    }
+
+    bool WriteCache::flush()
+    {
+#ifdef _WINDOWS
+        // write_at moves the file pointer on Windows.
+        tint64 pos = file_.tell();
+#endif
+        bool result = true;
+
+        ExtentMap::iterator it = extents_.begin();
+        for (; it != extents_.end() && result; ++it)
+        {
+            const std::vector<unsigned char> &extent = it->second;
+
+            tint64 written = 0;
+            while (written < static_cast<tint64>(extent.size()))
+            {
+                tint64 res = file_.write_at(&extent[static_cast<size_t>(written)],
+                                            extent.size() - written,it->first + written);
+                if (res <= 0)
+                {
+                    result = false;
+                    break;
+                }
+
+                written += res;
+            }
+
+            if (result)
+                dirty_ -= extent.size();
+        }
+#ifdef _WINDOWS
+        file_.seek(pos,File::ckFILE_BEGIN);
+#endif
+
+        if (!result)
+        {
+            // Keep the extent that failed and the ones after it.
+            extents_.erase(extents_.begin(),--it);
+            return false;
+        }
+
+        extents_.clear();
+        return true;
+    }
+
+    tuint64 WriteCache::dirty() const
+    {
+        return dirty_;
+    }
+
+    size_t WriteCache::extents() const
+    {
+        return extents_.size();
+    }
+}
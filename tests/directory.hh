@@ -91,6 +91,16 @@ public:
             it_file = std::find(files2.begin(),files2.end(),*it);
             if (it_file != files2.end())
                 files2.erase(it_file);
+
+            // The meta data should match the one of the file itself.
+            ckcore::File::Info info,file_info;
+            TS_ASSERT(it.info(info));
+
+            ckcore::tstring path = ckT(TEST_SRC_DIR)ckT("/data/file/") + *it;
+            TS_ASSERT(ckcore::File::info(path.c_str(),file_info));
+            TS_ASSERT_EQUALS(info.size,file_info.size);
+            TS_ASSERT_EQUALS(info.size,ckcore::File::size(path.c_str()));
+            TS_ASSERT_EQUALS(info.modify_time,file_info.modify_time);
         }
 
         TS_ASSERT_EQUALS(files1.size(),0);
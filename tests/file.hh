@@ -18,9 +18,13 @@
 
 #include <cxxtest/TestSuite.h>
 #include <stdlib.h>
+#include <string.h>
+#include <vector>
 #include "ckcore/types.hh"
 #include "ckcore/file.hh"
+#include "ckcore/filestream.hh"
 #include "ckcore/process.hh"
+#include "ckcore/writecache.hh"
 
 #ifdef TEST_SRC_DIR
 #undef TEST_SRC_DIR
@@ -40,6 +44,27 @@ public:
     void event_output(const std::string &block) {}
 };
 
+class CollectCallback : public ckcore::File::ReadCallback
+{
+public:
+    std::vector<ckcore::tint64> sizes_;
+    std::vector<ckcore::tuint32> sums_;
+    size_t calls_;
+    size_t limit_;
+
+    CollectCallback(size_t count,size_t limit)
+        : sizes_(count,-2),sums_(count,0),calls_(0),limit_(limit) {}
+
+    bool file_read(size_t index,const unsigned char *data,ckcore::tint64 size)
+    {
+        sizes_[index] = size;
+        for (ckcore::tint64 i = 0; i < size; i++)
+            sums_[index] += data[i];
+
+        return ++calls_ < limit_;
+    }
+};
+
 class FileTestSuite : public CxxTest::TestSuite
 {
 public:
@@ -317,6 +342,322 @@ public:
         }
     }
 
+    void testInfo()
+    {
+        ckcore::File file(ckT(TEST_SRC_DIR)ckT("/data/file/8253bytes"));
+
+        ckcore::File::Info info;
+        TS_ASSERT(file.info(info));
+        TS_ASSERT_EQUALS(info.size,8253);
+        TS_ASSERT(info.blocks*512 >= info.size);
+        TS_ASSERT(info.modify_time > 0);
+        TS_ASSERT(info.create_time > 0);
+
+        // Querying an open file should give the same result.
+        ckcore::File::Info open_info;
+        TS_ASSERT_THROWS_NOTHING(file.open2(ckcore::File::ckOPEN_READ));
+        TS_ASSERT(file.info(open_info));
+        TS_ASSERT_EQUALS(open_info.size,info.size);
+        TS_ASSERT_EQUALS(open_info.inode,info.inode);
+        TS_ASSERT_EQUALS(open_info.device,info.device);
+        TS_ASSERT_EQUALS(open_info.modify_time,info.modify_time);
+        TS_ASSERT_EQUALS(file.size2(),8253);
+        TS_ASSERT(file.close());
+
+        ckcore::File missing(ckT(TEST_SRC_DIR)ckT("/data/file/missing"));
+        TS_ASSERT(!missing.info(info));
+    }
+
+    void testReadMany()
+    {
+        const ckcore::tchar *file_paths[] =
+        {
+            ckT(TEST_SRC_DIR)ckT("/data/file/0bytes"),
+            ckT(TEST_SRC_DIR)ckT("/data/file/53bytes"),
+            ckT(TEST_SRC_DIR)ckT("/data/file/123bytes"),
+            ckT(TEST_SRC_DIR)ckT("/data/file/8253bytes"),
+            ckT(TEST_SRC_DIR)ckT("/data/file/missing")
+        };
+
+        // Read each file several times using a small queue.
+        std::vector<ckcore::Path> paths;
+        for (unsigned int i = 0; i < 50; i++)
+            paths.push_back(file_paths[i % 5]);
+
+        CollectCallback cb(paths.size(),paths.size() + 1);
+        TS_ASSERT(ckcore::File::read_many(paths,cb,4));
+        TS_ASSERT_EQUALS(cb.calls_,paths.size());
+
+        for (unsigned int i = 0; i < paths.size(); i++)
+        {
+            TS_ASSERT_EQUALS(cb.sizes_[i],ckcore::File::size(paths[i]));
+            TS_ASSERT_EQUALS(cb.sums_[i],cb.sums_[i % 5]);
+        }
+
+        // Verify the contents of one of the files.
+        unsigned char buffer[8253];
+        ckcore::File file(file_paths[3]);
+        TS_ASSERT_THROWS_NOTHING(file.open2(ckcore::File::ckOPEN_READ));
+        TS_ASSERT_EQUALS(file.read(buffer,sizeof(buffer)),8253);
+
+        ckcore::tuint32 sum = 0;
+        for (unsigned int i = 0; i < sizeof(buffer); i++)
+            sum += buffer[i];
+        TS_ASSERT_EQUALS(cb.sums_[3],sum);
+
+        // Cancel after a few files.
+        CollectCallback cancel_cb(paths.size(),3);
+        TS_ASSERT(!ckcore::File::read_many(paths,cancel_cb,4));
+        TS_ASSERT_EQUALS(cancel_cb.calls_,3);
+    }
+
+    void testReserve()
+    {
+        ckcore::File file = ckcore::File::temp(ckT("ckcore-test-file"));
+        TS_ASSERT(!file.reserve(4096));
+
+        // Reserving space must not change the file size.
+        TS_ASSERT_THROWS_NOTHING(file.open2(ckcore::File::ckOPEN_WRITE));
+        TS_ASSERT(file.reserve(1024*1024));
+        TS_ASSERT_EQUALS(file.size2(),0);
+        TS_ASSERT_EQUALS(file.write("0123456789",10),10);
+        TS_ASSERT_EQUALS(file.size2(),10);
+        TS_ASSERT(file.remove());
+
+        {
+            ckcore::FileOutStream os(ckcore::Path(file.name().c_str()),false,
+                                     1024*1024);
+            TS_ASSERT(os.open());
+            TS_ASSERT_EQUALS(os.write("abc",3),3);
+        }
+
+        TS_ASSERT_EQUALS(file.size2(),3);
+        TS_ASSERT(file.remove());
+    }
+
+    void testWriteCache()
+    {
+        const ckcore::tuint32 data_size = 200000;
+        unsigned char *ref = new unsigned char[data_size];
+        memset(ref,0,data_size);
+
+        ckcore::File file = ckcore::File::temp(ckT("ckcore-test-file"));
+        TS_ASSERT_THROWS_NOTHING(file.open2(ckcore::File::ckOPEN_WRITE));
+        TS_ASSERT(file.close());
+
+        // Test all ways of merging writes with a limit small enough to
+        // cause intermediate flushes.
+        TS_ASSERT_THROWS_NOTHING(file.open2(ckcore::File::ckOPEN_READWRITE));
+        {
+            ckcore::WriteCache cache(file,64*1024);
+
+            unsigned char data[3000];
+            for (int i = 0; i < 2000; i++)
+            {
+                ckcore::tuint32 count = rand() % sizeof(data) + 1;
+                ckcore::tint64 offset = rand() % (data_size - count);
+                for (ckcore::tuint32 j = 0; j < count; j++)
+                    data[j] = static_cast<unsigned char>(rand());
+
+                TS_ASSERT(cache.write(data,count,offset));
+                memcpy(ref + offset,data,count);
+
+                // Reading should include the cached data.
+                ckcore::tint64 read_offset = rand() % data_size;
+                ckcore::tuint32 read_count = rand() % sizeof(data) + 1;
+                ckcore::tint64 res = cache.read(data,read_count,read_offset);
+                TS_ASSERT(res >= 0 && res <= read_count);
+                if (res > 0)
+                    TS_ASSERT_SAME_DATA(data,ref + read_offset,static_cast<unsigned int>(res));
+            }
+
+            TS_ASSERT(cache.flush());
+            TS_ASSERT_EQUALS(cache.dirty(),0);
+
+            // Adjacent writes should be merged.
+            for (ckcore::tuint32 offset = 1000; offset < 5000; offset += 100)
+            {
+                TS_ASSERT(cache.write(data,100,offset));
+                memcpy(ref + offset,data,100);
+            }
+
+            TS_ASSERT(cache.write(data,50,900));
+            memcpy(ref + 900,data,50);
+
+            TS_ASSERT_EQUALS(cache.extents(),2);
+            TS_ASSERT(cache.write(data,100,940));
+            memcpy(ref + 940,data,100);
+
+            TS_ASSERT_EQUALS(cache.extents(),1);
+            TS_ASSERT_EQUALS(cache.dirty(),4100);
+        }
+        TS_ASSERT(file.close());
+
+        ckcore::tint64 size = file.size2();
+        TS_ASSERT(size > 0 && size <= data_size);
+
+        unsigned char *buffer = new unsigned char[data_size];
+        TS_ASSERT_THROWS_NOTHING(file.open2(ckcore::File::ckOPEN_READ));
+        TS_ASSERT_EQUALS(file.read(buffer,data_size),size);
+        TS_ASSERT_SAME_DATA(buffer,ref,static_cast<unsigned int>(size));
+        TS_ASSERT(file.close());
+        TS_ASSERT(file.remove());
+
+        delete [] buffer;
+        delete [] ref;
+    }
+
+    void testOpenOptions()
+    {
+        ckcore::File file = ckcore::File::temp(ckT("ckcore-test-file"));
+
+        // Exclusive creation should fail for existing files.
+        ckcore::File::OpenOptions options;
+        options.exclusive = true;
+        options.close_on_exec = true;
+        TS_ASSERT_THROWS_NOTHING(file.open2(ckcore::File::ckOPEN_READWRITE,options));
+        TS_ASSERT_EQUALS(file.write("0123456789",10),10);
+        TS_ASSERT(file.close());
+        TS_ASSERT(!file.open(ckcore::File::ckOPEN_READWRITE,options));
+
+        // Open without locking and without updating the access time.
+        options = ckcore::File::OpenOptions();
+        options.lock = ckcore::File::ckLOCK_NONE;
+        options.no_atime = true;
+        TS_ASSERT_THROWS_NOTHING(file.open2(ckcore::File::ckOPEN_READ,options));
+        char buffer[10];
+        TS_ASSERT_EQUALS(file.read(buffer,sizeof(buffer)),10);
+        TS_ASSERT_SAME_DATA(buffer,"0123456789",10);
+
+        // An unlocked file should be possible to open for writing elsewhere.
+        SimpleProcess process;
+        ckcore::tstring cmd_line = FILETESTER;
+        cmd_line += ckT(" -w ");
+        cmd_line += file.name().c_str();
+
+        TS_ASSERT(process.create(cmd_line.c_str()));
+        process.wait();
+
+        ckcore::tuint32 exit_code = -1;
+        TS_ASSERT(process.exit_code(exit_code));
+        TS_ASSERT_EQUALS(exit_code,ckcore::tuint32(0));
+        TS_ASSERT(file.close());
+
+        options = ckcore::File::OpenOptions();
+        options.lock = ckcore::File::ckLOCK_OFD;
+        options.truncate = true;
+        TS_ASSERT_THROWS_NOTHING(file.open2(ckcore::File::ckOPEN_READWRITE,options));
+        TS_ASSERT_EQUALS(file.size2(),0);
+        TS_ASSERT(file.close());
+
+        // Create an anonymous file in the same directory.
+        ckcore::File temp(ckcore::Path(file.name().c_str()).dir_name().c_str());
+        options = ckcore::File::OpenOptions();
+        options.temporary = true;
+        TS_ASSERT_THROWS_NOTHING(temp.open2(ckcore::File::ckOPEN_READ,options));
+        TS_ASSERT_EQUALS(temp.write("abc",3),3);
+        TS_ASSERT_EQUALS(temp.seek2(0,ckcore::File::ckFILE_BEGIN),0);
+        TS_ASSERT_EQUALS(temp.read(buffer,sizeof(buffer)),3);
+        TS_ASSERT_SAME_DATA(buffer,"abc",3);
+        TS_ASSERT(temp.close());
+
+        TS_ASSERT(file.remove());
+    }
+
+    void testUnbuffered()
+    {
+        const ckcore::tuint32 data_size = 300000;
+        unsigned char *data = new unsigned char[data_size];
+        for (ckcore::tuint32 i = 0; i < data_size; i++)
+            data[i] = static_cast<unsigned char>(rand());
+
+        unsigned char *buffer = new unsigned char[data_size + 1];
+
+        ckcore::File file = ckcore::File::temp(ckT("ckcore-test-file"));
+        file.set_unbuffered(true);
+
+        // Write the data using unaligned chunks.
+        TS_ASSERT_THROWS_NOTHING(file.open2(ckcore::File::ckOPEN_WRITE));
+        ckcore::tuint32 pos = 0;
+        while (pos < data_size)
+        {
+            ckcore::tuint32 count = (rand() % 20000) + 1;
+            if (count > data_size - pos)
+                count = data_size - pos;
+
+            TS_ASSERT_EQUALS(file.write(data + pos,count),count);
+            TS_ASSERT_EQUALS(file.tell2(),pos + count);
+            pos += count;
+        }
+
+        TS_ASSERT_EQUALS(file.size2(),data_size);
+
+        // Overwrite a range in the middle of the file.
+        for (ckcore::tuint32 i = 5000; i < 6000; i++)
+            data[i] = static_cast<unsigned char>(rand());
+
+        TS_ASSERT_EQUALS(file.seek2(5000,ckcore::File::ckFILE_BEGIN),5000);
+        TS_ASSERT_EQUALS(file.write(data + 5000,1000),1000);
+        TS_ASSERT_EQUALS(file.size2(),data_size);
+        TS_ASSERT(file.close());
+
+        // Read the data back, both unaligned and through the file cache.
+        for (int i = 0; i < 2; i++)
+        {
+            file.set_unbuffered(i == 0);
+            TS_ASSERT_THROWS_NOTHING(file.open2(ckcore::File::ckOPEN_READ));
+
+            pos = 0;
+            while (pos < data_size)
+            {
+                ckcore::tint64 res = file.read(buffer + pos,(rand() % 30000) + 1);
+                TS_ASSERT(res > 0);
+                if (res <= 0)
+                    break;
+
+                pos += static_cast<ckcore::tuint32>(res);
+            }
+
+            TS_ASSERT_EQUALS(pos,data_size);
+            TS_ASSERT_EQUALS(file.read(buffer,100),0);
+            TS_ASSERT_SAME_DATA(buffer,data,data_size);
+            TS_ASSERT(file.close());
+        }
+
+        {
+            ckcore::FileInStream is(ckcore::Path(file.name().c_str()),true);
+            TS_ASSERT(is.open());
+            TS_ASSERT(is.seek(1234,ckcore::InStream::ckSTREAM_BEGIN));
+            TS_ASSERT_EQUALS(is.read(buffer,4321),4321);
+            TS_ASSERT_SAME_DATA(buffer,data + 1234,4321);
+        }
+
+        // Overwriting a range inside the last partial block must not extend
+        // the file.
+        file.set_unbuffered(true);
+        TS_ASSERT_THROWS_NOTHING(file.open2(ckcore::File::ckOPEN_READWRITE));
+        for (ckcore::tuint32 i = data_size - 500; i < data_size - 400; i++)
+            data[i] = static_cast<unsigned char>(rand());
+
+        TS_ASSERT_EQUALS(file.seek2(data_size - 500,ckcore::File::ckFILE_BEGIN),
+                         data_size - 500);
+        TS_ASSERT_EQUALS(file.write(data + data_size - 500,100),100);
+        TS_ASSERT_EQUALS(file.tell2(),data_size - 400);
+        TS_ASSERT_EQUALS(file.size2(),data_size);
+        TS_ASSERT(file.close());
+
+        file.set_unbuffered(false);
+        TS_ASSERT_THROWS_NOTHING(file.open2(ckcore::File::ckOPEN_READ));
+        TS_ASSERT_EQUALS(file.read(buffer,data_size + 1),data_size);
+        TS_ASSERT_SAME_DATA(buffer,data,data_size);
+        TS_ASSERT(file.close());
+
+        TS_ASSERT(file.remove());
+
+        delete [] buffer;
+        delete [] data;
+    }
+
     void testExclusiveAccess()
     {
         // Create a new file.
@@ -0,0 +1,259 @@
+/*
+ * The ckCore library provides core software functionality.
+ * Copyright (C) 2006-2012 Christian Kindahl
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cxxtest/TestSuite.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "ckcore/types.hh"
+#include "ckcore/buffer.hh"
+#include "ckcore/directory.hh"
+#include "ckcore/memory.hh"
+#include "ckcore/memorystats.hh"
+#include "ckcore/memorystream.hh"
+#include "ckcore/thread.hh"
+
+#ifdef TEST_SRC_DIR
+#undef TEST_SRC_DIR
+#endif
+#define TEST_SRC_DIR        "."
+
+class ArenaThread : public ckcore::Thread
+{
+public:
+    ckcore::Arena &arena_;
+    ckcore::Arena *local_;
+
+    ArenaThread(ckcore::Arena &arena) : arena_(arena),local_(NULL) {}
+
+    void run()
+    {
+        local_ = &arena_.local();
+        for (int i = 0; i < 1000; i++)
+            local_->allocate(100);
+    }
+};
+
+class MemoryTestSuite : public CxxTest::TestSuite
+{
+public:
+    void testBuffer()
+    {
+        // Small buffers should be stored inline.
+        ckcore::Buffer<unsigned char,size_t,16> small(8);
+        TS_ASSERT_EQUALS(small.size(),size_t(8));
+        TS_ASSERT_EQUALS(small.capacity(),size_t(16));
+        TS_ASSERT(reinterpret_cast<unsigned char *>(&small) <= small.data() &&
+                  small.data() < reinterpret_cast<unsigned char *>(&small + 1));
+
+        for (unsigned char i = 0; i < 8; i++)
+            small[i] = i;
+
+        // Growing the buffer should keep the contents.
+        small.resize(1000);
+        TS_ASSERT_EQUALS(small.size(),size_t(1000));
+        TS_ASSERT(small.capacity() >= 1000);
+        for (unsigned char i = 0; i < 8; i++)
+            TS_ASSERT_EQUALS(small[i],i);
+
+        small.resize(4);
+        TS_ASSERT(small.capacity() >= 1000);
+
+        // Test alignment and pool backing.
+        const size_t alignments[] = { 0,16,64,4096,8192 };
+        for (size_t i = 0; i < sizeof(alignments)/sizeof(size_t); i++)
+        {
+            ckcore::Buffer<int> heap(100,alignments[i]);
+            ckcore::Buffer<int> pool(100,alignments[i],ckcore::BufferStorage::ckBACKING_POOL);
+            if (alignments[i] != 0)
+            {
+                TS_ASSERT_EQUALS(reinterpret_cast<size_t>(heap.data()) % alignments[i],size_t(0));
+                TS_ASSERT_EQUALS(reinterpret_cast<size_t>(pool.data()) % alignments[i],size_t(0));
+            }
+
+            memset(pool.data(),0xaa,pool.capacity()*sizeof(int));
+            pool.reserve(100000);
+            TS_ASSERT(pool.capacity() >= 100000);
+            TS_ASSERT_EQUALS(pool[99],static_cast<int>(0xaaaaaaaa));
+        }
+
+        // Swapping should transfer ownership without copying.
+        ckcore::Buffer<unsigned char,size_t,16> large(5000,64);
+        unsigned char *large_data = large.data();
+        large[4999] = 0x55;
+        small[0] = 0x22;
+
+        small.swap(large);
+        TS_ASSERT_EQUALS(small.data(),large_data);
+        TS_ASSERT_EQUALS(small.size(),size_t(5000));
+        TS_ASSERT_EQUALS(small.alignment(),size_t(64));
+        TS_ASSERT_EQUALS(small[4999],0x55);
+        TS_ASSERT_EQUALS(large.size(),size_t(4));
+        TS_ASSERT_EQUALS(large[0],0x22);
+
+        ckcore::Buffer<unsigned char,size_t,16> inline_a(4),inline_b(2);
+        inline_a[0] = 1;
+        inline_b[0] = 2;
+        inline_a.swap(inline_b);
+        TS_ASSERT_EQUALS(inline_a[0],2);
+        TS_ASSERT_EQUALS(inline_b[0],1);
+        TS_ASSERT_EQUALS(inline_a.size(),size_t(2));
+
+        // Test copying.
+        ckcore::Buffer<unsigned char,size_t,16> copy(small);
+        TS_ASSERT(copy.data() != small.data());
+        TS_ASSERT_SAME_DATA(copy.data(),small.data(),5000);
+        copy = inline_b;
+        TS_ASSERT_EQUALS(copy.size(),size_t(4));
+        TS_ASSERT_EQUALS(copy[0],1);
+    }
+
+    void testArena()
+    {
+        ckcore::Arena arena(4096);
+        TS_ASSERT_EQUALS(arena.used(),size_t(0));
+        TS_ASSERT_EQUALS(arena.capacity(),size_t(0));
+
+        // Allocations should be aligned and not overlap.
+        unsigned char *last = NULL;
+        for (size_t i = 1; i < 200; i++)
+        {
+            unsigned char *ptr = static_cast<unsigned char *>(arena.allocate(i));
+            TS_ASSERT(ptr != NULL);
+            TS_ASSERT_EQUALS(reinterpret_cast<size_t>(ptr) % ckcore::Arena::DEFAULT_ALIGNMENT,size_t(0));
+            memset(ptr,static_cast<int>(i),i);
+
+            if (last != NULL)
+                TS_ASSERT_EQUALS(last[0],static_cast<unsigned char>(i - 1));
+            last = ptr;
+        }
+
+        void *aligned = arena.allocate(10,256);
+        TS_ASSERT_EQUALS(reinterpret_cast<size_t>(aligned) % 256,size_t(0));
+
+        // Large allocations should not waste the current block.
+        unsigned char *small1 = static_cast<unsigned char *>(arena.allocate(8));
+        TS_ASSERT(arena.allocate(100000) != NULL);
+        unsigned char *small2 = static_cast<unsigned char *>(arena.allocate(8));
+        TS_ASSERT_EQUALS(small2,small1 + 16);
+
+        TS_ASSERT(arena.used() >= 100000);
+        TS_ASSERT(arena.capacity() >= arena.used());
+
+        // Test the standard allocator adapter.
+        {
+            ckcore::ArenaAllocator<int> alloc(arena);
+            std::vector<int,ckcore::ArenaAllocator<int> > vec(alloc);
+            for (int i = 0; i < 10000; i++)
+                vec.push_back(i);
+            TS_ASSERT_EQUALS(vec[9999],9999);
+
+            typedef std::basic_string<ckcore::tchar,std::char_traits<ckcore::tchar>,
+                                      ckcore::ArenaAllocator<ckcore::tchar> > ArenaString;
+            ArenaString str(ckT("/some/path"),alloc);
+            str += ckT("/file.txt");
+            TS_ASSERT(str == ckT("/some/path/file.txt"));
+        }
+
+        // Test thread local sub-arenas.
+        ArenaThread thread1(arena),thread2(arena);
+        TS_ASSERT(thread1.start());
+        TS_ASSERT(thread2.start());
+        thread1.wait();
+        thread2.wait();
+
+        TS_ASSERT(thread1.local_ != NULL && thread2.local_ != NULL);
+        TS_ASSERT(thread1.local_ != thread2.local_);
+        TS_ASSERT(thread1.local_ != &arena.local());
+        TS_ASSERT_EQUALS(thread1.local_->used(),size_t(100000));
+
+        arena.reset();
+        TS_ASSERT_EQUALS(arena.used(),size_t(0));
+        TS_ASSERT_EQUALS(arena.capacity(),size_t(0));
+        TS_ASSERT_EQUALS(thread1.local_->capacity(),size_t(0));
+    }
+
+    void testMemoryStats()
+    {
+        ckcore::MemoryStats &stats = ckcore::MemoryStats::instance();
+        TS_ASSERT(!stats.enabled());
+
+        // Nothing should be counted while disabled.
+        ckcore::MemoryStats::Snapshot before = stats.snapshot();
+        {
+            ckcore::MemoryOutStream os;
+            os.write("0123456789",10);
+        }
+        ckcore::MemoryStats::Snapshot after = stats.snapshot();
+        TS_ASSERT_EQUALS(after.total.allocations,before.total.allocations);
+
+        ckcore::Buffer<unsigned char> *early = new ckcore::Buffer<unsigned char>(1000,64);
+
+        stats.set_enabled(true);
+        stats.reset();
+        before = stats.snapshot();
+
+        const ckcore::MemoryStats::Tag tag = ckcore::MemoryStats::ckTAG_MEMORY_STREAM;
+        {
+            // Growing the stream should allocate a number of buffers.
+            ckcore::MemoryOutStream os(4096);
+            unsigned char data[1024];
+            memset(data,0,sizeof(data));
+            for (int i = 0; i < 64; i++)
+                os.write(data,sizeof(data));
+
+            ckcore::MemoryStats::Snapshot snapshot = stats.snapshot();
+            TS_ASSERT_EQUALS(snapshot.tags[tag].allocations,before.tags[tag].allocations + 5);
+            TS_ASSERT_EQUALS(snapshot.tags[tag].current,before.tags[tag].current + 65536);
+            TS_ASSERT(snapshot.tags[tag].peak >= snapshot.tags[tag].current + 32768);
+            TS_ASSERT(snapshot.total.current >= snapshot.tags[tag].current);
+
+            ckcore::Buffer<unsigned char> buffer(1000,64);
+            snapshot = stats.snapshot();
+            TS_ASSERT_EQUALS(snapshot.tags[ckcore::MemoryStats::ckTAG_BUFFER].current,
+                             before.tags[ckcore::MemoryStats::ckTAG_BUFFER].current + 1000);
+
+            // Releasing memory allocated before enabling should not affect
+            // the counters.
+            delete early;
+            snapshot = stats.snapshot();
+            TS_ASSERT_EQUALS(snapshot.tags[ckcore::MemoryStats::ckTAG_BUFFER].current,
+                             before.tags[ckcore::MemoryStats::ckTAG_BUFFER].current + 1000);
+
+            // Container memory of library objects is counted as well.
+            ckcore::Directory dir(ckT(TEST_SRC_DIR)ckT("/data"));
+            ckcore::Directory::Iterator it = dir.begin();
+            snapshot = stats.snapshot();
+            TS_ASSERT(snapshot.tags[ckcore::MemoryStats::ckTAG_DIRECTORY].current >
+                      before.tags[ckcore::MemoryStats::ckTAG_DIRECTORY].current);
+        }
+
+        // All memory should have been released.
+        after = stats.snapshot();
+        TS_ASSERT_EQUALS(after.tags[tag].current,before.tags[tag].current);
+        TS_ASSERT_EQUALS(after.tags[ckcore::MemoryStats::ckTAG_BUFFER].current,
+                         before.tags[ckcore::MemoryStats::ckTAG_BUFFER].current);
+        TS_ASSERT_EQUALS(after.tags[ckcore::MemoryStats::ckTAG_DIRECTORY].current,
+                         before.tags[ckcore::MemoryStats::ckTAG_DIRECTORY].current);
+        TS_ASSERT(after.tags[tag].peak > after.tags[tag].current);
+
+        TS_ASSERT(ckcore::tstring(ckcore::MemoryStats::name(tag)) == ckT("memory stream"));
+
+        stats.set_enabled(false);
+    }
+};
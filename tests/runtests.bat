@@ -1 +1,2 @@
+cxxtestgen.pl --error-printer -o test.cc cast.hh convert.hh directory.hh file.hh linereader.hh memory.hh path.hh process.hh stream.hh string.hh thread.hh threadpool.hh
 call "bin\test.exe"
\ No newline at end of file
@@ -19,10 +19,19 @@
 #include <cxxtest/TestSuite.h>
 #include <stdlib.h>
 #include <algorithm>
+#ifndef _WINDOWS
+#include <unistd.h>
+#endif
 #include "ckcore/types.hh"
+#include "ckcore/atomicfilestream.hh"
+#include "ckcore/directory.hh"
 #include "ckcore/filestream.hh"
 #include "ckcore/bufferedstream.hh"
+#include "ckcore/bufferpool.hh"
+#include "ckcore/blockchecksumstream.hh"
 #include "ckcore/crcstream.hh"
+#include "ckcore/linereader.hh"
+#include "ckcore/mappedfilestream.hh"
 #include "ckcore/memorystream.hh"
 #include "ckcore/nullstream.hh"
 #include "ckcore/system.hh"
@@ -42,6 +51,24 @@ public:
     bool cancelled() { return false; }
 };
 
+class LimitedOutStream : public ckcore::OutStream
+{
+private:
+    ckcore::tuint32 remain_;
+
+public:
+    LimitedOutStream(ckcore::tuint32 limit) : remain_(limit) {}
+
+    ckcore::tint64 write(const void *buffer,ckcore::tuint32 count)
+    {
+        if (count > remain_)
+            return -1;
+
+        remain_ -= count;
+        return count;
+    }
+};
+
 class StreamTestSuite : public CxxTest::TestSuite
 {
 public:
@@ -138,6 +165,356 @@ public:
         }
     }
 
+    void testFileAccessPolicy()
+    {
+        ckcore::FileInStream ref(ckT(TEST_SRC_DIR)ckT("/data/file/8253bytes"));
+        TS_ASSERT(ref.open());
+
+        unsigned char ref_data[8253];
+        TS_ASSERT_EQUALS(ref.read(ref_data,sizeof(ref_data)),8253);
+
+        // The policy must not affect the data being read.
+        ckcore::FileInStream fs(ckT(TEST_SRC_DIR)ckT("/data/file/8253bytes"));
+        fs.set_policy(ckcore::FileInStream::ckACCESS_DROP_BEHIND);
+        TS_ASSERT(fs.open());
+
+        unsigned char data[8253];
+        ckcore::tuint32 pos = 0;
+        while (!fs.end())
+        {
+            ckcore::tint64 res = fs.read(data + pos,1000);
+            TS_ASSERT(res > 0);
+            if (res <= 0)
+                break;
+
+            pos += static_cast<ckcore::tuint32>(res);
+        }
+
+        TS_ASSERT_EQUALS(pos,8253);
+        TS_ASSERT_SAME_DATA(data,ref_data,sizeof(ref_data));
+
+        // Seek back and read data that has been released.
+        TS_ASSERT(fs.seek(100,ckcore::InStream::ckSTREAM_BEGIN));
+        TS_ASSERT_EQUALS(fs.read(data,500),500);
+        TS_ASSERT_SAME_DATA(data,ref_data + 100,500);
+
+        fs.set_policy(ckcore::FileInStream::ckACCESS_SEQUENTIAL);
+        TS_ASSERT(fs.close());
+
+        ckcore::File file(ckT(TEST_SRC_DIR)ckT("/data/file/8253bytes"));
+        TS_ASSERT(!file.prefetch());
+        TS_ASSERT_THROWS_NOTHING(file.open2(ckcore::File::ckOPEN_READ));
+        TS_ASSERT(file.prefetch());
+        TS_ASSERT(file.prefetch(4096,100));
+        TS_ASSERT(file.advise(ckcore::File::ckADVICE_DONTNEED));
+    }
+
+    void testFileCache()
+    {
+        ckcore::FileCache cache(2);
+        TS_ASSERT_EQUALS(cache.capacity(),2);
+
+        ckcore::FileInStream ref(ckT(TEST_SRC_DIR)ckT("/data/file/8253bytes"));
+        TS_ASSERT(ref.open());
+
+        unsigned char ref_data[8253];
+        TS_ASSERT_EQUALS(ref.read(ref_data,sizeof(ref_data)),8253);
+
+        // Two streams reading the same file share the open file.
+        ckcore::FileInStream fs1(ckT(TEST_SRC_DIR)ckT("/data/file/8253bytes"));
+        ckcore::FileInStream fs2(ckT(TEST_SRC_DIR)ckT("/data/file/8253bytes"));
+        TS_ASSERT(fs1.open(cache));
+        TS_ASSERT(fs2.open(cache));
+        TS_ASSERT_EQUALS(cache.count(),1);
+        TS_ASSERT_EQUALS(fs1.size(),8253);
+
+        unsigned char data[8253];
+        TS_ASSERT_EQUALS(fs1.read(data,1000),1000);
+        TS_ASSERT_EQUALS(fs2.read(data + 1000,500),500);
+        TS_ASSERT_SAME_DATA(data,ref_data,1000);
+        TS_ASSERT_SAME_DATA(data + 1000,ref_data,500);
+
+        TS_ASSERT(fs1.seek(8000,ckcore::InStream::ckSTREAM_BEGIN));
+        TS_ASSERT_EQUALS(fs1.read(data,1000),253);
+        TS_ASSERT_SAME_DATA(data,ref_data + 8000,253);
+        TS_ASSERT(fs1.end());
+        TS_ASSERT(fs1.close());
+        TS_ASSERT(fs2.close());
+
+        // The file should remain open after being released.
+        TS_ASSERT_EQUALS(cache.count(),1);
+
+        // Idle files are evicted when the cache is full.
+        ckcore::FileInStream fs3(ckT(TEST_SRC_DIR)ckT("/data/file/0bytes"));
+        ckcore::FileInStream fs4(ckT(TEST_SRC_DIR)ckT("/data/file/53bytes"));
+        TS_ASSERT(fs3.open(cache));
+        TS_ASSERT(fs4.open(cache));
+        TS_ASSERT_EQUALS(cache.count(),2);
+        TS_ASSERT(fs1.open(cache));
+        TS_ASSERT_EQUALS(cache.count(),2);
+        fs1.close();
+        fs3.close();
+        fs4.close();
+
+        // Modified files should be reopened.
+        ckcore::File file = ckcore::File::temp(ckT("ckcore-test-cache"));
+        TS_ASSERT_THROWS_NOTHING(file.open2(ckcore::File::ckOPEN_WRITE));
+        TS_ASSERT_EQUALS(file.write(ref_data,100),100);
+        TS_ASSERT(file.close());
+
+        ckcore::FileInStream fs5(file.name().c_str());
+        TS_ASSERT(fs5.open(cache));
+        TS_ASSERT_EQUALS(fs5.size(),100);
+        TS_ASSERT(fs5.close());
+
+        TS_ASSERT(file.remove());
+        TS_ASSERT_THROWS_NOTHING(file.open2(ckcore::File::ckOPEN_WRITE));
+        TS_ASSERT_EQUALS(file.write(ref_data,200),200);
+        TS_ASSERT(file.close());
+
+        TS_ASSERT(fs5.open(cache));
+        TS_ASSERT_EQUALS(fs5.size(),200);
+        TS_ASSERT_EQUALS(fs5.read(data,sizeof(data)),200);
+        TS_ASSERT_SAME_DATA(data,ref_data,200);
+        TS_ASSERT(fs5.close());
+
+        cache.clear();
+        TS_ASSERT_EQUALS(cache.count(),0);
+        TS_ASSERT(file.remove());
+
+        ckcore::FileInStream fs6(ckT("/some/missing/file"));
+        TS_ASSERT(!fs6.open(cache));
+    }
+
+    void testAtomicFileOutStream()
+    {
+        ckcore::tstring dir_name = ckcore::Directory::temp().name().c_str();
+        TS_ASSERT(ckcore::Directory::create(dir_name.c_str()));
+
+        const ckcore::Path file_path = (dir_name + ckT("/target")).c_str();
+        ckcore::File file(file_path);
+        TS_ASSERT_THROWS_NOTHING(file.open2(ckcore::File::ckOPEN_WRITE));
+        TS_ASSERT_EQUALS(file.write("old",3),3);
+        TS_ASSERT(file.close());
+
+        // The target should not change until the stream is committed.
+        {
+            ckcore::AtomicFileOutStream os(file_path);
+            TS_ASSERT(os.open());
+            TS_ASSERT_EQUALS(os.write("new data",8),8);
+            TS_ASSERT_EQUALS(file.size2(),3);
+            TS_ASSERT(os.commit());
+            TS_ASSERT_EQUALS(file.size2(),8);
+            TS_ASSERT(!os.commit());
+        }
+
+        // Discarded and destroyed streams must not leave anything behind.
+        {
+            ckcore::AtomicFileOutStream os1(file_path,
+                ckcore::AtomicFileOutStream::ckDURABILITY_NONE);
+            TS_ASSERT(os1.open());
+            TS_ASSERT_EQUALS(os1.write("discarded",9),9);
+            TS_ASSERT(os1.discard());
+
+            ckcore::AtomicFileOutStream os2(file_path);
+            TS_ASSERT(os2.open());
+            TS_ASSERT_EQUALS(os2.write("destroyed",9),9);
+        }
+
+        TS_ASSERT_EQUALS(file.size2(),8);
+
+        // Batched files are moved into place when the batch is committed.
+        for (size_t threshold = 1; threshold <= 100; threshold += 99)
+        {
+            ckcore::FileSyncBatch batch(threshold);
+            for (int i = 0; i < 3; i++)
+            {
+                ckcore::tchar name[32];
+                ckcore::convert::sprintf(name,sizeof(name)/sizeof(ckcore::tchar),
+                                         ckT("/batch%d"),i);
+
+                ckcore::AtomicFileOutStream os((dir_name + name).c_str(),batch);
+                TS_ASSERT(os.open());
+                TS_ASSERT_EQUALS(os.write("0123456789",i + 1),i + 1);
+                TS_ASSERT(os.commit());
+                TS_ASSERT(!ckcore::File::exist((dir_name + name).c_str()));
+            }
+
+            TS_ASSERT_EQUALS(batch.count(),3);
+            TS_ASSERT(batch.commit());
+            TS_ASSERT_EQUALS(batch.count(),0);
+
+            for (int i = 0; i < 3; i++)
+            {
+                ckcore::tchar name[32];
+                ckcore::convert::sprintf(name,sizeof(name)/sizeof(ckcore::tchar),
+                                         ckT("/batch%d"),i);
+
+                ckcore::File batch_file((dir_name + name).c_str());
+                TS_ASSERT_EQUALS(batch_file.size2(),i + 1);
+                TS_ASSERT(batch_file.remove());
+            }
+        }
+
+        // Only the target should remain.
+        ckcore::Directory dir(dir_name.c_str());
+        int count = 0;
+        for (ckcore::Directory::Iterator it = dir.begin(); it != dir.end(); it++)
+            count++;
+
+        TS_ASSERT_EQUALS(count,1);
+        TS_ASSERT(file.remove());
+        TS_ASSERT(ckcore::Directory::remove(dir_name.c_str()));
+    }
+
+    void testFollow()
+    {
+        ckcore::File writer = ckcore::File::temp(ckT("ckcore-test-follow"));
+        TS_ASSERT_THROWS_NOTHING(writer.open2(ckcore::File::ckOPEN_WRITE));
+        TS_ASSERT_EQUALS(writer.write("abc",3),3);
+
+        char buffer[16];
+
+        // Data written after the stream was opened should be read, and the
+        // end should be reported once the timeout expires.
+        {
+            ckcore::FileInStream is(writer.name().c_str());
+            is.set_follow(true,200);
+            TS_ASSERT(is.open());
+            TS_ASSERT_EQUALS(is.read(buffer,sizeof(buffer)),3);
+            TS_ASSERT(!is.end());
+
+            TS_ASSERT_EQUALS(writer.write("def",3),3);
+            TS_ASSERT_EQUALS(is.read(buffer,sizeof(buffer)),3);
+            TS_ASSERT_SAME_DATA(buffer,"def",3);
+            TS_ASSERT(!is.end());
+
+            ckcore::tuint64 start = ckcore::system::time();
+            TS_ASSERT_EQUALS(is.read(buffer,sizeof(buffer)),0);
+            TS_ASSERT(ckcore::system::time() - start >= 150);
+            TS_ASSERT(is.end());
+            TS_ASSERT_EQUALS(is.size(),6);
+        }
+
+        // The end should be reported when the writer closes the file (only
+        // detected on Linux, other systems rely on the timeout).
+        {
+            ckcore::FileInStream is(writer.name().c_str());
+            is.set_follow(true,5000);
+            TS_ASSERT(is.open());
+
+            TS_ASSERT_EQUALS(writer.write("ghi",3),3);
+            TS_ASSERT(writer.close());
+
+            ckcore::CrcStream crc(ckcore::CrcStream::ckCRC_32);
+            TS_ASSERT(ckcore::stream::copy(is,crc));
+            TS_ASSERT(is.end());
+            TS_ASSERT_EQUALS(is.size(),9);
+        }
+
+        TS_ASSERT(writer.remove());
+    }
+
+    void testBufferedSeek()
+    {
+        const ckcore::tuint32 data_size = 20000;
+        unsigned char *data = new unsigned char[data_size];
+        for (ckcore::tuint32 i = 0; i < data_size; i++)
+            data[i] = static_cast<unsigned char>(rand());
+
+        // Run without and with read-ahead.
+        for (ckcore::tuint32 depth = 0; depth < 4; depth += 3)
+        {
+            ckcore::MemoryInStream ms(data,data_size);
+            ckcore::BufferedInStream bs(ms,1000);
+            TS_ASSERT(bs.set_read_ahead(depth));
+
+            unsigned char buffer[300];
+            ckcore::tuint32 pos = 0;
+
+            // Seeking forward without a known position.
+            TS_ASSERT_EQUALS(bs.read(buffer,100),100);
+            TS_ASSERT(bs.seek(50,ckcore::InStream::ckSTREAM_CURRENT));
+            TS_ASSERT(bs.seek(5000,ckcore::InStream::ckSTREAM_CURRENT));
+            pos = 5150;
+            TS_ASSERT_EQUALS(bs.read(buffer,sizeof(buffer)),ckcore::tint64(sizeof(buffer)));
+            TS_ASSERT_SAME_DATA(buffer,data + pos,sizeof(buffer));
+
+            // Random seeks in both directions.
+            for (int i = 0; i < 1000; i++)
+            {
+                if (rand() % 2 == 0 || pos + 3000 + 2*sizeof(buffer) > data_size)
+                {
+                    pos = rand() % (data_size - sizeof(buffer));
+                    TS_ASSERT(bs.seek(pos,ckcore::InStream::ckSTREAM_BEGIN));
+                }
+                else
+                {
+                    pos += sizeof(buffer);
+                    ckcore::tuint32 distance = rand() % 3000;
+                    TS_ASSERT(bs.seek(distance,ckcore::InStream::ckSTREAM_CURRENT));
+                    pos += distance;
+                }
+
+                TS_ASSERT_EQUALS(bs.read(buffer,sizeof(buffer)),ckcore::tint64(sizeof(buffer)));
+                TS_ASSERT_SAME_DATA(buffer,data + pos,sizeof(buffer));
+            }
+
+            // Seeking to the end.
+            TS_ASSERT(bs.seek(data_size,ckcore::InStream::ckSTREAM_BEGIN));
+            TS_ASSERT(bs.end());
+        }
+
+        delete [] data;
+    }
+
+    void testBufferedReadAhead()
+    {
+        ckcore::FileInStream is1(ckT(TEST_SRC_DIR)ckT("/data/file/8253bytes"));
+
+        for (int i = 0; i < 50; i++)
+        {
+            ckcore::FileInStream fs(ckT(TEST_SRC_DIR)ckT("/data/file/8253bytes"));
+
+            TS_ASSERT(is1.open());
+            TS_ASSERT(fs.open());
+
+            ckcore::BufferedInStream is2(fs,(rand() % 1000) + 1);
+            TS_ASSERT(is2.set_read_ahead((rand() % 4) + 1));
+
+            size_t buffer_size = (rand() % 2100) + 50;
+            unsigned char *buffer1 = new unsigned char[buffer_size];
+            unsigned char *buffer2 = new unsigned char[buffer_size];
+
+            ckcore::tint64 read1 = 0,read2 = 0;
+            while (!is1.end() && !is2.end())
+            {
+                ckcore::tint64 res1 = is1.read(buffer1,(ckcore::tuint32)buffer_size);
+                ckcore::tint64 res2 = is2.read(buffer2,(ckcore::tuint32)buffer_size);
+
+                TS_ASSERT_EQUALS(res1,res2);
+                TS_ASSERT_SAME_DATA(buffer1,buffer2,(unsigned int)res1);
+
+                read1 += res1;
+                read2 += res2;
+            }
+
+            TS_ASSERT_EQUALS(is1.end(),is2.end());
+            TS_ASSERT_EQUALS(read1,8253);
+            TS_ASSERT_EQUALS(read2,8253);
+
+            // Stop in the middle of the file to make sure pending read-ahead
+            // is cancelled.
+            TS_ASSERT(is2.seek(1000,ckcore::InStream::ckSTREAM_BEGIN));
+            TS_ASSERT_EQUALS(is2.read(buffer2,10),10);
+
+            TS_ASSERT(is1.close());
+
+            delete [] buffer1;
+            delete [] buffer2;
+        }
+    }
+
     void testOutStream()
     {
         ckcore::FileInStream is1(ckT(TEST_SRC_DIR)ckT("/data/file/8253bytes"));
@@ -212,6 +589,272 @@ public:
         }
     }
 
+    void testWriteback()
+    {
+        const ckcore::tuint32 data_size = 1024*1024 + 1234;
+        unsigned char *data = new unsigned char[data_size];
+        for (ckcore::tuint32 i = 0; i < data_size; i++)
+            data[i] = static_cast<unsigned char>(rand());
+
+        ckcore::File file = ckcore::File::temp(ckT("ckcore-test-file"));
+
+        // The writeback control must not affect the data written.
+        {
+            ckcore::FileOutStream os(file.name().c_str());
+            os.set_writeback(64*1024);
+            TS_ASSERT(os.open());
+
+            for (ckcore::tuint32 pos = 0; pos < data_size; pos += 3000)
+            {
+                ckcore::tuint32 count = data_size - pos < 3000 ?
+                                        data_size - pos : 3000;
+                TS_ASSERT_EQUALS(os.write(data + pos,count),count);
+            }
+
+            TS_ASSERT(os.close());
+        }
+
+        TS_ASSERT_EQUALS(file.size2(),data_size);
+
+        unsigned char *buffer = new unsigned char[data_size];
+        TS_ASSERT_THROWS_NOTHING(file.open2(ckcore::File::ckOPEN_READ));
+        TS_ASSERT_EQUALS(file.read(buffer,data_size),data_size);
+        TS_ASSERT_SAME_DATA(buffer,data,data_size);
+        TS_ASSERT(file.close());
+        TS_ASSERT(file.remove());
+
+        delete [] buffer;
+        delete [] data;
+    }
+
+    void testBufferedLarge()
+    {
+        const ckcore::tuint32 data_size = 1024*1024;
+        unsigned char *data = new unsigned char[data_size];
+        for (ckcore::tuint32 i = 0; i < data_size; i++)
+            data[i] = static_cast<unsigned char>(rand());
+
+        unsigned char *buffer = new unsigned char[data_size];
+
+        // Mix small and large requests so that the buffer both grows and is
+        // bypassed.
+        ckcore::MemoryInStream ms(data,data_size);
+        ckcore::BufferedInStream is(ms);
+        ckcore::MemoryOutStream mos;
+        {
+            ckcore::BufferedOutStream os(mos);
+
+            ckcore::tuint32 pos = 0;
+            while (!is.end())
+            {
+                ckcore::tuint32 count = rand() % 4 == 0 ?
+                    (rand() % 300000) + 1 : (rand() % 1000) + 1;
+
+                ckcore::tint64 res = is.read(buffer + pos,count);
+                TS_ASSERT(res > 0);
+                if (res <= 0)
+                    break;
+
+                TS_ASSERT_EQUALS(os.write(buffer + pos,(ckcore::tuint32)res),res);
+                pos += (ckcore::tuint32)res;
+            }
+
+            TS_ASSERT_EQUALS(pos,data_size);
+            TS_ASSERT_SAME_DATA(buffer,data,data_size);
+        }
+
+        TS_ASSERT_EQUALS(mos.count(),data_size);
+        TS_ASSERT_SAME_DATA(mos.data(),data,data_size);
+
+        // Seeking after the buffer has grown.
+        for (int i = 0; i < 100; i++)
+        {
+            ckcore::tuint32 pos = rand() % (data_size - 1000);
+            TS_ASSERT(is.seek(pos,ckcore::InStream::ckSTREAM_BEGIN));
+            TS_ASSERT_EQUALS(is.read(buffer,1000),1000);
+            TS_ASSERT_SAME_DATA(buffer,data + pos,1000);
+        }
+
+        delete [] buffer;
+        delete [] data;
+    }
+
+    void testBufferedWriteBehind()
+    {
+        const ckcore::tuint32 data_size = 100000;
+        unsigned char *data = new unsigned char[data_size];
+        for (ckcore::tuint32 i = 0; i < data_size; i++)
+            data[i] = static_cast<unsigned char>(rand());
+
+        for (int i = 0; i < 20; i++)
+        {
+            ckcore::MemoryOutStream ms;
+            {
+                ckcore::BufferedOutStream os(ms,(rand() % 1000) + 1);
+                TS_ASSERT(os.set_write_behind((rand() % 4) + 1));
+
+                for (ckcore::tuint32 pos = 0; pos < data_size;)
+                {
+                    ckcore::tuint32 count = (rand() % 2100) + 1;
+                    if (count > data_size - pos)
+                        count = data_size - pos;
+
+                    TS_ASSERT_EQUALS(os.write(data + pos,count),ckcore::tint64(count));
+                    pos += count;
+
+                    // Flush now and then.
+                    if (rand() % 20 == 0)
+                        TS_ASSERT(os.flush() != -1);
+                }
+            }
+
+            // The destructor must have written all data.
+            TS_ASSERT_EQUALS(ms.count(),data_size);
+            TS_ASSERT_SAME_DATA(ms.data(),data,data_size);
+        }
+
+        // Background write errors.
+        LimitedOutStream ls(5000);
+        ckcore::BufferedOutStream os(ls,1000);
+        TS_ASSERT(os.set_write_behind(2));
+
+        ckcore::tint64 res = 0;
+        for (int i = 0; i < 100 && res != -1; i++)
+            res = os.write(data,100);
+
+        TS_ASSERT_EQUALS(res,-1);
+        TS_ASSERT_EQUALS(os.flush(),-1);
+        TS_ASSERT(!os.set_write_behind(0));
+
+        delete [] data;
+    }
+
+    void testBufferPool()
+    {
+        ckcore::BufferPool &pool = ckcore::BufferPool::instance();
+
+        TS_ASSERT_EQUALS(pool.capacity(1),size_t(4096));
+        TS_ASSERT_EQUALS(pool.capacity(4097),size_t(8192));
+        TS_ASSERT_EQUALS(pool.capacity(1024*1024),size_t(1024*1024));
+        TS_ASSERT(pool.capacity(1024*1024 + 1) >= size_t(1024*1024 + 1));
+
+        const size_t sizes[] = { 1,100,4096,5000,65536,300000,1024*1024,
+                                 1024*1024 + 1,3*1024*1024 };
+        for (size_t i = 0; i < sizeof(sizes)/sizeof(size_t); i++)
+        {
+            unsigned char *buffer = static_cast<unsigned char *>(pool.allocate(sizes[i]));
+            TS_ASSERT(buffer != NULL);
+            if (buffer == NULL)
+                continue;
+
+            // All buffers must be page aligned.
+            TS_ASSERT_EQUALS(reinterpret_cast<size_t>(buffer) % 4096,size_t(0));
+
+            memset(buffer,0xaa,pool.capacity(sizes[i]));
+            pool.release(buffer,sizes[i]);
+
+            // Released buffers should be reused.
+            if (sizes[i] <= ckcore::BufferPool::MAX_BUFFER_SIZE)
+            {
+                void *again = pool.allocate(sizes[i]);
+                TS_ASSERT_EQUALS(again,static_cast<void *>(buffer));
+                pool.release(again,sizes[i]);
+            }
+        }
+
+        // Huge pages silently fall back on normal pages.
+        pool.set_huge_pages(true);
+        void *huge = pool.allocate(4*1024*1024);
+        TS_ASSERT(huge != NULL);
+        pool.release(huge,4*1024*1024);
+        pool.set_huge_pages(false);
+
+        pool.trim();
+        TS_ASSERT_EQUALS(pool.cached(),ckcore::tuint64(0));
+    }
+
+    void testMappedFileStream()
+    {
+        ckcore::FileInStream fs(ckT(TEST_SRC_DIR)ckT("/data/file/8253bytes"));
+        TS_ASSERT(fs.open());
+
+        unsigned char ref[8253];
+        TS_ASSERT_EQUALS(fs.read(ref,sizeof(ref)),8253);
+
+        // Test both a small window and mapping the whole file.
+        size_t windows[] = { 4096,0 };
+        for (unsigned int i = 0; i < 2; i++)
+        {
+            ckcore::MappedFileInStream ms(ckT(TEST_SRC_DIR)ckT("/data/file/8253bytes"),
+                                          windows[i]);
+            TS_ASSERT(!ms.test());
+            TS_ASSERT(ms.open());
+            TS_ASSERT(ms.test());
+            TS_ASSERT_EQUALS(ms.size(),8253);
+            TS_ASSERT(ms.advise(ckcore::File::ckADVICE_SEQUENTIAL));
+
+            // Read the file in odd sized chunks.
+            unsigned char buffer[8253];
+            ckcore::tuint32 pos = 0;
+            while (!ms.end())
+            {
+                ckcore::tint64 res = ms.read(buffer + pos,1000);
+                TS_ASSERT(res > 0);
+                if (res <= 0)
+                    break;
+
+                pos += static_cast<ckcore::tuint32>(res);
+            }
+
+            TS_ASSERT_EQUALS(pos,8253);
+            TS_ASSERT_SAME_DATA(buffer,ref,sizeof(ref));
+            TS_ASSERT_EQUALS(ms.read(buffer,1),0);
+
+            // Borrow data across the window boundaries.
+            TS_ASSERT(ms.seek(4000,ckcore::InStream::ckSTREAM_BEGIN));
+            const unsigned char *data = NULL;
+            ckcore::tint64 res = ms.borrow(data,200);
+            TS_ASSERT(res > 0 && res <= 200);
+            TS_ASSERT_SAME_DATA(data,ref + 4000,static_cast<unsigned int>(res));
+
+            TS_ASSERT(ms.seek(static_cast<ckcore::tuint32>(res),ckcore::InStream::ckSTREAM_CURRENT));
+            TS_ASSERT_EQUALS(ms.read(buffer,200),200);
+            TS_ASSERT_SAME_DATA(buffer,ref + 4000 + res,200);
+
+            TS_ASSERT(ms.seek(8200,ckcore::InStream::ckSTREAM_BEGIN));
+            TS_ASSERT_EQUALS(ms.borrow(data,100),53);
+            TS_ASSERT_SAME_DATA(data,ref + 8200,53);
+            TS_ASSERT(ms.seek(53,ckcore::InStream::ckSTREAM_CURRENT));
+            TS_ASSERT(ms.end());
+            TS_ASSERT_EQUALS(ms.borrow(data,100),0);
+
+            // Copying should make use of the mapped data directly.
+            TS_ASSERT(ms.seek(0,ckcore::InStream::ckSTREAM_BEGIN));
+            ckcore::MemoryOutStream os;
+            TS_ASSERT(ckcore::stream::copy(ms,os));
+            TS_ASSERT_EQUALS(os.count(),8253);
+            TS_ASSERT_SAME_DATA(os.data(),ref,sizeof(ref));
+
+            TS_ASSERT(ms.close());
+            TS_ASSERT(!ms.test());
+        }
+
+        ckcore::MappedFileInStream missing(ckT(TEST_SRC_DIR)ckT("/data/file/missing"));
+        TS_ASSERT(!missing.open());
+
+        // Test that lines are parsed the same way when borrowing.
+        char text[] = "first\r\nsecond\n\rthird\rfourth";
+        ckcore::MemoryInStream ts(reinterpret_cast<unsigned char *>(text),
+                                  sizeof(text) - 1);
+        ckcore::LineReader<char> lr(ts);
+        TS_ASSERT_EQUALS(lr.read_line(),"first");
+        TS_ASSERT_EQUALS(lr.read_line(),"second");
+        TS_ASSERT_EQUALS(lr.read_line(),"");
+        TS_ASSERT_EQUALS(lr.read_line(),"third");
+        TS_ASSERT_EQUALS(lr.read_line(),"fourth");
+        TS_ASSERT(lr.end());
+    }
+
     void testCrcStream()
     {
         ckcore::FileInStream is1(ckT(TEST_SRC_DIR)ckT("/data/file/8253bytes"));
@@ -304,6 +947,147 @@ public:
         crc16ibm.reset();
     }
 
+    void testCrcMany()
+    {
+        const ckcore::CrcStream::CrcType types[] =
+        {
+            ckcore::CrcStream::ckCRC_16,
+            ckcore::CrcStream::ckCRC_32,
+            ckcore::CrcStream::ckCRC_CCITT
+        };
+
+        // Use buffers of different sizes, including empty ones, so that both
+        // the interleaved and the remainder paths are exercised.
+        const size_t num = 11;
+        unsigned char data[num][2100];
+        const void *buffers[num];
+        size_t counts[num];
+        for (size_t i = 0; i < num; i++)
+        {
+            for (size_t j = 0; j < sizeof(data[i]); j++)
+                data[i][j] = static_cast<unsigned char>(rand());
+
+            buffers[i] = data[i];
+            counts[i] = i == 3 ? 0 : (rand() % 1600) + 500;
+        }
+
+        for (size_t t = 0; t < sizeof(types)/sizeof(types[0]); t++)
+        {
+            ckcore::tuint32 checksums[num];
+            ckcore::crc::compute_many(types[t],buffers,counts,checksums,num);
+
+            ckcore::CrcStream crc(types[t]);
+            for (size_t i = 0; i < num; i++)
+            {
+                crc.reset();
+                crc.write(buffers[i],static_cast<ckcore::tuint32>(counts[i]));
+                TS_ASSERT_EQUALS(checksums[i],crc.checksum());
+            }
+        }
+
+        // Test from the UDF 1.50 reference.
+        unsigned char bytes[] = { 0x70, 0x6A, 0x77 };
+        const void *udf_buffers[] = { bytes };
+        size_t udf_counts[] = { 3 };
+        ckcore::tuint32 udf_checksum = 0;
+        ckcore::crc::compute_many(ckcore::CrcStream::ckCRC_CCITT,udf_buffers,
+                                  udf_counts,&udf_checksum,1);
+        TS_ASSERT_EQUALS(udf_checksum,ckcore::tuint32(0x3299));
+    }
+
+    void testBlockChecksumStream()
+    {
+        const ckcore::tuint32 block_size = 1000;
+        const ckcore::tuint32 data_size = 25*block_size + 123;
+        unsigned char *data = new unsigned char[data_size];
+        for (ckcore::tuint32 i = 0; i < data_size; i++)
+            data[i] = static_cast<unsigned char>(rand());
+
+        // Write the data in chunks of random size to cross block boundaries.
+        ckcore::BlockChecksumStream bs(block_size);
+        for (ckcore::tuint32 pos = 0; pos < data_size;)
+        {
+            ckcore::tuint32 count = (rand() % 2500) + 1;
+            if (count > data_size - pos)
+                count = data_size - pos;
+
+            TS_ASSERT_EQUALS(bs.write(data + pos,count),ckcore::tint64(count));
+            pos += count;
+        }
+
+        ckcore::BlockManifest manifest = bs.manifest();
+        TS_ASSERT_EQUALS(manifest.block_size(),block_size);
+        TS_ASSERT_EQUALS(manifest.size(),ckcore::tuint64(data_size));
+        TS_ASSERT_EQUALS(manifest.count(),ckcore::tuint64(26));
+
+        ckcore::CrcStream crc(ckcore::CrcStream::ckCRC_32);
+        crc.write(data + 25*block_size,123);
+        TS_ASSERT_EQUALS(manifest.checksum(25),crc.checksum());
+
+        // Save and load the manifest.
+        ckcore::MemoryOutStream os;
+        TS_ASSERT(manifest.save(os));
+        TS_ASSERT_EQUALS(os.count(),ckcore::tuint32(28 + 26*4));
+
+        ckcore::MemoryInStream ms(os.data(),os.count());
+        ckcore::BlockManifest loaded;
+        TS_ASSERT(loaded.load(ms));
+        TS_ASSERT_EQUALS(loaded.count(),manifest.count());
+        TS_ASSERT_EQUALS(loaded.size(),manifest.size());
+        for (ckcore::tuint64 i = 0; i < manifest.count(); i++)
+            TS_ASSERT_EQUALS(loaded.checksum(i),manifest.checksum(i));
+
+        // A manifest claiming more blocks than the stream holds is rejected.
+        std::vector<unsigned char> corrupt(os.data(),os.data() + os.count());
+        const ckcore::tuint64 huge_size = ckcore::tuint64(1) << 40;
+        for (int i = 0; i < 4; i++)
+            corrupt[8 + i] = i == 0 ? 1 : 0;
+        for (int i = 0; i < 8; i++)
+        {
+            corrupt[12 + i] = static_cast<unsigned char>(huge_size >> (i*8));
+            corrupt[20 + i] = static_cast<unsigned char>(huge_size >> (i*8));
+        }
+
+        ckcore::MemoryInStream cs(&corrupt[0],static_cast<ckcore::tuint32>(corrupt.size()));
+        ckcore::BlockManifest rejected;
+        TS_ASSERT(!rejected.load(cs));
+        TS_ASSERT_EQUALS(rejected.count(),ckcore::tuint64(0));
+
+        // Verify intact data.
+        std::vector<ckcore::BlockManifest::Range> mismatches;
+        ckcore::MemoryInStream is1(data,data_size);
+        TS_ASSERT(loaded.verify(is1,mismatches));
+        TS_ASSERT(mismatches.empty());
+
+        // Damage a few blocks.
+        data[3*block_size + 17] ^= 0xff;
+        data[4*block_size] ^= 0xff;
+        data[10*block_size + 999] ^= 0xff;
+
+        ckcore::MemoryInStream is2(data,data_size);
+        TS_ASSERT(loaded.verify(is2,mismatches));
+        TS_ASSERT_EQUALS(mismatches.size(),size_t(2));
+        if (mismatches.size() == 2)
+        {
+            TS_ASSERT_EQUALS(mismatches[0].first,ckcore::tuint64(3));
+            TS_ASSERT_EQUALS(mismatches[0].count,ckcore::tuint64(2));
+            TS_ASSERT_EQUALS(mismatches[1].first,ckcore::tuint64(10));
+            TS_ASSERT_EQUALS(mismatches[1].count,ckcore::tuint64(1));
+        }
+
+        // A truncated stream reports the missing blocks.
+        ckcore::MemoryInStream is3(data,20*block_size + 5);
+        TS_ASSERT(loaded.verify(is3,mismatches));
+        TS_ASSERT_EQUALS(mismatches.size(),size_t(3));
+        if (mismatches.size() == 3)
+        {
+            TS_ASSERT_EQUALS(mismatches[2].first,ckcore::tuint64(20));
+            TS_ASSERT_EQUALS(mismatches[2].count,ckcore::tuint64(6));
+        }
+
+        delete [] data;
+    }
+
     void testMemoryStream()
     {
         unsigned char in_data[] = { 0x00,0x11,0x22,0x33,0x44,0x55,0x66,0x77 };
@@ -349,6 +1133,127 @@ public:
         TS_ASSERT_SAME_DATA(os.data(),in_data,8);
     }
 
+    void testSegmentedMemoryStream()
+    {
+        std::vector<unsigned char> data(100000);
+        for (size_t i = 0; i < data.size(); i++)
+            data[i] = static_cast<unsigned char>((i*7) ^ (i >> 8));
+
+        ckcore::SegmentedMemoryOutStream os(4096);
+        TS_ASSERT_EQUALS(os.count(),0);
+        TS_ASSERT_EQUALS(os.segments(),0);
+
+        // Write using odd sizes to cross segment boundaries.
+        for (size_t pos = 0; pos < data.size(); pos += 333)
+        {
+            ckcore::tuint32 count = static_cast<ckcore::tuint32>(std::min<size_t>(333,data.size() - pos));
+            TS_ASSERT_EQUALS(os.write(&data[pos],count),count);
+        }
+
+        TS_ASSERT_EQUALS(os.count(),data.size());
+        TS_ASSERT(os.segments() > 1);
+
+        // All segments except the last one should be full.
+        size_t pos = 0;
+        for (size_t i = 0; i < os.segments(); i++)
+        {
+            if (i + 1 < os.segments())
+                TS_ASSERT_EQUALS(os.segment_count(i),os.segment_count(0));
+
+            TS_ASSERT_SAME_DATA(os.segment(i),&data[pos],os.segment_count(i));
+            pos += os.segment_count(i);
+        }
+        TS_ASSERT_EQUALS(pos,data.size());
+
+        ckcore::MemoryOutStream copy;
+        TS_ASSERT(os.write_to(copy));
+        TS_ASSERT_EQUALS(copy.count(),data.size());
+        TS_ASSERT_SAME_DATA(copy.data(),&data[0],copy.count());
+
+        // Hand over the segments to an input stream.
+        ckcore::SegmentedMemoryInStream is(os);
+        TS_ASSERT_EQUALS(os.count(),0);
+        TS_ASSERT_EQUALS(os.segments(),0);
+        TS_ASSERT_EQUALS(is.size(),static_cast<ckcore::tint64>(data.size()));
+
+        std::vector<unsigned char> out_data(data.size());
+        TS_ASSERT_EQUALS(is.read(&out_data[0],static_cast<ckcore::tuint32>(out_data.size())),
+                         static_cast<ckcore::tint64>(data.size()));
+        TS_ASSERT(is.end());
+        TS_ASSERT_SAME_DATA(&out_data[0],&data[0],data.size());
+
+        // Test seeking and borrowing.
+        TS_ASSERT(is.seek(100000,ckcore::InStream::ckSTREAM_CURRENT));
+        TS_ASSERT(is.end());
+        TS_ASSERT(is.seek(50000,ckcore::InStream::ckSTREAM_BEGIN));
+        TS_ASSERT(!is.end());
+
+        const unsigned char *buffer = NULL;
+        ckcore::tint64 res = is.borrow(buffer,100000);
+        TS_ASSERT(res > 0 && res <= 50000);
+        TS_ASSERT_SAME_DATA(buffer,&data[50000],static_cast<unsigned int>(res));
+
+        TS_ASSERT_EQUALS(is.read(&out_data[0],60000),50000);
+        TS_ASSERT_SAME_DATA(&out_data[0],&data[50000],50000);
+
+        // The output stream should be usable again.
+        TS_ASSERT_EQUALS(os.write(&data[0],10),10);
+        TS_ASSERT_EQUALS(os.count(),10);
+    }
+
+    void testSharedBuffer()
+    {
+        unsigned char in_data[] = { 0x00,0x11,0x22,0x33,0x44,0x55,0x66,0x77 };
+
+        ckcore::SharedBuffer empty;
+        TS_ASSERT(empty.empty());
+        TS_ASSERT_EQUALS(empty.size(),0);
+
+        ckcore::MemoryInStream *is = NULL;
+        {
+            ckcore::SharedBuffer buffer(in_data,8);
+            TS_ASSERT_EQUALS(buffer.size(),8);
+            TS_ASSERT_SAME_DATA(buffer.data(),in_data,8);
+
+            // Slices should reference the same data.
+            ckcore::SharedBuffer slice = buffer.slice(2,4);
+            TS_ASSERT_EQUALS(slice.size(),4);
+            TS_ASSERT_EQUALS(slice.data(),buffer.data() + 2);
+
+            TS_ASSERT_EQUALS(slice.slice(3,100).size(),1);
+            TS_ASSERT(slice.slice(100,1).empty());
+
+            ckcore::SharedBuffer copy;
+            copy = slice;
+            copy = copy;
+            TS_ASSERT_EQUALS(copy.data(),slice.data());
+
+            // The stream should keep the data alive.
+            is = new ckcore::MemoryInStream(slice);
+        }
+
+        TS_ASSERT_EQUALS(is->size(),4);
+
+        unsigned char out_data[8];
+        TS_ASSERT_EQUALS(is->read(out_data,8),4);
+        TS_ASSERT(is->end());
+        TS_ASSERT_SAME_DATA(out_data,in_data + 2,4);
+        delete is;
+
+        // Take over the data of a memory stream.
+        ckcore::MemoryOutStream os;
+        os.write(in_data,8);
+        const unsigned char *os_data = os.data();
+
+        ckcore::SharedBuffer buffer(os);
+        TS_ASSERT_EQUALS(buffer.data(),os_data);
+        TS_ASSERT_EQUALS(buffer.size(),8);
+        TS_ASSERT_EQUALS(os.count(),0);
+
+        TS_ASSERT_EQUALS(os.write(in_data,4),4);
+        TS_ASSERT_SAME_DATA(buffer.data(),in_data,8);
+    }
+
     void testNullStream()
     {
         ckcore::NullStream ns;
@@ -392,4 +1297,61 @@ public:
         TS_ASSERT(ckcore::stream::copy(is1,ns4,p,9200));
         TS_ASSERT_EQUALS(ns4.written(),ckcore::tuint64(9200));
     }
+
+    void testFileCopy()
+    {
+        ckcore::File src = ckcore::File::temp(ckT("ckcore-test-copy"));
+        ckcore::File dst = ckcore::File::temp(ckT("ckcore-test-copy"));
+
+        // Create a sparse file with data at the beginning and in the middle,
+        // followed by a hole.
+        const ckcore::tint64 size = 12*1024*1024 + 17;
+        unsigned char data[5000];
+        for (unsigned int i = 0; i < sizeof(data); i++)
+            data[i] = static_cast<unsigned char>(rand());
+
+        TS_ASSERT_THROWS_NOTHING(src.open2(ckcore::File::ckOPEN_WRITE));
+        TS_ASSERT_EQUALS(src.write(data,sizeof(data)),sizeof(data));
+        TS_ASSERT_EQUALS(src.seek2(5*1024*1024,ckcore::File::ckFILE_BEGIN),5*1024*1024);
+        TS_ASSERT_EQUALS(src.write(data,sizeof(data)),sizeof(data));
+        TS_ASSERT_EQUALS(src.seek2(size - 1,ckcore::File::ckFILE_BEGIN),size - 1);
+        TS_ASSERT_EQUALS(src.write(data,1),1);
+        TS_ASSERT(src.close());
+
+        DummyProgress dp;
+        ckcore::Progresser p(dp,size);
+        TS_ASSERT(ckcore::File::copy(src.name().c_str(),dst.name().c_str(),p));
+        TS_ASSERT_EQUALS(dst.size2(),size);
+
+        // Compare the contents.
+        ckcore::FileInStream is1(src.name().c_str()),is2(dst.name().c_str());
+        TS_ASSERT(is1.open());
+        TS_ASSERT(is2.open());
+
+        ckcore::CrcStream crc1(ckcore::CrcStream::ckCRC_32);
+        ckcore::CrcStream crc2(ckcore::CrcStream::ckCRC_32);
+        TS_ASSERT(ckcore::stream::copy(is1,crc1));
+        TS_ASSERT(ckcore::stream::copy(is2,crc2));
+        TS_ASSERT_EQUALS(crc1.checksum(),crc2.checksum());
+
+        is1.close();
+        is2.close();
+
+        // Copying a file onto itself should fail without truncating it.
+        TS_ASSERT(!ckcore::File::copy(src.name().c_str(),src.name().c_str(),p));
+        TS_ASSERT_EQUALS(src.size2(),size);
+
+#ifndef _WINDOWS
+        ckcore::File link = ckcore::File::temp(ckT("ckcore-test-copy"));
+        TS_ASSERT_EQUALS(::link(src.name().c_str(),link.name().c_str()),0);
+        TS_ASSERT(!ckcore::File::copy(src.name().c_str(),link.name().c_str(),p));
+        TS_ASSERT_EQUALS(src.size2(),size);
+        TS_ASSERT(link.remove());
+#endif
+
+        // Copying a missing file should fail.
+        TS_ASSERT(src.remove());
+        TS_ASSERT(!ckcore::File::copy(src.name().c_str(),dst.name().c_str(),p));
+        TS_ASSERT(dst.remove());
+    }
 };